@@ -168,10 +168,18 @@ HEADERS += src/qt/bitcoingui.h \
     src/ui_interface.h \
     src/qt/rpcconsole.h \
     src/kernel.h \
+    src/kernelhash.h \
+    src/kernelhash_lanes.h \
+    src/unspent.h \
     src/hashblock/pbkdf2.h \
     src/hashblock/ramhog.h \
+    src/hashblock/ramhog_lanes.h \
     src/hashblock/hashblock.h \
     src/hashblock/ramhog_mt.h \
+    src/hashblock/ramhog_alloc.h \
+    src/hashcache.h \
+    src/checkqueue.h \
+    src/ramhogipc.h \
     src/txinfo.h \
     src/SQLiteCpp/Assertion.h \
     src/SQLiteCpp/Column.h \
@@ -242,10 +250,13 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/qtipcserver.cpp \
     src/qt/rpcconsole.cpp \
     src/kernel.cpp \
+    src/kernelhash.cpp \
+    src/unspent.cpp \
     src/hashblock/pbkdf2.c \
     src/hashblock/ramhog.c \
     src/hashblock/hashblock.cpp \
     src/hashblock/ramhog_mt.cpp \
+    src/hashblock/ramhog_alloc.cpp \
     src/txinfo.cpp \
     src/SQLiteCpp/Column.cpp \
     src/SQLiteCpp/Database.cpp \
@@ -253,7 +264,9 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/SQLiteCpp/Statement.cpp \
     src/SQLiteCpp/Transaction.cpp \
     src/alert.cpp \
-    src/signedhash.cpp
+    src/signedhash.cpp \
+    src/hashcache.cpp \
+    src/ramhogipc.cpp
 
 RESOURCES += \
     src/qt/bitcoin.qrc
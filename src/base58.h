@@ -237,6 +237,24 @@ public:
         vchData.clear();
     }
     
+    // The version byte followed by the data, without the base58 encoding
+    std::vector<unsigned char> GetVersionedData() const
+    {
+        std::vector<unsigned char> vch(1, nVersion);
+        vch.insert(vch.end(), vchData.begin(), vchData.end());
+        return vch;
+    }
+    
+    void SetVersionedData(const unsigned char* pch, size_t nSize)
+    {
+        if (nSize == 0)
+        {
+            Clear();
+            return;
+        }
+        SetData(pch[0], pch + 1, nSize - 1);
+    }
+    
     std::string ToString() const
     {
         std::vector<unsigned char> vch(1, nVersion);
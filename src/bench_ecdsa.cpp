@@ -0,0 +1,179 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Standalone timing harness for ECDSA signature verification.
+//
+// Signs -sigs signatures with each of -keys keys, then verifies all of them
+// the old way (a fresh CKey and SetPubKey per signature, as CheckSig did),
+// and with CKey::VerifyPubKey, cold and then with its key cache warm. The
+// cached path is then run on each -threads count, the way the script-check
+// threads call it. Every result is written as one JSON object per line, to
+// stdout or -out.
+//
+//   bench_ecdsa [-keys=<n>] [-sigs=<n>] [-threads=1,2,4] [-out=<file>]
+//
+
+#include "main.h"
+#include "wallet.h"
+#include "key.h"
+#include "util.h"
+
+#include "json/json_spirit_writer_template.h"
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace json_spirit;
+
+// init.o is not linked in
+CWallet* pwalletMain;
+
+void Shutdown(void* parg)
+{
+    exit(0);
+}
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+struct CBenchSig
+{
+    vector<unsigned char> vchPubKey;
+    uint256 hash;
+    vector<unsigned char> vchSig;
+};
+
+static FILE* fileOut = stdout;
+
+static void WriteResult(const Object& result)
+{
+    fprintf(fileOut, "%s\n", write_string(Value(result), false).c_str());
+    fflush(fileOut);
+}
+
+static void VerifyRange(const vector<CBenchSig>* pvSigs, unsigned int nBegin, unsigned int nEnd, int* pnValid)
+{
+    for (unsigned int i = nBegin; i < nEnd; i++)
+        if (CKey::VerifyPubKey((*pvSigs)[i].vchPubKey, (*pvSigs)[i].hash, (*pvSigs)[i].vchSig))
+            (*pnValid)++;
+}
+
+static void WriteTiming(const string& strPath, int nThreads, int64 nMicros, int nValid, unsigned int nSigs)
+{
+    Object result;
+    result.push_back(Pair("bench", "verify"));
+    result.push_back(Pair("path", strPath));
+    result.push_back(Pair("threads", nThreads));
+    result.push_back(Pair("sigs", (int)nSigs));
+    result.push_back(Pair("valid", nValid));
+    result.push_back(Pair("us_per_sig", max(nMicros, (int64)1) * 1.0 / nSigs));
+    result.push_back(Pair("sigs_per_sec", nSigs * 1000000.0 / max(nMicros, (int64)1)));
+    WriteResult(result);
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("--help"))
+    {
+        fprintf(stderr,
+                "Usage: bench_ecdsa [options]\n"
+                "  -keys=<n>       \t  Distinct public keys (default: 200)\n"
+                "  -sigs=<n>       \t  Signatures per key (default: 10)\n"
+                "  -threads=<n,...>\t  Thread counts for the cached path (default: 1 and the number of processors)\n"
+                "  -out=<file>     \t  Write results to <file> instead of stdout\n");
+        return 1;
+    }
+
+    if (mapArgs.count("-out"))
+    {
+        fileOut = fopen(mapArgs["-out"].c_str(), "a");
+        if (!fileOut)
+        {
+            fprintf(stderr, "bench_ecdsa: cannot open %s\n", mapArgs["-out"].c_str());
+            return 1;
+        }
+    }
+
+    int nKeys = max((int)GetArg("-keys", 200), 1);
+    int nSigsPerKey = max((int)GetArg("-sigs", 10), 1);
+    int nProcessors = boost::thread::hardware_concurrency();
+    if (nProcessors < 1)
+        nProcessors = 1;
+    vector<string> vStrThreads;
+    ParseString(GetArg("-threads", strprintf("1,%d", nProcessors)), ',', vStrThreads);
+
+    // half the keys compressed, as both kinds are in the chain; signatures
+    // interleaved across keys, as in a block
+    vector<CBenchSig> vSigs(nKeys * nSigsPerKey);
+    for (int k = 0; k < nKeys; k++)
+    {
+        CKey key;
+        key.MakeNewKey(k % 2 == 1);
+        vector<unsigned char> vchPubKey = key.GetPubKey();
+        for (int j = 0; j < nSigsPerKey; j++)
+        {
+            CBenchSig& sig = vSigs[j * nKeys + k];
+            sig.vchPubKey = vchPubKey;
+            sig.hash = GetRandHash();
+            if (!key.Sign(sig.hash, sig.vchSig))
+            {
+                fprintf(stderr, "bench_ecdsa: signing failed\n");
+                return 1;
+            }
+        }
+    }
+
+    int nValid = 0;
+    int64 nStart = GetTimeMicros();
+    BOOST_FOREACH(const CBenchSig& sig, vSigs)
+    {
+        CKey key;
+        if (key.SetPubKey(sig.vchPubKey) && key.Verify(sig.hash, sig.vchSig))
+            nValid++;
+    }
+    WriteTiming("fresh_key", 1, GetTimeMicros() - nStart, nValid, vSigs.size());
+
+    nValid = 0;
+    nStart = GetTimeMicros();
+    VerifyRange(&vSigs, 0, vSigs.size(), &nValid);
+    WriteTiming("cached_cold", 1, GetTimeMicros() - nStart, nValid, vSigs.size());
+
+    BOOST_FOREACH(const string& strThreads, vStrThreads)
+    {
+        int nThreads = atoi(strThreads);
+        if (nThreads < 1)
+            continue;
+        vector<int> vValid(nThreads, 0);
+        boost::thread_group threads;
+        nStart = GetTimeMicros();
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&VerifyRange, &vSigs, vSigs.size() * i / nThreads,
+                                              vSigs.size() * (i + 1) / nThreads, &vValid[i]));
+        threads.join_all();
+        int64 nMicros = GetTimeMicros() - nStart;
+        nValid = 0;
+        BOOST_FOREACH(int n, vValid)
+            nValid += n;
+        WriteTiming("cached_warm", nThreads, nMicros, nValid, vSigs.size());
+    }
+
+    uint64 nHits, nMisses;
+    CKey::GetPubKeyCacheStats(nHits, nMisses);
+    Object result;
+    result.push_back(Pair("bench", "pubkeycache"));
+    result.push_back(Pair("hits", (boost::uint64_t)nHits));
+    result.push_back(Pair("misses", (boost::uint64_t)nMisses));
+    WriteResult(result);
+
+    if (fileOut != stdout)
+        fclose(fileOut);
+    return 0;
+}
@@ -0,0 +1,363 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Standalone timing harness for the ramhog proof-of-work kernel.
+//
+// Times pad generation (ramhog_gen_pad) and the random walk
+// (ramhog_run_iterations) separately on a single thread, then the same
+// phases in low-memory mode for each -maxmem budget, then sweeps
+// CRamhogThreadPool over -ramhogworkers / -ramhogthreads style counts.
+// Every result is written as one JSON object per line, to stdout or -out.
+//
+//   bench_ramhog [-preset=small,test,main] [-N=<n> -C=<n> -I=<n>]
+//                [-workers=1,2,4] [-threads=1,2] [-hashes=<n>] [-maxmem=<MB,...>]
+//                [-out=<file>]
+//
+
+#include "main.h"
+#include "wallet.h"
+#include "util.h"
+#include "hashblock/hashblock.h"
+#include "hashblock/ramhog.h"
+#include "hashblock/ramhog_mt.h"
+
+#include "json/json_spirit_writer_template.h"
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+using namespace json_spirit;
+
+// init.o is not linked in
+CWallet* pwalletMain;
+
+void Shutdown(void* parg)
+{
+    exit(0);
+}
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+const uint32_t SMALL_SHINY_PADS = 16;
+const uint32_t SMALL_SHINY_CHUNKS = 1048576;
+const uint32_t SMALL_SHINY_ITERS = 131072;
+
+struct CBenchParams
+{
+    string strName;
+    uint32_t N, C, I;
+};
+
+// one full-memory run, for comparing low-memory runs against
+struct CBenchPhaseResult
+{
+    uint256 hash;
+    double dGenSecs, dWalkSecs;
+};
+
+static FILE* fileOut = stdout;
+
+static void WriteResult(const Object& result)
+{
+    fprintf(fileOut, "%s\n", write_string(Value(result), false).c_str());
+    fflush(fileOut);
+}
+
+static vector<int> GetIntListArg(const string& strArg, const string& strDefault)
+{
+    vector<string> vStr;
+    vector<int> vRet;
+    ParseString(GetArg(strArg, strDefault), ',', vStr);
+    BOOST_FOREACH(const string& str, vStr)
+        if (!str.empty())
+            vRet.push_back(atoi(str));
+    return vRet;
+}
+
+static void BenchInput(unsigned char* pch, unsigned int nSeq)
+{
+    // 80-byte header-sized input, distinct per hash
+    for (int i = 0; i < 80; i++)
+        pch[i] = (unsigned char)(i * 7 + nSeq);
+    memcpy(pch + 76, &nSeq, 4);
+}
+
+static void BenchPhases(const CBenchParams& params, int nHashes, vector<CBenchPhaseResult>& vResults)
+{
+    uint64_t** scratchpads = (uint64_t **)malloc(sizeof(uint64_t *) * params.N);
+    for (uint32_t j = 0; j < params.N; j++)
+    {
+        scratchpads[j] = (uint64_t *)malloc(sizeof(uint64_t) * params.C);
+        if (!scratchpads[j])
+        {
+            fprintf(stderr, "bench_ramhog: cannot allocate %.2fGB for preset %s\n",
+                    params.N * 1.0 * params.C * 8 / 1024.0 / 1024.0 / 1024.0, params.strName.c_str());
+            for (uint32_t k = 0; k < j; k++)
+                free(scratchpads[k]);
+            free(scratchpads);
+            return;
+        }
+    }
+
+    for (int n = 0; n < nHashes; n++)
+    {
+        unsigned char input[80];
+        uint256 hash;
+        BenchInput(input, n);
+
+        int64 nStart = GetTimeMicros();
+        ramhog_gen_pads(input, sizeof(input), params.C, 0, params.N, scratchpads);
+        int64 nGenerated = GetTimeMicros();
+        ramhog_run_iterations(input, sizeof(input), (uint8_t *)&hash, sizeof(hash),
+                              params.N, params.C, params.I, scratchpads);
+        int64 nDone = GetTimeMicros();
+
+        double dGenSecs = max(nGenerated - nStart, (int64)1) / 1000000.0;
+        double dWalkSecs = max(nDone - nGenerated, (int64)1) / 1000000.0;
+
+        Object result;
+        result.push_back(Pair("bench", "phases"));
+        result.push_back(Pair("preset", params.strName));
+        result.push_back(Pair("N", (int)params.N));
+        result.push_back(Pair("C", (int)params.C));
+        result.push_back(Pair("I", (int)params.I));
+        result.push_back(Pair("run", n));
+        result.push_back(Pair("lanes", (int)ramhog_lanes()));
+        result.push_back(Pair("gen_pad_secs", dGenSecs));
+        result.push_back(Pair("walk_secs", dWalkSecs));
+        result.push_back(Pair("pad_fill_gbps", params.N * 1.0 * params.C * sizeof(uint64_t) / dGenSecs / 1e9));
+        result.push_back(Pair("ns_per_read", dWalkSecs * 1e9 / params.I));
+        result.push_back(Pair("hash", hash.GetHex()));
+        WriteResult(result);
+
+        CBenchPhaseResult phases = {hash, dGenSecs, dWalkSecs};
+        vResults.push_back(phases);
+    }
+
+    for (uint32_t j = 0; j < params.N; j++)
+        free(scratchpads[j]);
+    free(scratchpads);
+}
+
+static void BenchLowMem(const CBenchParams& params, int nMaxMB, const vector<CBenchPhaseResult>& vFull)
+{
+    uint32_t nSegmentChunks = ramhog_lowmem_segment_chunks(params.N, params.C, (uint64_t)nMaxMB * 1024 * 1024);
+    vector<ramhog_lowmem_pad> vPads(params.N);
+    uint64_t nBytes = 0;
+    for (uint32_t j = 0; j < params.N; j++)
+    {
+        memset(&vPads[j], 0, sizeof(ramhog_lowmem_pad));
+        if (!ramhog_pad_reachable(params.N, j))
+            continue;
+        if (!ramhog_lowmem_alloc(&vPads[j], params.C, nSegmentChunks))
+        {
+            fprintf(stderr, "bench_ramhog: cannot allocate low-memory pads for preset %s\n", params.strName.c_str());
+            for (uint32_t k = 0; k < j; k++)
+                ramhog_lowmem_free(&vPads[k]);
+            return;
+        }
+        nBytes += ramhog_lowmem_pad_bytes(params.C, nSegmentChunks);
+    }
+
+    for (unsigned int n = 0; n < vFull.size(); n++)
+    {
+        unsigned char input[80];
+        uint256 hash;
+        BenchInput(input, n);
+
+        int64 nStart = GetTimeMicros();
+        for (uint32_t j = 0; j < params.N; j++)
+            if (vPads[j].C)
+                ramhog_lowmem_fill(&vPads[j], input, sizeof(input), j, NULL);
+        int64 nGenerated = GetTimeMicros();
+        ramhog_run_iterations_lowmem(input, sizeof(input), (uint8_t *)&hash, sizeof(hash),
+                                     params.N, params.C, params.I, &vPads[0], NULL);
+        int64 nDone = GetTimeMicros();
+
+        double dGenSecs = max(nGenerated - nStart, (int64)1) / 1000000.0;
+        double dWalkSecs = max(nDone - nGenerated, (int64)1) / 1000000.0;
+
+        Object result;
+        result.push_back(Pair("bench", "lowmem"));
+        result.push_back(Pair("preset", params.strName));
+        result.push_back(Pair("N", (int)params.N));
+        result.push_back(Pair("C", (int)params.C));
+        result.push_back(Pair("I", (int)params.I));
+        result.push_back(Pair("run", (int)n));
+        result.push_back(Pair("maxmem_mb", nMaxMB));
+        result.push_back(Pair("pad_mb", nBytes / 1024.0 / 1024.0));
+        result.push_back(Pair("segment_chunks", (int)nSegmentChunks));
+        result.push_back(Pair("gen_pad_secs", dGenSecs));
+        result.push_back(Pair("walk_secs", dWalkSecs));
+        result.push_back(Pair("slowdown", (dGenSecs + dWalkSecs) / (vFull[n].dGenSecs + vFull[n].dWalkSecs)));
+        result.push_back(Pair("matches_full", hash == vFull[n].hash));
+        WriteResult(result);
+    }
+
+    for (uint32_t j = 0; j < params.N; j++)
+        ramhog_lowmem_free(&vPads[j]);
+}
+
+static void BenchPoolThread(CRamhogThreadPool* pool, unsigned int nFirst, int nCount, int* pnFailed)
+{
+    for (int n = 0; n < nCount; n++)
+    {
+        unsigned char input[80];
+        uint256 hash;
+        BenchInput(input, nFirst + n);
+        if (!pool->ramhog(input, sizeof(input), (uint8_t *)&hash, sizeof(hash), false))
+            (*pnFailed)++;
+    }
+}
+
+static void BenchPool(const CBenchParams& params, int nWorkers, int nThreads, int nHashes)
+{
+    // give every concurrent slot at least one hash
+    int nPerThread = max(1, (nHashes + nThreads - 1) / nThreads);
+
+    CRamhogThreadPool* pool = new CRamhogThreadPool(params.N, params.C, params.I, nThreads, nWorkers,
+                                                    GetArg("-ramhoghugepages", "auto"), GetBoolArg("-ramhognuma", true),
+                                                    GetBoolArg("-ramhogpipeline", true),
+                                                    GetBoolArg("-ramhogbatchwalks", true),
+                                                    GetArg("-ramhogmaxmem", 0) * 1024 * 1024);
+
+    vector<int> vFailed(nThreads, 0);
+    boost::thread_group threads;
+    int64 nStart = GetTimeMicros();
+    for (int i = 0; i < nThreads; i++)
+        threads.create_thread(boost::bind(&BenchPoolThread, pool, i * nPerThread, nPerThread, &vFailed[i]));
+    threads.join_all();
+    double dSecs = max(GetTimeMicros() - nStart, (int64)1) / 1000000.0;
+
+    delete pool;
+
+    int nFailed = 0;
+    BOOST_FOREACH(int n, vFailed)
+        nFailed += n;
+    int nTotal = nPerThread * nThreads;
+
+    Object result;
+    result.push_back(Pair("bench", "pool"));
+    result.push_back(Pair("preset", params.strName));
+    result.push_back(Pair("N", (int)params.N));
+    result.push_back(Pair("C", (int)params.C));
+    result.push_back(Pair("I", (int)params.I));
+    result.push_back(Pair("ramhogworkers", nWorkers));
+    result.push_back(Pair("ramhogthreads", nThreads));
+    result.push_back(Pair("ramhogpipeline", GetBoolArg("-ramhogpipeline", true)));
+    result.push_back(Pair("ramhogbatchwalks", GetBoolArg("-ramhogbatchwalks", true)));
+    result.push_back(Pair("hashes", nTotal));
+    result.push_back(Pair("failed", nFailed));
+    result.push_back(Pair("secs", dSecs));
+    result.push_back(Pair("hashes_per_min", (nTotal - nFailed) * 60.0 / dSecs));
+    result.push_back(Pair("pad_fill_gbps", (nTotal - nFailed) * params.N * 1.0 * params.C * sizeof(uint64_t) / dSecs / 1e9));
+    WriteResult(result);
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+    fPrintToConsole = true;
+
+    if (mapArgs.count("-?") || mapArgs.count("--help"))
+    {
+        fprintf(stderr,
+                "Usage: bench_ramhog [options]\n"
+                "  -preset=<list>  \t  Comma separated presets to run: small, test, main (default: small)\n"
+                "  -N=<n> -C=<n> -I=<n>\t  Run a custom pads/chunks/iterations preset instead\n"
+                "  -workers=<list> \t  Worker thread counts to sweep (default: 1,<processors>)\n"
+                "  -threads=<list> \t  Concurrent hash counts to sweep (default: 1,2)\n"
+                "  -hashes=<n>     \t  Hashes per measurement (default: 2)\n"
+                "  -maxmem=<list>  \t  Low-memory pad budgets in MB to time against the full phases (default: none)\n"
+                "  -nopool         \t  Only time the single threaded phases\n"
+                "  -ramhoghugepages=<mode>\t  Pool scratchpad backing: auto, 1gb, 2mb, thp or none (default: auto)\n"
+                "  -ramhognuma     \t  Bind pool scratchpad sets to NUMA nodes (default: 1)\n"
+                "  -ramhoglanes=<n>\t  Pads filled at once in SIMD lanes: 1, 4 or 8 (default: 4)\n"
+                "  -ramhogpipeline \t  Overlap pad fills with walks across pool slots (default: 1)\n"
+                "  -ramhogbatchwalks\t  Interleave concurrent walks on one thread (default: 1)\n"
+                "  -out=<file>     \t  Write results to <file> instead of stdout\n");
+        return 1;
+    }
+
+    if (mapArgs.count("-out"))
+    {
+        fileOut = fopen(mapArgs["-out"].c_str(), "a");
+        if (!fileOut)
+        {
+            fprintf(stderr, "bench_ramhog: cannot open %s\n", mapArgs["-out"].c_str());
+            return 1;
+        }
+    }
+
+    vector<CBenchParams> vParams;
+    if (mapArgs.count("-N") || mapArgs.count("-C") || mapArgs.count("-I"))
+    {
+        CBenchParams params = {"custom",
+                               (uint32_t)GetArg("-N", SMALL_SHINY_PADS),
+                               (uint32_t)GetArg("-C", SMALL_SHINY_CHUNKS),
+                               (uint32_t)GetArg("-I", SMALL_SHINY_ITERS)};
+        vParams.push_back(params);
+    }
+    else
+    {
+        vector<string> vPresets;
+        ParseString(GetArg("-preset", "small"), ',', vPresets);
+        BOOST_FOREACH(const string& strPreset, vPresets)
+        {
+            CBenchParams params = {strPreset, 0, 0, 0};
+            if (strPreset == "main")
+            {
+                params.N = MAIN_SHINY_PADS; params.C = MAIN_SHINY_CHUNKS; params.I = MAIN_SHINY_ITERS;
+            }
+            else if (strPreset == "test")
+            {
+                params.N = TEST_SHINY_PADS; params.C = TEST_SHINY_CHUNKS; params.I = TEST_SHINY_ITERS;
+            }
+            else if (strPreset == "small")
+            {
+                params.N = SMALL_SHINY_PADS; params.C = SMALL_SHINY_CHUNKS; params.I = SMALL_SHINY_ITERS;
+            }
+            else
+            {
+                fprintf(stderr, "bench_ramhog: unknown preset %s\n", strPreset.c_str());
+                return 1;
+            }
+            vParams.push_back(params);
+        }
+    }
+
+    int nProcessors = boost::thread::hardware_concurrency();
+    if (nProcessors < 1)
+        nProcessors = 1;
+    vector<int> vWorkers = GetIntListArg("-workers", strprintf("1,%d", nProcessors));
+    vector<int> vThreads = GetIntListArg("-threads", "1,2");
+    vector<int> vMaxMem = GetIntListArg("-maxmem", "");
+    int nHashes = max((int)GetArg("-hashes", 2), 1);
+    ramhog_set_max_lanes(GetArg("-ramhoglanes", 4));
+
+    BOOST_FOREACH(const CBenchParams& params, vParams)
+    {
+        vector<CBenchPhaseResult> vFull;
+        BenchPhases(params, nHashes, vFull);
+        BOOST_FOREACH(int nMaxMB, vMaxMem)
+            if (nMaxMB > 0)
+                BenchLowMem(params, nMaxMB, vFull);
+
+        if (GetBoolArg("-nopool"))
+            continue;
+
+        BOOST_FOREACH(int nThreads, vThreads)
+            BOOST_FOREACH(int nWorkers, vWorkers)
+                if (nThreads > 0 && nWorkers > 0)
+                    BenchPool(params, nWorkers, nThreads, nHashes);
+    }
+
+    if (fileOut != stdout)
+        fclose(fileOut);
+    return 0;
+}
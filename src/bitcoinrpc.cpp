@@ -470,6 +470,27 @@ Value getmininginfo(const Array& params, bool fHelp)
 }
 
 
+Value getsigcacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "Returns an object containing signature cache statistics.");
+
+    uint64 nHits, nMisses, nEvictions, nEntries;
+    const CSignatureCache& signatureCache = GetSignatureCache();
+    signatureCache.GetStats(nHits, nMisses, nEvictions, nEntries);
+
+    Object obj;
+    obj.push_back(Pair("entries",       (boost::uint64_t)nEntries));
+    obj.push_back(Pair("maxentries",    (boost::uint64_t)signatureCache.GetMaxEntries()));
+    obj.push_back(Pair("hits",          (boost::uint64_t)nHits));
+    obj.push_back(Pair("misses",        (boost::uint64_t)nMisses));
+    obj.push_back(Pair("evictions",     (boost::uint64_t)nEvictions));
+    return obj;
+}
+
+
 Value getnewaddress(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -2353,6 +2374,18 @@ TxInfoType GetInfoType(const std::string &str)
     throw JSONRPCError(-32602, "Info type is one of 'normal', 'once', 'unique', or 'id'");
 }
 
+string GetInfoTypeName(unsigned char type)
+{
+    switch (type)
+    {
+        case INFO_NORMAL:       return "normal";
+        case INFO_WRITE_ONCE:   return "once";
+        case INFO_UNIQUE:       return "unique";
+        case INFO_ID:           return "id";
+    }
+    return "invalid";
+}
+
 Value settxinfos(const Array& params, bool fHelp)
 {
     if (pwalletMain->IsCrypted() && (fHelp || params.size() < 4 || (params.size() - 1) % 3 != 0))
@@ -2439,6 +2472,140 @@ Value dumptxinfos(const Array& params, bool fHelp)
     return Value::null;
 }
 
+static const int MAX_TXINFO_PAGE = 1000;
+
+Object TxInfoRecordToJSON(const TxInfoRecord &record)
+{
+    Object entry;
+    entry.push_back(Pair("address", record.addr.ToString()));
+    entry.push_back(Pair("type", GetInfoTypeName(record.info.key.type)));
+    entry.push_back(Pair("key", record.info.key.keyString));
+    entry.push_back(Pair("value", record.info.value));
+    entry.push_back(Pair("blockhash", record.blockHash.GetHex()));
+    entry.push_back(Pair("tx", record.indexTx));
+    entry.push_back(Pair("txin", record.indexTxIn));
+    entry.push_back(Pair("info", record.indexInfo));
+    return entry;
+}
+
+// params[nFirst] and params[nFirst+1] are [count] [cursor]
+void GetTxInfoPage(const Array& params, unsigned int nFirst, int &nCount, int64 &nCursor)
+{
+    nCount = 100;
+    if (params.size() > nFirst)
+        nCount = params[nFirst].get_int();
+    if (nCount < 1 || nCount > MAX_TXINFO_PAGE)
+        throw JSONRPCError(-8, strprintf("count must be between 1 and %d", MAX_TXINFO_PAGE));
+    
+    nCursor = 0;
+    if (params.size() > nFirst + 1)
+        nCursor = params[nFirst + 1].get_int64();
+}
+
+// A full page may be followed by more: hand back the cursor to continue from
+Object TxInfoPageToJSON(const vector<TxInfoRecord> &vRecords, int nCount, int64 nCursor)
+{
+    Array infos;
+    BOOST_FOREACH(const TxInfoRecord &record, vRecords)
+        infos.push_back(TxInfoRecordToJSON(record));
+    
+    Object result;
+    result.push_back(Pair("infos", infos));
+    if ((int)vRecords.size() == nCount)
+        result.push_back(Pair("cursor", (boost::int64_t)nCursor));
+    else
+        result.push_back(Pair("cursor", Value::null));
+    return result;
+}
+
+Value listtxinfosbyaddress(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 4)
+        throw runtime_error(
+            "listtxinfosbyaddress <shinycoinaddress> [latestonly=true] [count=100] [cursor]\n"
+            "Returns up to [count] txinfos set on <shinycoinaddress>, oldest first, and a cursor.\n"
+            "Pass the cursor back to get the next page; it is null after the last one.");
+    
+    CBitcoinAddress address(params[0].get_str());
+    if (!address.IsValid())
+        throw JSONRPCError(-5, "Invalid shinycoin address");
+    bool fLatestOnly = true;
+    if (params.size() > 1)
+        fLatestOnly = params[1].get_bool();
+    int nCount;
+    int64 nCursor;
+    GetTxInfoPage(params, 2, nCount, nCursor);
+    
+    vector<TxInfoRecord> vRecords = ptxinfoStore->RecordsWithAddress(address, fLatestOnly, nCursor, nCount);
+    return TxInfoPageToJSON(vRecords, nCount, nCursor);
+}
+
+Value listtxinfosbykey(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 2 || params.size() > 6)
+        throw runtime_error(
+            "listtxinfosbykey <key_type> <key_string> [value] [latestonly=true] [count=100] [cursor]\n"
+            "Returns up to [count] txinfos with the key, and the value if it isn't \"\", oldest first, and a cursor.\n"
+            "Pass the cursor back to get the next page; it is null after the last one.");
+    
+    TxInfoKey key(GetInfoType(params[0].get_str()), params[1].get_str());
+    TxInfoValue value;
+    if (params.size() > 2)
+        value = params[2].get_str();
+    bool fLatestOnly = true;
+    if (params.size() > 3)
+        fLatestOnly = params[3].get_bool();
+    int nCount;
+    int64 nCursor;
+    GetTxInfoPage(params, 4, nCount, nCursor);
+    
+    vector<TxInfoRecord> vRecords = ptxinfoStore->RecordsWithKey(key, value.empty() ? NULL : &value, fLatestOnly,
+                                                                 nCursor, nCount);
+    return TxInfoPageToJSON(vRecords, nCount, nCursor);
+}
+
+Value searchtxinfokeys(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 2 || params.size() > 4)
+        throw runtime_error(
+            "searchtxinfokeys <key_type> <prefix> [count=100] [cursor]\n"
+            "Returns up to [count] latest txinfos whose key starts with <prefix>, oldest first, and a cursor.\n"
+            "Pass the cursor back to get the next page; it is null after the last one.");
+    
+    TxInfoType keyType = GetInfoType(params[0].get_str());
+    string strPrefix = params[1].get_str();
+    int nCount;
+    int64 nCursor;
+    GetTxInfoPage(params, 2, nCount, nCursor);
+    
+    vector<TxInfoRecord> vRecords = ptxinfoStore->RecordsWithKeyPrefix(keyType, strPrefix, nCursor, nCount);
+    return TxInfoPageToJSON(vRecords, nCount, nCursor);
+}
+
+Value resolvetxinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "resolvetxinfo <value> [key_type=id] [key_string=n]\n"
+            "Returns the address whose unique or id key has <value>, or null.\n"
+            "With the defaults, the address with the name <value>.");
+    
+    TxInfoValue value = params[0].get_str();
+    TxInfoType keyType = INFO_ID;
+    if (params.size() > 1)
+        keyType = GetInfoType(params[1].get_str());
+    if (keyType != INFO_UNIQUE && keyType != INFO_ID)
+        throw JSONRPCError(-8, "Only 'unique' and 'id' keys resolve to one address");
+    string keyString = "n";
+    if (params.size() > 2)
+        keyString = params[2].get_str();
+    
+    boost::optional<CBitcoinAddress> address = ptxinfoStore->UniqueAddressWithValue(TxInfoKey(keyType, keyString), value);
+    if (!address)
+        return Value::null;
+    return address->ToString();
+}
+
 Value estimatehpm(const Array& params, bool fHelp)
 {
     if (fHelp)
@@ -2672,6 +2839,10 @@ static const CRPCCommand vRPCCommands[] =
     { "sendalert",              &sendalert,              false},
     
     { "dumptxinfos",            &dumptxinfos,            true },
+    { "listtxinfosbyaddress",   &listtxinfosbyaddress,   true },
+    { "listtxinfosbykey",       &listtxinfosbykey,       true },
+    { "searchtxinfokeys",       &searchtxinfokeys,       true },
+    { "resolvetxinfo",          &resolvetxinfo,          true },
     //{ "getbestblockhash",       &getbestblockhash,       true },
     //{ "getblockchaininfo",      &getblockchaininfo,      true },
     { "getblock",               &getblock,               false },
@@ -2687,6 +2858,7 @@ static const CRPCCommand vRPCCommands[] =
 
     { "getblocktemplate",       &getblocktemplate,       true },
     { "getmininginfo",          &getmininginfo,          true },
+    { "getsigcacheinfo",        &getsigcacheinfo,        true },
     //{ "getnetworkhashps",       &getnetworkhashps,       true},
     { "estimatehpm",            &estimatehpm,            true},
     { "estimatecoindays",       &estimatecoindays,       true},
@@ -3376,6 +3548,14 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "estimatecoindays"       && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "getnetworkhashpm"       && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "getnetworkhashpm"       && n > 1) ConvertTo<boost::int64_t>(params[1]);
+    if (strMethod == "listtxinfosbyaddress"   && n > 1) ConvertTo<bool>(params[1]);
+    if (strMethod == "listtxinfosbyaddress"   && n > 2) ConvertTo<boost::int64_t>(params[2]);
+    if (strMethod == "listtxinfosbyaddress"   && n > 3) ConvertTo<boost::int64_t>(params[3]);
+    if (strMethod == "listtxinfosbykey"       && n > 3) ConvertTo<bool>(params[3]);
+    if (strMethod == "listtxinfosbykey"       && n > 4) ConvertTo<boost::int64_t>(params[4]);
+    if (strMethod == "listtxinfosbykey"       && n > 5) ConvertTo<boost::int64_t>(params[5]);
+    if (strMethod == "searchtxinfokeys"       && n > 2) ConvertTo<boost::int64_t>(params[2]);
+    if (strMethod == "searchtxinfokeys"       && n > 3) ConvertTo<boost::int64_t>(params[3]);
     if (strMethod == "sendmany"               && n > 1)
     {
         string s = params[1].get_str();
@@ -0,0 +1,169 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SHINYCOIN_CHECKQUEUE_H
+#define SHINYCOIN_CHECKQUEUE_H
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <algorithm>
+#include <vector>
+
+/** Queue of checks run by a pool of worker threads.
+ *
+ * T is a check: a functor with bool operator()() and swap(). One thread at a
+ * time (the master) adds checks and then calls Wait(), helping the workers
+ * until the queue is empty and all running checks have finished. Once a
+ * check fails the remaining ones are taken off the queue without running.
+ */
+template<typename T> class CCheckQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWorker;   // workers wait for checks
+    boost::condition_variable condMaster;   // the master waits for the last checks to finish
+
+    // checks are taken from the back
+    std::vector<T> queue;
+
+    int nIdle;
+    int nTotal;             // threads in Loop(), including the master
+    bool fAllOk;            // no check added since the last Wait() has failed
+    unsigned int nTodo;     // checks queued or running
+    unsigned int nBatchSize;
+
+    bool Loop(bool fMaster = false)
+    {
+        boost::condition_variable &cond = fMaster ? condMaster : condWorker;
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        unsigned int nNow = 0;
+        bool fOk = true;
+        while (true)
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                // the previous batch is done
+                if (nNow)
+                {
+                    fAllOk &= fOk;
+                    nTodo -= nNow;
+                    if (nTodo == 0 && !fMaster)
+                        condMaster.notify_one();
+                }
+                else
+                    nTotal++;
+
+                while (queue.empty())
+                {
+                    if (fMaster && nTodo == 0)
+                    {
+                        nTotal--;
+                        bool fRet = fAllOk;
+                        fAllOk = true;
+                        return fRet;
+                    }
+                    nIdle++;
+                    cond.wait(lock);
+                    nIdle--;
+                }
+
+                // Take a share of what's queued, so the work spreads over
+                // the threads, but in batches to keep the lock cold
+                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
+                vChecks.resize(nNow);
+                for (unsigned int i = 0; i < nNow; i++)
+                {
+                    vChecks[i].swap(queue.back());
+                    queue.pop_back();
+                }
+                fOk = fAllOk;
+            }
+
+            // skip the rest once anything has failed
+            for (typename std::vector<T>::iterator it = vChecks.begin(); it != vChecks.end(); ++it)
+                if (fOk)
+                    fOk = (*it)();
+            vChecks.clear();
+        }
+    }
+
+public:
+    CCheckQueue(unsigned int nBatchSizeIn) :
+        nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+
+    // Worker thread body, never returns
+    void Thread()
+    {
+        Loop();
+    }
+
+    // Run checks until all added ones are done; false if any failed
+    bool Wait()
+    {
+        return Loop(true);
+    }
+
+    // Take over the checks in vChecks, leaving it empty
+    void Add(std::vector<T> &vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (typename std::vector<T>::iterator it = vChecks.begin(); it != vChecks.end(); ++it)
+        {
+            queue.push_back(T());
+            it->swap(queue.back());
+        }
+        nTodo += vChecks.size();
+        if (vChecks.size() == 1)
+            condWorker.notify_one();
+        else if (vChecks.size() > 1)
+            condWorker.notify_all();
+        vChecks.clear();
+    }
+};
+
+/** Scope of one master's use of a CCheckQueue. Checks are run inline when
+ * there is no queue, and leaving the scope waits for any still queued, so
+ * nothing they point to goes away under the workers.
+ */
+template<typename T> class CCheckQueueControl
+{
+private:
+    CCheckQueue<T> *pqueue;
+    bool fOk;       // checks run inline have all passed
+    bool fDone;
+
+public:
+    CCheckQueueControl(CCheckQueue<T> *pqueueIn) : pqueue(pqueueIn), fOk(true), fDone(false) {}
+
+    ~CCheckQueueControl()
+    {
+        if (!fDone)
+            Wait();
+    }
+
+    bool Wait()
+    {
+        fDone = true;
+        if (pqueue == NULL)
+            return fOk;
+        return pqueue->Wait() && fOk;
+    }
+
+    void Add(std::vector<T> &vChecks)
+    {
+        if (pqueue != NULL)
+        {
+            pqueue->Add(vChecks);
+            return;
+        }
+        for (typename std::vector<T>::iterator it = vChecks.begin(); it != vChecks.end() && fOk; ++it)
+            fOk = (*it)();
+        vChecks.clear();
+    }
+};
+
+#endif
@@ -12,6 +12,7 @@
 #include "main.h"
 #include "kernel.h"
 #include "signedhash.h"
+#include "unspent.h"
 #include <boost/version.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -846,6 +847,29 @@ bool CTxDB::LoadBlockIndex()
 
 
 
+//
+// CUnspentDB
+//
+
+bool CUnspentDB::ReadUnspent(const COutPoint& outpoint, CUnspentOutput& unspent)
+{
+    unspent.SetNull();
+    return Read(make_pair(string("unspent"), outpoint), unspent);
+}
+
+bool CUnspentDB::WriteUnspent(const COutPoint& outpoint, const CUnspentOutput& unspent)
+{
+    return Write(make_pair(string("unspent"), outpoint), unspent);
+}
+
+bool CUnspentDB::EraseUnspent(const COutPoint& outpoint)
+{
+    return Erase(make_pair(string("unspent"), outpoint));
+}
+
+
+
+
 //
 // CAddrDB
 //
@@ -23,6 +23,7 @@ class CDiskTxPos;
 class CMasterKey;
 class COutPoint;
 class CTxIndex;
+class CUnspentOutput;
 class CWallet;
 class CWalletTx;
 
@@ -317,6 +318,23 @@ public:
 
 
 
+/** Access to the unspent output database (unspent.dat), see CUnspentCache */
+class CUnspentDB : public CDB
+{
+public:
+    CUnspentDB(const char* pszMode="r+") : CDB("unspent.dat", pszMode) { }
+private:
+    CUnspentDB(const CUnspentDB&);
+    void operator=(const CUnspentDB&);
+public:
+    bool ReadUnspent(const COutPoint& outpoint, CUnspentOutput& unspent);
+    bool WriteUnspent(const COutPoint& outpoint, const CUnspentOutput& unspent);
+    bool EraseUnspent(const COutPoint& outpoint);
+};
+
+
+
+
 /** Access to the (IP) address database (addr.dat) */
 class CAddrDB : public CDB
 {
@@ -94,7 +94,7 @@ static void HMAC_SHA256_Final(unsigned char digest[32], HMAC_SHA256_CTX *ctx)
 void PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
                    size_t saltlen, uint64_t c, uint8_t *buf, size_t dkLen)
 {
-	HMAC_SHA256_CTX PShctx, hctx;
+	HMAC_SHA256_CTX Phctx, PShctx, hctx;
 	size_t i;
 	uint8_t ivec[4];
 	uint8_t U[32];
@@ -103,8 +103,9 @@ void PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 	int k;
 	size_t clen;
     
-	/* Compute HMAC state after processing P and S. */
-	HMAC_SHA256_Init(&PShctx, passwd, passwdlen);
+	/* Compute HMAC state after processing P, and after processing P and S. */
+	HMAC_SHA256_Init(&Phctx, passwd, passwdlen);
+	memcpy(&PShctx, &Phctx, sizeof(HMAC_SHA256_CTX));
 	HMAC_SHA256_Update(&PShctx, salt, saltlen);
     
 	/* Iterate through the blocks. */
@@ -121,8 +122,8 @@ void PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 		memcpy(T, U, 32);
         
 		for (j = 2; j <= c; j++) {
-			/* Compute U_j. */
-			HMAC_SHA256_Init(&hctx, passwd, passwdlen);
+			/* Compute U_j, reusing the keyed state instead of rehashing the pads. */
+			memcpy(&hctx, &Phctx, sizeof(HMAC_SHA256_CTX));
 			HMAC_SHA256_Update(&hctx, U, 32);
 			HMAC_SHA256_Final(U, &hctx);
             
@@ -138,6 +139,7 @@ void PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 		memcpy(&buf[i * 32], T, clen);
 	}
     
-	/* Clean PShctx, since we never called _Final on it. */
+	/* Clean Phctx and PShctx, since we never called _Final on them. */
+	memset(&Phctx, 0, sizeof(HMAC_SHA256_CTX));
 	memset(&PShctx, 0, sizeof(HMAC_SHA256_CTX));
 }
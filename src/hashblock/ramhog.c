@@ -4,12 +4,7 @@
 #include "pbkdf2.h"
 
 
-typedef struct
-{
-    uint64_t s[64];
-    uint8_t p;
-    uint64_t last;
-} xorshift_ctx;
+typedef ramhog_xorshift_ctx xorshift_ctx;
 
 static inline uint64_t xorshift_next(xorshift_ctx *pctx)
 {
@@ -32,9 +27,11 @@ static void xorshift_pbkdf2_seed(xorshift_ctx *ctx, const uint8_t *seed, size_t
     ctx->p = (uint8_t)(fullSeed[16] & 63);
 }
 
-void ramhog_gen_pad(const uint8_t *input, size_t input_size,
-                    uint32_t C, uint32_t padIndex,
-                    uint64_t *padOut)
+#define ramhog_cancelled(cancel, n) (!((n) & (RAMHOG_CANCEL_CHUNKS - 1)) && (cancel) && *(cancel))
+
+static int ramhog_gen_pad_cancellable(const uint8_t *input, size_t input_size,
+                                      uint32_t C, uint32_t padIndex,
+                                      uint64_t *padOut, const volatile int *cancel)
 {
     xorshift_ctx ctx;
     uint32_t chunk;
@@ -46,10 +43,89 @@ void ramhog_gen_pad(const uint8_t *input, size_t input_size,
     
     for (chunk=2; chunk < C; chunk++)
     {
+        if (ramhog_cancelled(cancel, chunk))
+            return 0;
         padOut[chunk] = xorshift_next(&ctx);
         if (!(padOut[chunk] & 511))
             padOut[chunk] ^= padOut[xorshift_next(&ctx) % (chunk/2) + chunk/2];
     }
+    return 1;
+}
+
+void ramhog_gen_pad(const uint8_t *input, size_t input_size,
+                    uint32_t C, uint32_t padIndex,
+                    uint64_t *padOut)
+{
+    ramhog_gen_pad_cancellable(input, input_size, C, padIndex, padOut, NULL);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RAMHOG_HAVE_LANES
+
+#define RAMHOG_LANES 4
+#define RAMHOG_LANES_TARGET "avx2"
+#define RAMHOG_LANES_FN ramhog_gen_pads_avx2
+#include "ramhog_lanes.h"
+#undef RAMHOG_LANES
+#undef RAMHOG_LANES_TARGET
+#undef RAMHOG_LANES_FN
+
+#define RAMHOG_LANES 8
+#define RAMHOG_LANES_TARGET "avx512f,avx512dq"
+#define RAMHOG_LANES_FN ramhog_gen_pads_avx512
+#include "ramhog_lanes.h"
+#undef RAMHOG_LANES
+#undef RAMHOG_LANES_TARGET
+#undef RAMHOG_LANES_FN
+#endif
+
+/* AVX-512 is opt-in: the 8-lane kernel measured slower than AVX2 on parts that down-clock for it */
+static uint32_t nMaxLanes = 4;
+
+void ramhog_set_max_lanes(uint32_t maxLanes)
+{
+    nMaxLanes = maxLanes;
+}
+
+uint32_t ramhog_lanes(void)
+{
+#ifdef RAMHOG_HAVE_LANES
+    __builtin_cpu_init();
+    if (nMaxLanes >= 8 && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+        return 8;
+    if (nMaxLanes >= 4 && __builtin_cpu_supports("avx2"))
+        return 4;
+#endif
+    return 1;
+}
+
+int ramhog_gen_pads_cancellable(const uint8_t *input, size_t input_size,
+                                uint32_t C, uint32_t firstPadIndex, uint32_t numPads,
+                                uint64_t **padsOut, const volatile int *cancel)
+{
+    uint32_t lanes = ramhog_lanes();
+    
+#ifdef RAMHOG_HAVE_LANES
+    for (; lanes == 8 && numPads >= 8; firstPadIndex += 8, numPads -= 8, padsOut += 8)
+        if (!ramhog_gen_pads_avx512(input, input_size, C, firstPadIndex, padsOut, cancel))
+            return 0;
+    
+    for (; lanes >= 4 && numPads >= 4; firstPadIndex += 4, numPads -= 4, padsOut += 4)
+        if (!ramhog_gen_pads_avx2(input, input_size, C, firstPadIndex, padsOut, cancel))
+            return 0;
+#endif
+    
+    for (; numPads > 0; firstPadIndex++, numPads--, padsOut++)
+        if (!ramhog_gen_pad_cancellable(input, input_size, C, firstPadIndex, *padsOut, cancel))
+            return 0;
+    return 1;
+}
+
+void ramhog_gen_pads(const uint8_t *input, size_t input_size,
+                     uint32_t C, uint32_t firstPadIndex, uint32_t numPads,
+                     uint64_t **padsOut)
+{
+    ramhog_gen_pads_cancellable(input, input_size, C, firstPadIndex, numPads, padsOut, NULL);
 }
 
 void ramhog_run_iterations(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
@@ -87,16 +163,282 @@ void ramhog_run_iterations(const uint8_t *input, size_t input_size, uint8_t *out
                   1, (uint8_t *)output, output_size);
 }
 
-void ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
-            uint32_t N, uint32_t C, uint32_t I, uint64_t **scratchpads)
+#if defined(__GNUC__)
+#define ramhog_prefetch(p) __builtin_prefetch((p), 0, 0)
+#else
+#define ramhog_prefetch(p)
+#endif
+
+static inline const uint64_t *ramhog_walk_addr(const ramhog_walk *walk)
+{
+    return &walk->scratchpads[(walk->X & 0xffffffff00000000L) % walk->N][(walk->X & 0x00000000ffffffffL) % walk->C];
+}
+
+void ramhog_walk_init(ramhog_walk *walk,
+                      const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+                      uint32_t N, uint32_t C, uint32_t I,
+                      uint64_t **scratchpads)
 {
     uint32_t padIndex;
+    uint64_t finalChunks[N * 32];
+    
+    for (padIndex=0; padIndex < N; padIndex++)
+    {
+        memcpy(&finalChunks[padIndex * 32], &scratchpads[padIndex][C - 1 - 32], sizeof(uint64_t) * 32);
+    }
+    
+    xorshift_pbkdf2_seed(&walk->ctx, input, input_size, (uint8_t *)&finalChunks[0], sizeof(uint64_t) * N);
+    
+    memset(walk->finalSalt, 0, sizeof(walk->finalSalt));
+    walk->finalSalt[0] = N;
+    walk->finalSalt[1] = C;
+    walk->finalSalt[2] = I;
+    walk->finalSalt[3] = input_size;
+    walk->finalSalt[4] = output_size;
+    
+    walk->input = input;
+    walk->input_size = input_size;
+    walk->output = output;
+    walk->output_size = output_size;
+    walk->N = N;
+    walk->C = C;
+    walk->I = I;
+    walk->scratchpads = scratchpads;
+    
+    walk->step = 0;
+    walk->X = xorshift_next(&walk->ctx);
+    walk->next = ramhog_walk_addr(walk);
+    ramhog_prefetch(walk->next);
+}
+
+uint32_t ramhog_walk_steps(ramhog_walk **walks, uint32_t numWalks, uint32_t maxSteps)
+{
+    uint32_t k, i, numDone = 0;
+    
+    for (k=0; k < numWalks; k++)
+    {
+        if (!ramhog_walk_done(walks[k]) && walks[k]->I - walks[k]->step < maxSteps)
+            maxSteps = walks[k]->I - walks[k]->step;
+    }
+    
+    for (i=0; i < maxSteps; i++)
+    {
+        for (k=0; k < numWalks; k++)
+        {
+            ramhog_walk *walk = walks[k];
+            
+            if (ramhog_walk_done(walk))
+                continue;
+            
+            walk->X = *walk->next ^ xorshift_next(&walk->ctx);
+            if (++walk->step > walk->I - (32 - 5))
+                walk->finalSalt[walk->step - (walk->I - (32 - 5)) + 4] = walk->X;
+            
+            if (ramhog_walk_done(walk))
+            {
+                PBKDF2_SHA256(walk->input, walk->input_size,
+                              (uint8_t *)walk->finalSalt, sizeof(uint64_t)*32,
+                              1, (uint8_t *)walk->output, walk->output_size);
+                continue;
+            }
+            
+            walk->next = ramhog_walk_addr(walk);
+            ramhog_prefetch(walk->next);
+        }
+    }
+    
+    for (k=0; k < numWalks; k++)
+    {
+        if (ramhog_walk_done(walks[k]))
+            numDone++;
+    }
+    
+    return numDone;
+}
+
+void ramhog_run_iterations_multi(uint32_t numWalks,
+                                 const uint8_t **inputs, const size_t *input_sizes,
+                                 uint8_t **outputs, size_t output_size,
+                                 uint32_t N, uint32_t C, uint32_t I,
+                                 uint64_t ***scratchpads)
+{
+    ramhog_walk *walks = (ramhog_walk *)malloc(sizeof(ramhog_walk) * numWalks);
+    ramhog_walk **pwalks = (ramhog_walk **)malloc(sizeof(ramhog_walk *) * numWalks);
+    uint32_t k;
+    
+    for (k=0; k < numWalks; k++)
+    {
+        ramhog_walk_init(&walks[k], inputs[k], input_sizes[k], outputs[k], output_size,
+                         N, C, I, scratchpads[k]);
+        pwalks[k] = &walks[k];
+    }
+    
+    /* all walks have the same length, so they finish together */
+    while (ramhog_walk_steps(pwalks, numWalks, I) < numWalks)
+        ;
+    
+    free(pwalks);
+    free(walks);
+}
+
+static uint32_t gcd32(uint32_t a, uint32_t b)
+{
+    while (b)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+int ramhog_pad_reachable(uint32_t N, uint32_t padIndex)
+{
+    uint32_t step = gcd32((uint32_t)((1ULL << 32) % N), N);
+    
+    return padIndex % step == 0 || (uint64_t)padIndex * 32 < N;
+}
+
+uint32_t ramhog_lowmem_segment_chunks(uint32_t N, uint32_t C, uint64_t maxBytes)
+{
+    uint32_t padIndex, reachable = 0;
+    uint64_t numSegments;
     
     for (padIndex=0; padIndex < N; padIndex++)
+        reachable += ramhog_pad_reachable(N, padIndex);
+    
+    if (maxBytes >= (uint64_t)reachable * C * sizeof(uint64_t))
+        return 0;
+    
+    numSegments = maxBytes / ((uint64_t)reachable * sizeof(xorshift_ctx));
+    if (numSegments < 1)
+        numSegments = 1;
+    return (uint32_t)((C + numSegments - 1) / numSegments);
+}
+
+uint64_t ramhog_lowmem_pad_bytes(uint32_t C, uint32_t segmentChunks)
+{
+    if (segmentChunks == 0)
+        return (uint64_t)C * sizeof(uint64_t);
+    return (uint64_t)((C + segmentChunks - 1) / segmentChunks) * sizeof(xorshift_ctx);
+}
+
+int ramhog_lowmem_alloc(ramhog_lowmem_pad *pad, uint32_t C, uint32_t segmentChunks)
+{
+    memset(pad, 0, sizeof(*pad));
+    pad->C = C;
+    pad->segmentChunks = segmentChunks;
+    
+    if (segmentChunks == 0)
+        return (pad->values = (uint64_t *)malloc(sizeof(uint64_t) * C)) != NULL;
+    
+    pad->numSegments = (C + segmentChunks - 1) / segmentChunks;
+    return (pad->checkpoints = (xorshift_ctx *)malloc(sizeof(xorshift_ctx) * pad->numSegments)) != NULL;
+}
+
+void ramhog_lowmem_free(ramhog_lowmem_pad *pad)
+{
+    free(pad->checkpoints);
+    free(pad->values);
+    memset(pad, 0, sizeof(*pad));
+}
+
+/* Same state sequence as ramhog_gen_pad; the mixing step's extra draw doesn't depend on pad contents */
+int ramhog_lowmem_fill(ramhog_lowmem_pad *pad, const uint8_t *input, size_t input_size, uint32_t padIndex,
+                       const volatile int *cancel)
+{
+    xorshift_ctx ctx;
+    uint32_t chunk;
+    uint64_t out;
+    
+    if (pad->values)
+        return ramhog_gen_pad_cancellable(input, input_size, pad->C, padIndex, pad->values, cancel);
+    
+    xorshift_pbkdf2_seed(&ctx, input, input_size, (uint8_t *)&padIndex, 4);
+    
+    for (chunk=0; chunk < pad->C; chunk++)
+    {
+        if (ramhog_cancelled(cancel, chunk))
+            return 0;
+        if (chunk % pad->segmentChunks == 0)
+            pad->checkpoints[chunk / pad->segmentChunks] = ctx;
+        out = xorshift_next(&ctx);
+        if (chunk >= 2 && !(out & 511))
+            xorshift_next(&ctx);
+    }
+    return 1;
+}
+
+uint64_t ramhog_lowmem_chunk(const ramhog_lowmem_pad *pad, uint32_t chunk)
+{
+    xorshift_ctx ctx;
+    uint32_t i;
+    uint64_t out;
+    
+    if (pad->values)
+        return pad->values[chunk];
+    
+    ctx = pad->checkpoints[chunk / pad->segmentChunks];
+    for (i = chunk / pad->segmentChunks * pad->segmentChunks; ; i++)
+    {
+        out = xorshift_next(&ctx);
+        if (i < 2 || (out & 511))
+        {
+            if (i == chunk)
+                return out;
+            continue;
+        }
+        if (i == chunk)
+            return out ^ ramhog_lowmem_chunk(pad, xorshift_next(&ctx) % (chunk/2) + chunk/2);
+        xorshift_next(&ctx);
+    }
+}
+
+int ramhog_run_iterations_lowmem(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+                                 uint32_t N, uint32_t C, uint32_t I,
+                                 const ramhog_lowmem_pad *pads, const volatile int *cancel)
+{
+    xorshift_ctx ctx;
+    uint32_t i, k;
+    uint64_t X;
+    uint64_t finalChunks[N];
+    uint64_t finalSalt[32] = {N, C, I, input_size, output_size};
+    
+    /* only the first N words of ramhog_run_iterations' finalChunks go into the seed */
+    for (k=0; k < N; k++)
     {
-        ramhog_gen_pad(input, input_size, C, padIndex, scratchpads[padIndex]);
+        finalChunks[k] = ramhog_lowmem_chunk(&pads[k / 32], C - 1 - 32 + k % 32);
     }
     
+    xorshift_pbkdf2_seed(&ctx, input, input_size, (uint8_t *)&finalChunks[0], sizeof(uint64_t) * N);
+    
+    X = xorshift_next(&ctx);
+    
+    for (i=0; i < I - (32 - 5); i++)
+    {
+        /* a read recomputes up to a segment, so check far more often than per chunk */
+        if (ramhog_cancelled(cancel, i * 64))
+            return 0;
+        X = ramhog_lowmem_chunk(&pads[(X & 0xffffffff00000000L) % N], (X & 0x00000000ffffffffL) % C) ^ xorshift_next(&ctx);
+    }
+    
+    for (i=5; i < 32; i++)
+    {
+        X = ramhog_lowmem_chunk(&pads[(X & 0xffffffff00000000L) % N], (X & 0x00000000ffffffffL) % C) ^ xorshift_next(&ctx);
+        finalSalt[i] = X;
+    }
+    
+    PBKDF2_SHA256(input, input_size,
+                  (uint8_t *)finalSalt, sizeof(uint64_t)*32,
+                  1, (uint8_t *)output, output_size);
+    return 1;
+}
+
+void ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+            uint32_t N, uint32_t C, uint32_t I, uint64_t **scratchpads)
+{
+    ramhog_gen_pads(input, input_size, C, 0, N, scratchpads);
+    
     ramhog_run_iterations(input, input_size, output, output_size, N, C, I, scratchpads);
 }
 
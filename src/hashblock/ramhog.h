@@ -12,13 +12,128 @@ void ramhog_gen_pad(const uint8_t *input, size_t input_size,
                     uint32_t C, uint32_t padIndex,
                     uint64_t *padOut);
 
+/* Generates numPads consecutive pads, several at a time in SIMD lanes where the CPU allows. */
+void ramhog_gen_pads(const uint8_t *input, size_t input_size,
+                     uint32_t C, uint32_t firstPadIndex, uint32_t numPads,
+                     uint64_t **padsOut);
+
+/*
+ * The cancellable functions below check *cancel (if cancel isn't NULL) every
+ * RAMHOG_CANCEL_CHUNKS chunks - some tens of milliseconds of pad generation -
+ * and return 0 once it is nonzero, leaving their output unfinished.
+ */
+#define RAMHOG_CANCEL_CHUNKS (1 << 22)
+
+/*
+ * Steps a cancellable caller advances a random walk between checks: each is a
+ * dependent DRAM read, so this keeps a cancel within a few milliseconds.
+ */
+#define RAMHOG_WALK_SLICE (1 << 16)
+
+int ramhog_gen_pads_cancellable(const uint8_t *input, size_t input_size,
+                                uint32_t C, uint32_t firstPadIndex, uint32_t numPads,
+                                uint64_t **padsOut, const volatile int *cancel);
+
+/* Number of pads ramhog_gen_pads fills per pass on this CPU: 8, 4 or 1. */
+uint32_t ramhog_lanes(void);
+
+/* Caps the lane count ramhog_gen_pads may use (default 4); 1 forces the scalar kernel. */
+void ramhog_set_max_lanes(uint32_t maxLanes);
+
 void ramhog_run_iterations(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
                            uint32_t N, uint32_t C, uint32_t I,
                            uint64_t **scratchpads);
         
+typedef struct
+{
+    uint64_t s[64];
+    uint8_t p;
+    uint64_t last;
+} ramhog_xorshift_ctx;
+
+/* One random walk over a filled pad set, advanced in steps by ramhog_walk_steps. */
+typedef struct
+{
+    ramhog_xorshift_ctx ctx;
+    uint64_t X;
+    uint32_t step;
+    uint64_t finalSalt[32];
+    const uint64_t *next;       /* address of the next read, already prefetched */
+    const uint8_t *input;
+    size_t input_size;
+    uint8_t *output;
+    size_t output_size;
+    uint32_t N, C, I;
+    uint64_t **scratchpads;
+} ramhog_walk;
+
+void ramhog_walk_init(ramhog_walk *walk,
+                      const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+                      uint32_t N, uint32_t C, uint32_t I,
+                      uint64_t **scratchpads);
+
+/*
+ * Advances numWalks walks in lockstep by at most maxSteps each, prefetching
+ * every walk's next read so that their cache misses overlap. Walks that are
+ * already finished are skipped. Stops early when one of them finishes, which
+ * then writes its output. Returns the number of walks that are finished.
+ */
+uint32_t ramhog_walk_steps(ramhog_walk **walks, uint32_t numWalks, uint32_t maxSteps);
+
+static inline int ramhog_walk_done(const ramhog_walk *walk)
+{
+    return walk->step == walk->I;
+}
+
+/* ramhog_run_iterations for numWalks independent inputs and pad sets, interleaved. */
+void ramhog_run_iterations_multi(uint32_t numWalks,
+                                 const uint8_t **inputs, const size_t *input_sizes,
+                                 uint8_t **outputs, size_t output_size,
+                                 uint32_t N, uint32_t C, uint32_t I,
+                                 uint64_t ***scratchpads);
+
 void ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
             uint32_t N, uint32_t C, uint32_t I, uint64_t **scratchpads);
 
+/*
+ * Whether ramhog_run_iterations can ever read pad padIndex. The walk picks
+ * a pad with (X & 0xffffffff00000000) % N, which only reaches multiples of
+ * gcd(2^32 % N, N) - just pad 0 when N is a power of two - and the seed only
+ * uses the first N words of the final chunks.
+ */
+int ramhog_pad_reachable(uint32_t N, uint32_t padIndex);
+
+/*
+ * Low-memory pad: either all C words (values != NULL), or the generator
+ * state at the start of every segment of segmentChunks chunks, from which
+ * a chunk is recomputed each time the walk reads it.
+ */
+typedef struct
+{
+    uint32_t C;
+    uint32_t segmentChunks;
+    uint32_t numSegments;
+    ramhog_xorshift_ctx *checkpoints;
+    uint64_t *values;
+} ramhog_lowmem_pad;
+
+/* Segment length that fits the reachable pads of one hash in maxBytes, 0 if they fit in full. */
+uint32_t ramhog_lowmem_segment_chunks(uint32_t N, uint32_t C, uint64_t maxBytes);
+
+/* Bytes one pad takes with the given segment length. */
+uint64_t ramhog_lowmem_pad_bytes(uint32_t C, uint32_t segmentChunks);
+
+int ramhog_lowmem_alloc(ramhog_lowmem_pad *pad, uint32_t C, uint32_t segmentChunks);
+void ramhog_lowmem_free(ramhog_lowmem_pad *pad);
+int ramhog_lowmem_fill(ramhog_lowmem_pad *pad, const uint8_t *input, size_t input_size, uint32_t padIndex,
+                       const volatile int *cancel);
+uint64_t ramhog_lowmem_chunk(const ramhog_lowmem_pad *pad, uint32_t chunk);
+
+/* ramhog_run_iterations over low-memory pads; pads[j] need only be filled where ramhog_pad_reachable. */
+int ramhog_run_iterations_lowmem(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+                                 uint32_t N, uint32_t C, uint32_t I,
+                                 const ramhog_lowmem_pad *pads, const volatile int *cancel);
+
 #ifdef __cplusplus
 }
 #endif
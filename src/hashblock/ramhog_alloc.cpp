@@ -0,0 +1,247 @@
+#include "ramhog_alloc.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/foreach.hpp>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+#endif
+
+static const size_t RAMHOG_PAGE_2MB = 2 * 1024 * 1024;
+static const size_t RAMHOG_PAGE_1GB = 1024 * 1024 * 1024;
+
+const char *RamhogBackingName(RamhogPadBacking backing)
+{
+    switch (backing)
+    {
+    case RAMHOG_BACKING_MALLOC:      return "malloc";
+    case RAMHOG_BACKING_MMAP:        return "4KB pages";
+    case RAMHOG_BACKING_THP:         return "transparent huge pages";
+    case RAMHOG_BACKING_HUGETLB_2MB: return "2MB huge pages";
+    case RAMHOG_BACKING_HUGETLB_1GB: return "1GB huge pages";
+    }
+    return "unknown";
+}
+
+#ifdef __linux__
+// Parse a sysfs list of CPUs or nodes such as "0-3,8,10-11"
+static bool ParseSysfsList(const std::string &strList, std::vector<int> &vValues)
+{
+    std::vector<std::string> vRanges;
+    ParseString(strList, ',', vRanges);
+    BOOST_FOREACH(const std::string &strRange, vRanges)
+    {
+        if (strRange.empty() || strRange == "\n")
+            continue;
+        int nFirst, nLast;
+        size_t nDash = strRange.find('-');
+        nFirst = atoi(strRange.substr(0, nDash));
+        nLast = nDash == std::string::npos ? nFirst : atoi(strRange.substr(nDash + 1));
+        for (int n = nFirst; n <= nLast; n++)
+            vValues.push_back(n);
+    }
+    return !vValues.empty();
+}
+
+static void *MapPads(size_t nBytes, int nFlags)
+{
+    void *p = mmap(NULL, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | nFlags, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static bool BindToNode(void *p, size_t nBytes, int nNode)
+{
+    unsigned long nodemask[16];
+    if (nNode < 0 || nNode >= (int)(sizeof(nodemask) * 8))
+        return false;
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[nNode / (sizeof(unsigned long) * 8)] |= 1UL << (nNode % (sizeof(unsigned long) * 8));
+    return syscall(SYS_mbind, p, nBytes, MPOL_BIND, nodemask, sizeof(nodemask) * 8, 0) == 0;
+}
+
+static size_t FreeHugePages(int nNode, size_t nPageSize)
+{
+    boost::filesystem::ifstream file(boost::filesystem::path("/sys/devices/system/node") /
+                                     strprintf("node%d", nNode) / "hugepages" /
+                                     strprintf("hugepages-%dkB", (int)(nPageSize / 1024)) / "free_hugepages");
+    size_t nFree = 0;
+    if (!file || !(file >> nFree))
+        return 0;
+    return nFree;
+}
+
+// Map huge pages of nPageSize, bound to nNode if it is >= 0. Huge pages are
+// reserved from the whole system, so a bound mapping the node can't supply
+// would only fail, with SIGBUS, when first touched: check the node has them
+// and fault them all in here, where running short is an error instead.
+static void *MapHugePads(size_t nBytes, size_t nPageSize, int nPageShift, int nNode)
+{
+    if (nNode >= 0 && FreeHugePages(nNode, nPageSize) < nBytes / nPageSize)
+        return NULL;
+    void *p = MapPads(nBytes, MAP_HUGETLB | (nPageShift << MAP_HUGE_SHIFT));
+    if (!p || nNode < 0)
+        return p;
+    // EINVAL is a kernel before 5.14, with only the free page count to go by
+    if (!BindToNode(p, nBytes, nNode) || (madvise(p, nBytes, MADV_POPULATE_WRITE) != 0 && errno != EINVAL))
+    {
+        munmap(p, nBytes);
+        return NULL;
+    }
+    return p;
+}
+#endif
+
+std::vector<int> RamhogNumaNodes()
+{
+    std::vector<int> vNodes;
+#ifdef __linux__
+    // node IDs can have gaps, for offline nodes or ones without memory
+    boost::filesystem::path pathNodes("/sys/devices/system/node");
+    const char *pszLists[] = {"has_memory", "online"};
+    for (unsigned int i = 0; i < sizeof(pszLists) / sizeof(pszLists[0]) && vNodes.empty(); i++)
+    {
+        boost::filesystem::ifstream file(pathNodes / pszLists[i]);
+        std::string strList;
+        if (file && std::getline(file, strList))
+            ParseSysfsList(strList, vNodes);
+    }
+#endif
+    if (vNodes.empty())
+        vNodes.push_back(0);
+    return vNodes;
+}
+
+bool RamhogBindThreadToNode(int nNode)
+{
+#ifdef __linux__
+    boost::filesystem::ifstream file(boost::filesystem::path("/sys/devices/system/node") /
+                                     strprintf("node%d", nNode) / "cpulist");
+    std::string strList;
+    std::vector<int> vCpus;
+    if (!file || !std::getline(file, strList) || !ParseSysfsList(strList, vCpus))
+        return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    BOOST_FOREACH(int nCpu, vCpus)
+        if (nCpu < CPU_SETSIZE)
+            CPU_SET(nCpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+bool CRamhogPadSet::Alloc(uint32_t N, uint32_t C, const std::string &strHugePages, int nNodeIn)
+{
+    size_t nBytes = (size_t)N * C * sizeof(uint64_t);
+
+    pads = (uint64_t **)malloc(sizeof(uint64_t *) * N);
+    if (!pads)
+        return false;
+
+    pbase = NULL;
+    nPads = N;
+    nNode = -1;
+
+#ifdef __linux__
+    bool fTry1GB = strHugePages == "auto" || strHugePages == "1gb";
+    bool fTry2MB = fTry1GB || strHugePages == "2mb";
+    bool fTryTHP = fTry2MB || strHugePages == "thp";
+
+    if (!pbase && fTry1GB)
+    {
+        nMappedBytes = (nBytes + RAMHOG_PAGE_1GB - 1) / RAMHOG_PAGE_1GB * RAMHOG_PAGE_1GB;
+        if ((pbase = MapHugePads(nMappedBytes, RAMHOG_PAGE_1GB, 30, nNodeIn)))
+            backing = RAMHOG_BACKING_HUGETLB_1GB;
+    }
+    if (!pbase && fTry2MB)
+    {
+        nMappedBytes = (nBytes + RAMHOG_PAGE_2MB - 1) / RAMHOG_PAGE_2MB * RAMHOG_PAGE_2MB;
+        if ((pbase = MapHugePads(nMappedBytes, RAMHOG_PAGE_2MB, 21, nNodeIn)))
+            backing = RAMHOG_BACKING_HUGETLB_2MB;
+    }
+    if (!pbase)
+    {
+        nMappedBytes = nBytes;
+        if ((pbase = MapPads(nMappedBytes, 0)))
+        {
+            backing = RAMHOG_BACKING_MMAP;
+#ifdef MADV_HUGEPAGE
+            if (fTryTHP && madvise(pbase, nMappedBytes, MADV_HUGEPAGE) == 0)
+                backing = RAMHOG_BACKING_THP;
+#endif
+        }
+    }
+
+    if (pbase)
+    {
+        // huge pages were bound as they were mapped
+        bool fHugeTLB = backing == RAMHOG_BACKING_HUGETLB_1GB || backing == RAMHOG_BACKING_HUGETLB_2MB;
+        if (nNodeIn >= 0 && (fHugeTLB || BindToNode(pbase, nMappedBytes, nNodeIn)))
+            nNode = nNodeIn;
+        for (uint32_t j=0; j < N; j++)
+            pads[j] = (uint64_t *)pbase + (size_t)j * C;
+        return true;
+    }
+#endif
+
+    backing = RAMHOG_BACKING_MALLOC;
+    nMappedBytes = nBytes;
+    for (uint32_t j=0; j < N; j++)
+    {
+        pads[j] = (uint64_t *)malloc(sizeof(uint64_t) * C);
+        if (!pads[j])
+        {
+            while (j > 0)
+                free(pads[--j]);
+            free(pads);
+            pads = NULL;
+            return false;
+        }
+    }
+    return true;
+}
+
+void CRamhogPadSet::Free()
+{
+    if (!pads)
+        return;
+#ifndef WIN32
+    if (pbase)
+        munmap(pbase, nMappedBytes);
+    else
+#endif
+    {
+        for (uint32_t j=0; j < nPads; j++)
+            free(pads[j]);
+    }
+    free(pads);
+    pads = NULL;
+    pbase = NULL;
+}
+
+std::string CRamhogPadSet::ToString() const
+{
+    return strprintf("%.2fGB via %s%s", nMappedBytes/1024.0/1024.0/1024.0, RamhogBackingName(backing),
+                     nNode >= 0 ? strprintf(" on NUMA node %d", nNode).c_str() : "");
+}
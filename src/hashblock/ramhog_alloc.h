@@ -0,0 +1,50 @@
+#ifndef RAMHOG_ALLOC_H
+#define RAMHOG_ALLOC_H
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+enum RamhogPadBacking
+{
+    RAMHOG_BACKING_MALLOC = 0,  // one malloc() per pad, where mmap isn't available
+    RAMHOG_BACKING_MMAP,        // contiguous mapping of normal pages
+    RAMHOG_BACKING_THP,         // contiguous mapping, madvise(MADV_HUGEPAGE)
+    RAMHOG_BACKING_HUGETLB_2MB,
+    RAMHOG_BACKING_HUGETLB_1GB,
+};
+
+/** One set of N scratchpads of C words, backed by a single allocation where possible. */
+class CRamhogPadSet
+{
+public:
+    uint64_t **pads;
+    uint32_t nPads;
+    void *pbase;
+    size_t nMappedBytes;
+    RamhogPadBacking backing;
+    int nNode;                  // NUMA node the memory is bound to, -1 if unbound
+
+    CRamhogPadSet() : pads(NULL), nPads(0), pbase(NULL), nMappedBytes(0), backing(RAMHOG_BACKING_MALLOC), nNode(-1) {}
+
+    /**
+     * Allocate N pads of C words. strHugePages is one of "auto", "1gb", "2mb", "thp" or "none";
+     * every mode falls back to the next cheaper one when the kernel refuses it.
+     * If nNodeIn >= 0 the memory is bound to that NUMA node before it is first touched.
+     */
+    bool Alloc(uint32_t N, uint32_t C, const std::string &strHugePages, int nNodeIn);
+    void Free();
+
+    std::string ToString() const;
+};
+
+const char *RamhogBackingName(RamhogPadBacking backing);
+
+/** IDs of the NUMA nodes with memory, just node 0 where that can't be determined. */
+std::vector<int> RamhogNumaNodes();
+
+/** Restrict the calling thread to the CPUs of the given NUMA node. */
+bool RamhogBindThreadToNode(int nNode);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * Lane-parallel body of ramhog_gen_pad, included by ramhog.c once per
+ * instruction set with RAMHOG_LANES, RAMHOG_LANES_TARGET and
+ * RAMHOG_LANES_FN defined.
+ *
+ * RAMHOG_LANES consecutive pads are generated at once, one xorshift state
+ * per SIMD lane. The states are interleaved so that s[i] holds word i of
+ * every lane, and each lane is rotated at seeding time so that all lanes
+ * share one state pointer. When a lane takes the extra xorshift_next of
+ * the mixing step it runs that step on its own and is rotated by one word
+ * to get back in step with the others. Output is bit-identical to
+ * ramhog_gen_pad. Returns 0 if *cancel became nonzero before the pads
+ * were done.
+ */
+
+__attribute__((target(RAMHOG_LANES_TARGET)))
+static int RAMHOG_LANES_FN(const uint8_t *input, size_t input_size,
+                           uint32_t C, uint32_t firstPadIndex,
+                           uint64_t **padsOut, const volatile int *cancel)
+{
+    typedef uint64_t lanes_t __attribute__((vector_size(8 * RAMHOG_LANES)));
+
+    const uint64_t mult = 8372773778140471301LL;
+    lanes_t s[64];
+    lanes_t s0, s1, out, fixup;
+    xorshift_ctx ctx;
+    uint32_t chunk, lane, i, padIndex;
+    uint8_t p = 0;
+
+    for (lane=0; lane < RAMHOG_LANES; lane++)
+    {
+        padIndex = firstPadIndex + lane;
+        xorshift_pbkdf2_seed(&ctx, input, input_size, (uint8_t *)&padIndex, 4);
+        for (i=0; i < 64; i++)
+            s[i][lane] = ctx.s[(i + ctx.p) & 63];
+    }
+
+    for (chunk=0; chunk < C; chunk++)
+    {
+        if (ramhog_cancelled(cancel, chunk))
+            return 0;
+
+        s0 = s[p];
+        p = (p + 1) & 63;
+        s1 = s[p];
+        s1 ^= s1 << 25; // a
+        s1 ^= s1 >> 3;  // b
+        s0 ^= s0 >> 49; // c
+        s[p] = s0 ^ s1;
+        out = s[p] * mult;
+
+        for (lane=0; lane < RAMHOG_LANES; lane++)
+            padsOut[lane][chunk] = out[lane];
+
+        if (chunk < 2)
+            continue;
+
+        fixup = (lanes_t)((out & 511) == 0);
+        for (lane=1; lane < RAMHOG_LANES; lane++)
+            fixup[0] |= fixup[lane];
+        if (!fixup[0])
+            continue;
+
+        for (lane=0; lane < RAMHOG_LANES; lane++)
+        {
+            uint64_t e0, e1, first;
+
+            if (out[lane] & 511)
+                continue;
+
+            e0 = s[p][lane];
+            e1 = s[(p + 1) & 63][lane];
+            e1 ^= e1 << 25;
+            e1 ^= e1 >> 3;
+            e0 ^= e0 >> 49;
+            s[(p + 1) & 63][lane] = e0 ^ e1;
+            padsOut[lane][chunk] ^= padsOut[lane][((e0 ^ e1) * mult) % (chunk/2) + chunk/2];
+
+            first = s[0][lane];
+            for (i=0; i < 63; i++)
+                s[i][lane] = s[i + 1][lane];
+            s[63][lane] = first;
+        }
+    }
+    return 1;
+}
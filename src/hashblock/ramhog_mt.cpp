@@ -4,67 +4,152 @@
 #include "util.h"
 
 #include <boost/bind.hpp>
+#include <boost/foreach.hpp>
 #include <boost/thread/future.hpp>
 #include <boost/thread/thread.hpp>
 
 CRamhogThreadPool::CRamhogThreadPool(uint32_t Nin, uint32_t Cin, uint32_t Iin,
-                                     int numSimultaneousIn, int numWorkersIn) :
+                                     int numSimultaneousIn, int numWorkersIn,
+                                     const std::string &strHugePages, bool fNuma, bool fPipelineIn,
+                                     bool fBatchWalksIn, uint64_t nMaxMem) :
     N(Nin), C(Cin), I(Iin),
     numSimultaneous(numSimultaneousIn), numWorkers(numWorkersIn),
+    fPipeline(fPipelineIn && numSimultaneousIn > 1),
     workerWork(workerService), commandWork(commandService),
-    waitPads(numSimultaneous)
+    fLowMem(nMaxMem > 0 && nMaxMem < (uint64_t)Nin * Cin * sizeof(uint64_t)),
+    lowmemSegmentChunks(0),
+    lowmemSets(NULL),
+    vSlotJobs(numSimultaneousIn, (CRamhogPoolJob *)NULL),
+    nWaitingVerify(0),
+    nMiningEpoch(0),
+    pjobFilling(NULL),
+    nWaitingFillVerify(0),
+    fWalking(false)
 {
-    for (int i=0; i < numWorkers; i++)
+    std::vector<int> vNodes = fNuma ? RamhogNumaNodes() : std::vector<int>(1, 0);
+    int numNodes = vNodes.size();
+    
+    // A batched walk reads every pad set it carries from one thread, so
+    // only batch when the pad sets aren't spread over NUMA nodes
+    fBatchWalks = fBatchWalksIn && numSimultaneous > 1 && numNodes == 1 && !fLowMem;
+    
+    // Hand each worker a group of pads to fill in SIMD lanes, but only as
+    // many as still leave every worker a job
+    padsPerJob = std::max((uint32_t)1, std::min(ramhog_lanes(), N / std::max(numWorkers, 1)));
+    
+    if (fLowMem)
     {
-        workerPool.create_thread(boost::bind(&boost::asio::io_service::run, &workerService));
+        if (!AllocLowMem(nMaxMem))
+            throw std::runtime_error("CRamhogThreadPool() : unable to allocate low-memory scratchpads");
+        padSets = NULL;
+        StartThreads();
+        return;
     }
     
-    printf("Malloc()ing %dx%d scratchpads @ %.2fMB each = %.2fGB RAM...\n",
+    printf("Allocating %dx%d scratchpads @ %.2fMB each = %.2fGB RAM (hugepages=%s, %d NUMA node%s, %d pads per fill job)...\n",
            N, numSimultaneous, C*8/1024.0/1024.0,
-           N*1.0*numSimultaneous*C*8/1024.0/1024.0/1024.0);
+           N*1.0*numSimultaneous*C*8/1024.0/1024.0/1024.0,
+           strHugePages.c_str(), numNodes, numNodes == 1 ? "" : "s", padsPerJob);
     
-    scratchpads = (uint64_t ***)malloc(sizeof(uint64_t **) * numSimultaneous);
-    fPadUsed = (bool *)malloc(sizeof(bool) * numSimultaneous);
+    padSets = new CRamhogPadSet[numSimultaneous];
     
+    // allocate before any thread starts, so a failure can throw cleanly
     for (int i=0; i < numSimultaneous; i++)
     {
-        commandPool.create_thread(boost::bind(&boost::asio::io_service::run, &commandService));
-        scratchpads[i] = (uint64_t **)malloc(sizeof(uint64_t *) * N);
-        for (int j=0; j < N; j++)
+        if (!padSets[i].Alloc(N, C, strHugePages, numNodes > 1 ? vNodes[i % numNodes] : -1))
         {
-            scratchpads[i][j] = (uint64_t *)malloc(sizeof(uint64_t *) * C);
+            for (int j=0; j < i; j++)
+                padSets[j].Free();
+            delete[] padSets;
+            throw std::runtime_error(strprintf("CRamhogThreadPool() : unable to allocate scratchpad set %d", i));
         }
-        fPadUsed[i] = false;
+        printf("Ramhog scratchpad set %d: %s\n", i, padSets[i].ToString().c_str());
     }
+    
+    StartThreads();
 }
 
-CRamhogThreadPool::~CRamhogThreadPool()
+bool CRamhogThreadPool::AllocLowMem(uint64_t nMaxMem)
 {
-    for (int i=0; i < numSimultaneous; i++)
+    uint32_t numReachable = 0;
+    for (uint32_t j=0; j < N; j++)
+        numReachable += ramhog_pad_reachable(N, j);
+    
+    // every reachable pad recomputes on average half a segment per read
+    lowmemSegmentChunks = ramhog_lowmem_segment_chunks(N, C, nMaxMem);
+    printf("Low-memory ramhog: %d of %d pads reachable, %s, %.2fMB per hash x %d, ~%d chunks recomputed per read\n",
+           numReachable, N,
+           lowmemSegmentChunks ? strprintf("checkpoint every %d chunks", lowmemSegmentChunks).c_str() : "kept whole",
+           numReachable * ramhog_lowmem_pad_bytes(C, lowmemSegmentChunks) / 1024.0 / 1024.0, numSimultaneous,
+           lowmemSegmentChunks / 2);
+    
+    lowmemSets = (ramhog_lowmem_pad **)calloc(numSimultaneous, sizeof(ramhog_lowmem_pad *));
+    for (int i=0; lowmemSets && i < numSimultaneous; i++)
     {
-        for (int j=0; j < N; j++)
+        lowmemSets[i] = (ramhog_lowmem_pad *)calloc(N, sizeof(ramhog_lowmem_pad));
+        for (uint32_t j=0; lowmemSets[i] && j < N; j++)
+        {
+            if (ramhog_pad_reachable(N, j) && !ramhog_lowmem_alloc(&lowmemSets[i][j], C, lowmemSegmentChunks))
+            {
+                FreeLowMem();
+                return false;
+            }
+        }
+        if (!lowmemSets[i])
         {
-            delete scratchpads[i][j];
+            FreeLowMem();
+            return false;
         }
-        delete scratchpads[i];
     }
-    delete scratchpads;
+    return lowmemSets != NULL;
 }
 
-static void ramhog_gen_pad_mt(boost::promise<bool> &done,
-                              const uint8_t *input, size_t input_size,
-                              uint32_t C, uint32_t padIndex,
-                              uint64_t *padOut,
-                              bool fForMiner, CBlockIndex *pindexForBest)
+void CRamhogThreadPool::FreeLowMem()
 {
-    if (fForMiner && pindexForBest != pindexBest)
-    {
-        done.set_value(error("ramhog_gen_pad_mt(): Interrupted from new best block"));
+    if (!lowmemSets)
         return;
+    for (int i=0; i < numSimultaneous; i++)
+    {
+        if (!lowmemSets[i])
+            continue;
+        for (uint32_t j=0; j < N; j++)
+            ramhog_lowmem_free(&lowmemSets[i][j]);
+        free(lowmemSets[i]);
+    }
+    free(lowmemSets);
+    lowmemSets = NULL;
+}
+
+void CRamhogThreadPool::StartThreads()
+{
+    for (int i=0; i < numWorkers; i++)
+    {
+        workerPool.create_thread(boost::bind(&boost::asio::io_service::run, &workerService));
     }
     
-    ramhog_gen_pad(input, input_size, C, padIndex, padOut);
-    done.set_value(true);
+    for (int i=0; i < numSimultaneous; i++)
+    {
+        commandPool.create_thread(boost::bind(&boost::asio::io_service::run, &commandService));
+    }
+}
+
+CRamhogThreadPool::~CRamhogThreadPool()
+{
+    // the pools must be gone before the services they run are destroyed
+    commandService.stop();
+    workerService.stop();
+    commandPool.join_all();
+    workerPool.join_all();
+
+    if (padSets)
+    {
+        for (int i=0; i < numSimultaneous; i++)
+        {
+            padSets[i].Free();
+        }
+        delete[] padSets;
+    }
+    FreeLowMem();
 }
 
 typedef struct ramhog_mt_args
@@ -76,49 +161,177 @@ typedef struct ramhog_mt_args
     uint8_t *output;
     size_t output_size;
     uint32_t N, C, I;
+    uint32_t padsPerJob;
     uint64_t **scratchpads;
-    bool fForMiner;
-    CBlockIndex *pindexForBest;
+    ramhog_lowmem_pad *lowmemPads;
+    int nNode;
+    CRamhogThreadPool *pPipeline;
+    CRamhogPoolJob *pjob;
+    CRamhogThreadPool *pBatchWalks;
+    ramhog_walk walk;
+    const volatile int *pfCancel;
 } ramhog_mt_args;
 
-static void ramhog_mt(ramhog_mt_args &args)
+static void ramhog_gen_pads_job(boost::promise<bool> &done, const ramhog_mt_args &args,
+                                uint32_t firstPadIndex, uint32_t numPads)
 {
-    if (args.fForMiner && args.pindexForBest != pindexBest)
+    if (*args.pfCancel)
     {
-        args.done.set_value(error("ramhog_mt(): Interrupted before pad gen from new best block"));
+        done.set_value(false);
         return;
     }
     
+    if (args.lowmemPads)
+    {
+        done.set_value(ramhog_lowmem_fill(&args.lowmemPads[firstPadIndex], args.input, args.input_size,
+                                          firstPadIndex, args.pfCancel) != 0);
+        return;
+    }
+    
+    if (args.nNode >= 0)
+        RamhogBindThreadToNode(args.nNode);
+    
+    done.set_value(ramhog_gen_pads_cancellable(args.input, args.input_size, args.C, firstPadIndex, numPads,
+                                               &args.scratchpads[firstPadIndex], args.pfCancel) != 0);
+}
+
+static bool ramhog_gen_pads_mt(ramhog_mt_args &args)
+{
     boost::promise<bool> pad_dones[1024];
-    uint32_t padIndex;
+    uint32_t padIndex, numJobs = 0;
     
-    for (padIndex=0; padIndex < args.N; padIndex++)
+    for (padIndex=0; padIndex < args.N; padIndex += args.padsPerJob)
     {
-        args.workerService.post(boost::bind(ramhog_gen_pad_mt,
-                                            boost::ref(pad_dones[padIndex]),
-                                            args.input, args.input_size, args.C, padIndex,
-                                            args.scratchpads[padIndex],
-                                            args.fForMiner, args.pindexForBest));
+        // low-memory pads are filled one per job, and only if the walk can reach them
+        if (args.lowmemPads && !ramhog_pad_reachable(args.N, padIndex))
+            continue;
+        args.workerService.post(boost::bind(ramhog_gen_pads_job,
+                                            boost::ref(pad_dones[numJobs++]), boost::cref(args),
+                                            padIndex, std::min(args.padsPerJob, args.N - padIndex)));
     }
     
     bool fSuccess = true;
-    for (padIndex=0; padIndex < args.N; padIndex++)
+    for (uint32_t job=0; job < numJobs; job++)
     {
-        fSuccess &= pad_dones[padIndex].get_future().get();
+        fSuccess &= pad_dones[job].get_future().get();
     }
     
+    return fSuccess;
+}
+
+static void ramhog_mt(ramhog_mt_args &args)
+{
+    if (*args.pfCancel)
+    {
+        args.done.set_value(false);
+        return;
+    }
+    
+    bool fSuccess;
+    if (args.pPipeline)
+    {
+        // Pipelined: one pad set fills at a time using every worker, so the
+        // fill for the next hash overlaps this hash's single threaded walk
+        // instead of competing with other fills and leaving the workers idle
+        fSuccess = args.pPipeline->AcquireFill(*args.pjob);
+        if (fSuccess)
+        {
+            fSuccess = ramhog_gen_pads_mt(args);
+            args.pPipeline->ReleaseFill();
+        }
+    }
+    else
+        fSuccess = ramhog_gen_pads_mt(args);
+    
     if (!fSuccess)
     {
-        args.done.set_value(error("ramhog_mt(): Interrupted after pad gen from new best block"));
+        args.done.set_value(false);
+        return;
+    }
+    
+    if (args.pBatchWalks)
+    {
+        args.pBatchWalks->WalkBatched(args);
         return;
     }
     
-    ramhog_run_iterations(args.input, args.input_size, args.output, args.output_size,
-                          args.N, args.C, args.I, args.scratchpads);
+    if (args.lowmemPads)
+    {
+        args.done.set_value(ramhog_run_iterations_lowmem(args.input, args.input_size, args.output, args.output_size,
+                                                         args.N, args.C, args.I, args.lowmemPads, args.pfCancel) != 0);
+        return;
+    }
+    
+    if (args.nNode >= 0)
+        RamhogBindThreadToNode(args.nNode);
+    
+    // walk in slices so that a cancelled job stops within a few milliseconds
+    ramhog_walk *pwalk = &args.walk;
+    ramhog_walk_init(pwalk, args.input, args.input_size, args.output, args.output_size,
+                     args.N, args.C, args.I, args.scratchpads);
+    while (!ramhog_walk_steps(&pwalk, 1, RAMHOG_WALK_SLICE))
+    {
+        if (*args.pfCancel)
+        {
+            args.done.set_value(false);
+            return;
+        }
+    }
     
     args.done.set_value(true);
 }
 
+void CRamhogThreadPool::WalkBatched(ramhog_mt_args &args)
+{
+    ramhog_walk_init(&args.walk, args.input, args.input_size, args.output, args.output_size,
+                     args.N, args.C, args.I, args.scratchpads);
+    
+    {
+        LOCK(cs_walks);
+        vPendingWalks.push_back(&args);
+        if (fWalking)
+            return; // the running walker picks it up and sets args.done
+        fWalking = true;
+    }
+    
+    // This thread is now the walker: it advances every queued walk in
+    // lockstep, so that their DRAM misses overlap, until none is left.
+    // New walks join between rounds.
+    std::vector<ramhog_mt_args *> vActive;
+    std::vector<ramhog_walk *> vWalks;
+    loop
+    {
+        {
+            LOCK(cs_walks);
+            vActive.insert(vActive.end(), vPendingWalks.begin(), vPendingWalks.end());
+            vPendingWalks.clear();
+            if (vActive.empty())
+            {
+                fWalking = false;
+                return;
+            }
+        }
+        
+        vWalks.clear();
+        BOOST_FOREACH(ramhog_mt_args *pargs, vActive)
+            vWalks.push_back(&pargs->walk);
+        
+        ramhog_walk_steps(&vWalks[0], vWalks.size(), RAMHOG_WALK_SLICE);
+        
+        for (unsigned int i=0; i < vActive.size(); )
+        {
+            bool fDone = ramhog_walk_done(&vActive[i]->walk);
+            if (fDone || *vActive[i]->pfCancel)
+            {
+                vActive[i]->done.set_value(fDone);
+                vActive.erase(vActive.begin() + i);
+            }
+            else
+                i++;
+        }
+    }
+}
+
 static bool fNeedCheckBlock = false;
 static CCriticalSection cs_needCheckBlock;
 
@@ -132,67 +345,188 @@ void SetNeedCheckBlock(bool fNew)
     fNeedCheckBlock = fNew;
 }
 
+int CRamhogThreadPool::AcquireSlot(CRamhogPoolJob &job)
+{
+    boost::unique_lock<boost::mutex> lock(mutSchedule);
+    
+    if (!job.fForMiner)
+        nWaitingVerify++;
+    
+    loop
+    {
+        if (job.fCancel)
+        {
+            if (!job.fForMiner)
+                nWaitingVerify--;
+            return -1;
+        }
+        if (job.fForMiner && job.nMiningEpoch != nMiningEpoch)
+            return -1;
+        
+        // miners leave free pad sets to verifiers that are waiting
+        if (!job.fForMiner || nWaitingVerify == 0)
+        {
+            for (int i=0; i < numSimultaneous; i++)
+            {
+                if (vSlotJobs[i])
+                    continue;
+                vSlotJobs[i] = &job;
+                if (!job.fForMiner)
+                    nWaitingVerify--;
+                return i;
+            }
+        }
+        
+        if (!job.fForMiner)
+        {
+            // Preempt mining hashes until one is on its way out per waiting verifier
+            int nPreempted = 0;
+            BOOST_FOREACH(CRamhogPoolJob *pjob, vSlotJobs)
+                if (pjob && pjob->fForMiner && pjob->fCancel)
+                    nPreempted++;
+            for (int i=0; i < numSimultaneous && nPreempted < nWaitingVerify; i++)
+            {
+                if (vSlotJobs[i] && vSlotJobs[i]->fForMiner && !vSlotJobs[i]->fCancel)
+                {
+                    vSlotJobs[i]->fCancel = 1;
+                    nPreempted++;
+                    if (fDebug)
+                        printf("CRamhogThreadPool: preempting mining hash in pad set %d\n", i);
+                }
+            }
+            // a preempted miner may be waiting for its turn to fill
+            condSchedule.notify_all();
+        }
+        
+        condSchedule.wait(lock);
+    }
+}
+
+bool CRamhogThreadPool::AcquireFill(CRamhogPoolJob &job)
+{
+    boost::unique_lock<boost::mutex> lock(mutSchedule);
+    
+    if (!job.fForMiner)
+        nWaitingFillVerify++;
+    
+    loop
+    {
+        if (job.fCancel || (job.fForMiner && job.nMiningEpoch != nMiningEpoch))
+        {
+            if (!job.fForMiner)
+                nWaitingFillVerify--;
+            return false;
+        }
+        
+        if (!pjobFilling && (!job.fForMiner || nWaitingFillVerify == 0))
+        {
+            pjobFilling = &job;
+            if (!job.fForMiner)
+                nWaitingFillVerify--;
+            return true;
+        }
+        
+        // a miner's fill would hold a verifier up for a whole fill
+        if (!job.fForMiner && pjobFilling && pjobFilling->fForMiner && !pjobFilling->fCancel)
+        {
+            pjobFilling->fCancel = 1;
+            if (fDebug)
+                printf("CRamhogThreadPool: preempting mining hash pad fill\n");
+        }
+        
+        condSchedule.wait(lock);
+    }
+}
+
+void CRamhogThreadPool::ReleaseFill()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutSchedule);
+        pjobFilling = NULL;
+    }
+    condSchedule.notify_all();
+}
+
+void CRamhogThreadPool::ReleaseSlot(int whichPad)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutSchedule);
+        vSlotJobs[whichPad] = NULL;
+    }
+    condSchedule.notify_all();
+}
+
+void CRamhogThreadPool::Cancel(CRamhogPoolJob &job)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutSchedule);
+        job.fCancel = 1;
+    }
+    condSchedule.notify_all();
+}
+
+void CRamhogThreadPool::CancelMining()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutSchedule);
+        nMiningEpoch++;
+        BOOST_FOREACH(CRamhogPoolJob *pjob, vSlotJobs)
+            if (pjob && pjob->fForMiner)
+                pjob->fCancel = 1;
+    }
+    condSchedule.notify_all();
+}
+
 bool CRamhogThreadPool::ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
                                bool fForMiner)
+{
+    CRamhogPoolJob job(fForMiner);
+    return ramhog(input, input_size, output, output_size, job);
+}
+
+bool CRamhogThreadPool::ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+                               CRamhogPoolJob &job)
 {
     if (numSimultaneous == 0 || numWorkers == 0)
         return error("CRamhogThreadPool::ramhog(): No workers");
         
     {
         LOCK(cs_needCheckBlock);
-        if (fNeedCheckBlock && fForMiner)
+        if (fNeedCheckBlock && job.fForMiner)
             return false;
     }
 
-    CBlockIndex *pindexForBest = pindexBest;
-
-    waitPads.wait();
-    
-    if (fForMiner && pindexForBest != pindexBest)
     {
-        waitPads.post();
-        return error("CRamhogThreadPool::ramhog(): Interrupted from new best block");
+        boost::unique_lock<boost::mutex> lock(mutSchedule);
+        job.nMiningEpoch = nMiningEpoch;
     }
     
-    int whichPad = -1;
-    {
-        LOCK(cs_pickPad);
-        
-        int i;
-        for (i=0; i < numSimultaneous; i++)
-        {
-            if (!fPadUsed[i])
-            {
-                whichPad = i;
-                fPadUsed[whichPad] = true;
-                break;
-            }
-        }
-        if (whichPad == -1)
-        {
-            waitPads.post();
-            throw new std::runtime_error("waitPads/fPadUsed mismatch");
-        }
-    }
+    int whichPad = AcquireSlot(job);
+    if (whichPad == -1)
+        return false; // cancelled, or the best block changed while the miner waited
     
     boost::promise<bool> ramhog_done;
     
     ramhog_mt_args args = {
         workerService, ramhog_done,
         input, input_size, output, output_size,
-        N, C, I, scratchpads[whichPad],
-        fForMiner, pindexForBest};
+        N, C, I, fLowMem ? 1 : padsPerJob,
+        fLowMem ? NULL : padSets[whichPad].pads,
+        fLowMem ? lowmemSets[whichPad] : NULL,
+        fLowMem ? -1 : padSets[whichPad].nNode,
+        fPipeline ? this : NULL, &job,
+        fBatchWalks ? this : NULL,
+        ramhog_walk(),
+        &job.fCancel};
     
     commandService.post(boost::bind(ramhog_mt, boost::ref(args)));
     
     bool fSuccess = ramhog_done.get_future().get();
     
-    {
-        LOCK(cs_pickPad);
-        fPadUsed[whichPad] = false;
-    }
+    ReleaseSlot(whichPad);
     
-    waitPads.post();
+    if (!fSuccess && fDebug)
+        printf("CRamhogThreadPool::ramhog(): %s hash cancelled\n", job.fForMiner ? "mining" : "verifying");
     
     return fSuccess;
 }
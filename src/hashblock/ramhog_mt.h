@@ -2,15 +2,45 @@
 #define RAMHOG_MT_H
 
 #include "util.h"
+#include "ramhog.h"
+#include "ramhog_alloc.h"
 
 #include <boost/asio/io_service.hpp>
-#include <boost/interprocess/sync/interprocess_semaphore.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 
-class CRamhogThreadPool
+struct ramhog_mt_args;
+
+/** One hash waiting for or holding a pad set in CRamhogThreadPool. */
+struct CRamhogPoolJob
+{
+    bool fForMiner;
+    int nMiningEpoch;
+    volatile int fCancel;     // set to stop the job's pad fill or walk
+
+    CRamhogPoolJob(bool fForMinerIn=false) : fForMiner(fForMinerIn), nMiningEpoch(0), fCancel(0) {}
+};
+
+/** Computes ramhog hashes, in this process or by asking a shinycoin-ramhogd. */
+class CRamhogHasher
+{
+public:
+    virtual ~CRamhogHasher() {}
+    
+    virtual bool ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+                        bool fForMiner) = 0;
+    
+    // The best block changed: mining hashes in progress are for a stale block
+    virtual void CancelMining() {}
+};
+
+class CRamhogThreadPool : public CRamhogHasher
 {
 private:
     uint32_t N, C, I;
     int numSimultaneous, numWorkers;
+    uint32_t padsPerJob;
+    bool fPipeline;
     
     boost::asio::io_service workerService;
     boost::thread_group workerPool;
@@ -20,19 +50,64 @@ private:
     boost::thread_group commandPool;
     boost::asio::io_service::work commandWork;
     
-    uint64_t ***scratchpads;
+    CRamhogPadSet *padSets;
+    
+    // Low-memory mode (nMaxMem below a full pad set): only the reachable
+    // pads, kept whole or as checkpoints every lowmemSegmentChunks chunks
+    bool fLowMem;
+    uint32_t lowmemSegmentChunks;
+    ramhog_lowmem_pad **lowmemSets;
+    
+    // Scheduler: a hash for a block being verified always gets the next
+    // free pad set, and preempts a mining hash if there is none
+    boost::mutex mutSchedule;
+    boost::condition_variable condSchedule;
+    std::vector<CRamhogPoolJob *> vSlotJobs;    // NULL for a free pad set
+    int nWaitingVerify;
+    int nMiningEpoch;
+    
+    // Pipelined pad fills take turns, also under mutSchedule: a verification
+    // hash waiting for its turn goes first, and preempts a filling miner
+    CRamhogPoolJob *pjobFilling;
+    int nWaitingFillVerify;
+    
+    bool fBatchWalks;
+    CCriticalSection cs_walks;
+    std::vector<ramhog_mt_args *> vPendingWalks;
+    bool fWalking;
     
-    CSemaphore waitPads;
-    CCriticalSection cs_pickPad;
-    bool *fPadUsed;
+    bool AllocLowMem(uint64_t nMaxMem);
+    void FreeLowMem();
+    void StartThreads();
+    
+    int AcquireSlot(CRamhogPoolJob &job);
+    void ReleaseSlot(int whichPad);
     
 public:
     CRamhogThreadPool(uint32_t N, uint32_t C, uint32_t I,
-                      int numSimultaneous, int numWorkers);
+                      int numSimultaneous, int numWorkers,
+                      const std::string &strHugePages="none", bool fNuma=false,
+                      bool fPipeline=false, bool fBatchWalks=false,
+                      uint64_t nMaxMem=0);
     ~CRamhogThreadPool();
     
     bool ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
                 bool fForMiner);
+    // As above, for a job the caller can Cancel() from another thread
+    bool ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+                CRamhogPoolJob &job);
+    void Cancel(CRamhogPoolJob &job);
+    void CancelMining();
+    
+    bool IsLowMem() const { return fLowMem; }
+    
+    // Called on a command thread around a pipelined pad fill; false if
+    // the job was cancelled while it waited
+    bool AcquireFill(CRamhogPoolJob &job);
+    void ReleaseFill();
+    
+    // Called on a command thread once a pad set is filled
+    void WalkBatched(ramhog_mt_args &args);
 };
 
 void SetNeedCheckBlock(bool fNew);
@@ -0,0 +1,184 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hashcache.h"
+#include "util.h"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+static const char pchHashCacheMagic[8] = {'s', 'h', 'y', 'h', 'a', 's', 'h', 'c'};
+static const unsigned int HASHCACHE_VERSION = 1;
+
+// grow the mapping in steps, so that appending a block rarely remaps
+static const size_t HASHCACHE_MAP_STEP = 16 * 1024 * 1024;
+
+struct CHashCacheHeader
+{
+    char pchMagic[8];
+    unsigned int nVersion;
+    unsigned int nRecordSize;
+    uint256 hashMasterPubKey;
+};
+
+static const size_t HASHCACHE_HEADER_SIZE = sizeof(CHashCacheHeader);
+static const size_t HASHCACHE_RECORD_SIZE = sizeof(CHashCacheRecord);
+
+bool CHashCacheFile::Map(size_t nMinSize)
+{
+    if (nMinSize <= nMapped)
+        return true;
+
+#ifdef WIN32
+    // no mapping, keep a copy of the file that Write() keeps up to date
+    size_t nOldSize = vchData.size();
+    vchData.resize(nMinSize);
+    if (fseek(file, nOldSize, SEEK_SET) != 0)
+        return false;
+    size_t nRead = fread(&vchData[nOldSize], 1, nMinSize - nOldSize, file);
+    memset(&vchData[nOldSize + nRead], 0, nMinSize - nOldSize - nRead);
+    pbegin = &vchData[0];
+    nMapped = nMinSize;
+#else
+    Unmap();
+    size_t nSize = (nMinSize + HASHCACHE_MAP_STEP - 1) / HASHCACHE_MAP_STEP * HASHCACHE_MAP_STEP;
+    // pages past the end of the file are mapped but never read
+    void *p = mmap(NULL, nSize, PROT_READ, MAP_SHARED, fileno(file), 0);
+    if (p == MAP_FAILED)
+        return error("CHashCacheFile::Map() : mmap of %.2fMB failed", nSize / 1024.0 / 1024.0);
+    pbegin = (const unsigned char *)p;
+    nMapped = nSize;
+#endif
+    return true;
+}
+
+void CHashCacheFile::Unmap()
+{
+#ifdef WIN32
+    vchData.clear();
+#else
+    if (pbegin)
+        munmap((void *)pbegin, nMapped);
+#endif
+    pbegin = NULL;
+    nMapped = 0;
+}
+
+bool CHashCacheFile::Open(const boost::filesystem::path &path, const uint256 &hashMasterPubKey, bool &fCreated)
+{
+    Close();
+    fCreated = false;
+
+    CHashCacheHeader header;
+    file = fopen(path.string().c_str(), "r+b");
+    if (file)
+    {
+        if (fread(&header, sizeof(header), 1, file) != 1 ||
+            memcmp(header.pchMagic, pchHashCacheMagic, sizeof(pchHashCacheMagic)) != 0 ||
+            header.nVersion != HASHCACHE_VERSION || header.nRecordSize != HASHCACHE_RECORD_SIZE)
+        {
+            printf("CHashCacheFile::Open() : %s is from another version, recreating it\n", path.string().c_str());
+            fclose(file);
+            file = NULL;
+        }
+    }
+    if (!file)
+    {
+        file = fopen(path.string().c_str(), "w+b");
+        if (!file)
+            return error("CHashCacheFile::Open() : cannot create %s", path.string().c_str());
+        memcpy(header.pchMagic, pchHashCacheMagic, sizeof(pchHashCacheMagic));
+        header.nVersion = HASHCACHE_VERSION;
+        header.nRecordSize = HASHCACHE_RECORD_SIZE;
+        header.hashMasterPubKey = hashMasterPubKey;
+        if (fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0)
+        {
+            Close();
+            return error("CHashCacheFile::Open() : cannot write %s", path.string().c_str());
+        }
+        fCreated = true;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0)
+    {
+        Close();
+        return error("CHashCacheFile::Open() : cannot seek in %s", path.string().c_str());
+    }
+    long nFileSize = ftell(file);
+    nRecords = (nFileSize - HASHCACHE_HEADER_SIZE) / HASHCACHE_RECORD_SIZE;
+
+    if (!Map(HASHCACHE_HEADER_SIZE + nRecords * HASHCACHE_RECORD_SIZE))
+    {
+        Close();
+        return false;
+    }
+
+    if (header.hashMasterPubKey != hashMasterPubKey)
+    {
+        // signatures under the old key are worthless, the PoW hashes are still good
+        printf("CHashCacheFile::Open() : signed hash master key changed, dropping signatures\n");
+        CHashCacheRecord record;
+        for (int nHeight = 0; nHeight < nRecords; nHeight++)
+        {
+            if (!Read(nHeight, record) || !(record.nFlags & HASHCACHE_SIGNED))
+                continue;
+            record.nFlags &= ~HASHCACHE_SIGNED;
+            record.SetSig(std::vector<unsigned char>());
+            if (!Write(nHeight, record))
+                return false;
+        }
+        header.hashMasterPubKey = hashMasterPubKey;
+        if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1 || fflush(file) != 0)
+            return error("CHashCacheFile::Open() : cannot write %s", path.string().c_str());
+    }
+
+    return true;
+}
+
+void CHashCacheFile::Close()
+{
+    Unmap();
+    if (file)
+        fclose(file);
+    file = NULL;
+    nRecords = 0;
+}
+
+bool CHashCacheFile::Read(int nHeight, CHashCacheRecord &record) const
+{
+    if (nHeight < 0 || nHeight >= nRecords)
+        return false;
+    memcpy(&record, pbegin + HASHCACHE_HEADER_SIZE + (size_t)nHeight * HASHCACHE_RECORD_SIZE, HASHCACHE_RECORD_SIZE);
+    return true;
+}
+
+bool CHashCacheFile::Write(int nHeight, const CHashCacheRecord &record)
+{
+    if (!file || nHeight < 0)
+        return false;
+
+    // writing past the end leaves zeroed, i.e. null, records in between
+    size_t nPos = HASHCACHE_HEADER_SIZE + (size_t)nHeight * HASHCACHE_RECORD_SIZE;
+    if (fseek(file, nPos, SEEK_SET) != 0 ||
+        fwrite(&record, HASHCACHE_RECORD_SIZE, 1, file) != 1 ||
+        fflush(file) != 0)
+        return error("CHashCacheFile::Write() : failed to write height %d", nHeight);
+
+    if (nHeight >= nRecords)
+    {
+        nRecords = nHeight + 1;
+        if (!Map(nPos + HASHCACHE_RECORD_SIZE))
+            return false;
+    }
+#ifdef WIN32
+    memcpy(&vchData[nPos], &record, HASHCACHE_RECORD_SIZE);
+#endif
+    return true;
+}
+
+bool CHashCacheFile::Flush()
+{
+    return file && fflush(file) == 0;
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SHINYCOIN_HASHCACHE_H
+#define SHINYCOIN_HASHCACHE_H
+
+#include "uint256.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+enum
+{
+    HASHCACHE_POW    = (1 << 0),    // powHash is set
+    HASHCACHE_SIGNED = (1 << 1),    // vchSig signs idHash/powHash
+};
+
+static const unsigned int HASHCACHE_MAX_SIG_SIZE = 88;
+
+/** One block's proof-of-work hash and master key signature, as stored on disk. */
+struct CHashCacheRecord
+{
+    uint256 idHash;
+    uint256 powHash;
+    unsigned int nFlags;
+    unsigned int nSigSize;
+    unsigned char vchSig[HASHCACHE_MAX_SIG_SIZE];
+
+    void SetNull()
+    {
+        idHash = 0;
+        powHash = 0;
+        nFlags = 0;
+        nSigSize = 0;
+        memset(vchSig, 0, sizeof(vchSig));
+    }
+
+    bool IsNull() const
+    {
+        return nFlags == 0;
+    }
+
+    void SetSig(const std::vector<unsigned char> &vchSigIn)
+    {
+        nSigSize = vchSigIn.size();
+        memset(vchSig, 0, sizeof(vchSig));
+        if (!vchSigIn.empty())
+            memcpy(vchSig, &vchSigIn[0], nSigSize);
+    }
+
+    std::vector<unsigned char> GetSig() const
+    {
+        return std::vector<unsigned char>(vchSig, vchSig + nSigSize);
+    }
+};
+
+/**
+ * hashcache.dat: a header followed by one fixed-size CHashCacheRecord per
+ * block height of the main chain. The file is mapped read-only, so opening
+ * it costs the same at any chain height; records are written through the
+ * FILE and show up in the mapping. A record is only overwritten when a
+ * reorganization puts a different block at its height.
+ */
+class CHashCacheFile
+{
+private:
+    FILE *file;
+    const unsigned char *pbegin;
+    size_t nMapped;
+    int nRecords;
+#ifdef WIN32
+    std::vector<unsigned char> vchData;
+#endif
+
+    bool Map(size_t nMinSize);
+    void Unmap();
+
+public:
+    CHashCacheFile() : file(NULL), pbegin(NULL), nMapped(0), nRecords(0) {}
+    ~CHashCacheFile() { Close(); }
+
+    /**
+     * Open or create the file. If it was written for a different signed
+     * hash master key its signatures are dropped. fCreated is set when
+     * there was no usable file before.
+     */
+    bool Open(const boost::filesystem::path &path, const uint256 &hashMasterPubKey, bool &fCreated);
+    void Close();
+
+    bool IsOpen() const { return file != NULL; }
+
+    /** One past the highest height with a record slot. */
+    int Size() const { return nRecords; }
+
+    bool Read(int nHeight, CHashCacheRecord &record) const;
+    bool Write(int nHeight, const CHashCacheRecord &record);
+    bool Flush();
+};
+
+#endif
@@ -14,6 +14,7 @@
 #include "checkpoints.h"
 #include "hashblock/hashblock.h"
 #include "signedhash.h"
+#include "unspent.h"
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/convenience.hpp>
@@ -72,11 +73,19 @@ void Shutdown(void* parg)
         nTransactionsUpdated++;
         DBFlush(false);
         StopNode();
+        SignedHash::StopVerifier();
+        if (punspentCache)
+        {
+            if (!punspentCache->Flush())
+                error("Shutdown() : failed to write back the unspent output set");
+            punspentCache->Close();
+        }
         DBFlush(true);
         boost::filesystem::remove(GetPidFile());
         UnregisterWallet(pwalletMain);
         delete pwalletMain; pwalletMain = NULL;
         delete ptxinfoStore; ptxinfoStore = NULL;
+        delete punspentCache; punspentCache = NULL;
         delete pramhogPool; pramhogPool = NULL;
         CreateThread(ExitTimeout, NULL);
         Sleep(50);
@@ -195,6 +204,15 @@ bool AppInit2(int argc, char* argv[])
             "  -gen=0           \t\t  " + _("Don't generate coins") + "\n" +
             "  -ramhogthreads=<n>\t\t  " + _("Set the number of concurrent ramhog hashes to run.  You will need 15 GB for each thread (default: 0)") +
             "  -ramhogworkers=<n>\t\t  " + _("Set the number of worker threads to use for generating scratchpads (default: the number of processors)") +
+            "  -ramhoghugepages=<mode>\t  " + _("Back scratchpads with huge pages: auto, 1gb, 2mb, thp or none (default: auto)") + "\n" +
+            "  -ramhognuma      \t  "   + _("Bind each scratchpad set and its threads to one NUMA node (default: 1)") + "\n" +
+            "  -ramhoglanes=<n> \t  "   + _("Fill up to <n> scratchpads at once per worker in SIMD lanes: 1, 4 (AVX2) or 8 (AVX-512) (default: 4)") + "\n" +
+            "  -ramhogpipeline  \t  "   + _("Fill one scratchpad set at a time so fills overlap the random walks of other hashes (default: 1)") + "\n" +
+            "  -ramhogbatchwalks\t  "   + _("Interleave the random walks of concurrent hashes on one thread to overlap memory reads (default: 1)") + "\n" +
+            "  -ramhogmaxmem=<n>\t  " + _("Keep at most <n> MB of scratchpad per concurrent hash, recomputing the rest as it is read; slower, for verifying nodes (default: 0 = no limit)") + "\n" +
+            "  -ramhogd         \t  "   + _("Compute ramhog hashes in a shinycoin-ramhogd on this host instead of in-process") + "\n" +
+            "  -ramhogsocket=<path>\t  " + _("Socket of shinycoin-ramhogd (default: ramhogd.sock in the data directory)") + "\n" +
+            "  -signedhashthreads=<n>\t  " + _("Threads checking signed hashes received from peers (default: number of processors)") + "\n" +
             "  -usesignedhashes\t\t"    + _("Use the signed proof-of-work hashes (default: true)") + "\n" +
             "  -usesignedhashes=0\t\t"  + _("Don't use the signed proof-of-work hashes") + "\n" +
             "  -mint            \t\t  " + _("Mint coins (default: true)") + "\n" +
@@ -204,6 +222,13 @@ bool AppInit2(int argc, char* argv[])
             "  -splash          \t\t  " + _("Show splash screen on startup (default: 1)") + "\n" +
             "  -datadir=<dir>   \t\t  " + _("Specify data directory") + "\n" +
             "  -dbcache=<n>     \t\t  " + _("Set database cache size in megabytes (default: 25)") + "\n" +
+            "  -sigcachesize=<n>\t  " + _("Keep up to <n> MB of valid signature digests in memory (default: 8, at most 16384)") + "\n" +
+            "  -par=<n>         \t\t  " + _("Set the number of script verification threads (up to 32, 0 = auto, <0 = leave that many cores free, default: 0)") + "\n" +
+            "  -unspentcache=<n>\t\t  " + _("Keep up to <n> unspent outputs in memory (default: 500000)") + "\n" +
+            "  -txinfocache=<n> \t\t  " + _("Keep the latest tx info values of up to <n> address keys in memory (default: 50000)") + "\n" +
+            "  -txinfowal       \t\t  " + _("Use a write-ahead log for the tx info index, so readers don't wait for block connects (default: 1)") + "\n" +
+            "  -txinfommap=<n>  \t\t  " + _("Memory map up to <n> MB of the tx info index (default: 64)") + "\n" +
+            "  -txinfodbcache=<n>\t\t  " + _("Set the tx info index page cache size in megabytes, per connection (default: 8)") + "\n" +
             "  -dblogsize=<n>   \t\t  " + _("Set database disk log size in megabytes (default: 100)") + "\n" +
             "  -timeout=<n>     \t  "   + _("Specify connection timeout (in milliseconds)") + "\n" +
             "  -proxy=<ip:port> \t  "   + _("Connect through socks4 proxy") + "\n" +
@@ -254,6 +279,7 @@ bool AppInit2(int argc, char* argv[])
             "  -upgradewallet   \t  "   + _("Upgrade wallet to latest format") + "\n" +
             "  -keypool=<n>     \t  "   + _("Set key pool size to <n> (default: 100)") + "\n" +
             "  -rescan          \t  "   + _("Rescan the block chain for missing wallet transactions") + "\n" +
+            "  -rebuildtxinfo   \t  "   + _("Rebuild the tx info index (infostore.db3) from the block files") + "\n" +
             "  -checkblocks=<n> \t\t  " + _("How many blocks to check at startup (default: 2500, 0 = all)") + "\n" +
             "  -checklevel=<n>  \t\t  " + _("How thorough the block verification is (0-6, default: 1)") + "\n";
 
@@ -376,9 +402,30 @@ bool AppInit2(int argc, char* argv[])
         fprintf(stdout, "shinycoin server starting\n");
     int64 nStart;
 
-    ptxinfoStore = new CTxInfoStore(GetDataDir(true) / "infostore.db3");
+    ptxinfoStore = new CTxInfoStore(GetDataDir(true) / "infostore.db3",
+                                    max((int)GetArg("-txinfocache", DEFAULT_TXINFO_CACHE), 0),
+                                    GetBoolArg("-txinfowal", true),
+                                    GetArg("-txinfommap", 64) * 1024 * 1024,
+                                    GetArg("-txinfodbcache", 8));
+    punspentCache = new CUnspentCache(max((int)GetArg("-unspentcache", DEFAULT_UNSPENT_CACHE), 0));
+    
+    SoftSetArg("-genproclimit", GetBoolArg("-ramhogd") ? "1" : GetArg("-ramhogthreads", "0"));
     
-    SoftSetArg("-genproclimit", GetArg("-ramhogthreads", "0"));
+    // -par counts the thread connecting the block, which checks too
+    nScriptCheckThreads = GetArg("-par", 0);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += boost::thread::hardware_concurrency();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+    if (nScriptCheckThreads)
+    {
+        printf("Using %d threads for script verification\n", nScriptCheckThreads);
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            if (!CreateThread(ThreadScriptCheck, NULL))
+                printf("Error: CreateThread(ThreadScriptCheck) failed\n");
+    }
     
     InitMessage(_("Loading addresses..."));
     printf("Loading addresses...\n");
@@ -403,6 +450,16 @@ bool AppInit2(int argc, char* argv[])
     }
     printf(" block index %15"PRI64d"ms\n", GetTimeMillis() - nStart);
 
+    if (GetBoolArg("-rebuildtxinfo"))
+    {
+        InitMessage(_("Rebuilding tx info index..."));
+        printf("Rebuilding tx info index...\n");
+        nStart = GetTimeMillis();
+        if (!RebuildTxInfoStore())
+            strErrors << _("Error rebuilding the tx info index") << "\n";
+        printf(" tx infos    %15"PRI64d"ms\n", GetTimeMillis() - nStart);
+    }
+
     InitMessage(_("Loading wallet..."));
     printf("Loading wallet...\n");
     nStart = GetTimeMillis();
@@ -489,7 +546,7 @@ bool AppInit2(int argc, char* argv[])
     printf("mapWallet.size() = %d\n",       pwalletMain->mapWallet.size());
     printf("mapAddressBook.size() = %d\n",  pwalletMain->mapAddressBook.size());
     
-    if (GetArg("-ramhogthreads", 0) == 0 && !GetBoolArg("-usesignedhashes", true))
+    if (GetArg("-ramhogthreads", 0) == 0 && !GetBoolArg("-ramhogd") && !GetBoolArg("-usesignedhashes", true))
         strErrors << _("Must either run ramhog or use the signed hashes") << "\n";
 
     if (!strErrors.str().empty())
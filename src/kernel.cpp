@@ -6,6 +6,7 @@
 #include <boost/assign/list_of.hpp>
 
 #include "kernel.h"
+#include "kernelhash.h"
 #include "db.h"
 
 using namespace std;
@@ -64,7 +65,7 @@ static int64 GetStakeModifierSelectionIntervalSection(int nSection)
 }
 
 // Get stake modifier selection interval (in seconds)
-static int64 GetStakeModifierSelectionInterval()
+int64 GetStakeModifierSelectionInterval()
 {
     int64 nSelectionInterval = 0;
     for (int nSection=0; nSection<64; nSection++)
@@ -248,18 +249,111 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64& nStakeMo
     return true;
 }
 
+// Stake modifier table: the best chain by height, and the blocks in it that
+// generated a stake modifier, so the kernel modifier of a block is found
+// without walking pnext from it
+struct CModifierGenerator
+{
+    const CBlockIndex* pindex;
+    int64 nTime;
+    int64 nMaxTime;     // latest time of this or any earlier generator
+};
+
+static CCriticalSection cs_modifierTable;
+static vector<const CBlockIndex*> vModifierChain;
+static vector<int> vModifierLast;  // by height: last generator at or below it, or -1
+static vector<CModifierGenerator> vModifierGenerators;
+
+static bool CompareGeneratorMaxTime(const CModifierGenerator& generator, int64 nTime)
+{
+    return generator.nMaxTime < nTime;
+}
+
+void UpdateStakeModifierTable(const CBlockIndex* pindexNew)
+{
+    LOCK(cs_modifierTable);
+
+    // walk back to the fork with the chain in the table
+    vector<const CBlockIndex*> vConnect;
+    const CBlockIndex* pindexFork = pindexNew;
+    while (pindexFork && !(pindexFork->nHeight < (int)vModifierChain.size() && vModifierChain[pindexFork->nHeight] == pindexFork))
+    {
+        vConnect.push_back(pindexFork);
+        pindexFork = pindexFork->pprev;
+    }
+
+    // roll back to the fork
+    int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+    vModifierChain.resize(nForkHeight + 1);
+    vModifierLast.resize(nForkHeight + 1);
+    while (!vModifierGenerators.empty() && vModifierGenerators.back().pindex->nHeight > nForkHeight)
+        vModifierGenerators.pop_back();
+
+    // and add the new branch
+    BOOST_REVERSE_FOREACH(const CBlockIndex* pindex, vConnect)
+    {
+        if (pindex->GeneratedStakeModifier())
+        {
+            CModifierGenerator generator;
+            generator.pindex = pindex;
+            generator.nTime = pindex->GetBlockTime();
+            generator.nMaxTime = generator.nTime;
+            if (!vModifierGenerators.empty())
+                generator.nMaxTime = max(generator.nMaxTime, vModifierGenerators.back().nMaxTime);
+            vModifierGenerators.push_back(generator);
+        }
+        vModifierChain.push_back(pindex);
+        vModifierLast.push_back((int)vModifierGenerators.size() - 1);
+    }
+}
+
+// The first block after pindexFrom in the best chain to generate a stake
+// modifier at or after nTime; false if there is none yet, or pindexFrom isn't
+// in the best chain
+static bool GetStakeModifierFromTable(const CBlockIndex* pindexFrom, int64 nTime, const CBlockIndex*& pindexModifierRet)
+{
+    LOCK(cs_modifierTable);
+    if (pindexBest && (vModifierChain.empty() || vModifierChain.back() != pindexBest))
+        UpdateStakeModifierTable(pindexBest);
+
+    int nHeight = pindexFrom->nHeight;
+    if (nHeight >= (int)vModifierChain.size() || vModifierChain[nHeight] != pindexFrom)
+        return false;
+
+    // Generator times hardly ever go backwards, so the first to reach nTime
+    // at all is nearly always the one, unless it is at or before pindexFrom
+    vector<CModifierGenerator>::const_iterator it = lower_bound(vModifierGenerators.begin(), vModifierGenerators.end(), nTime, CompareGeneratorMaxTime);
+    for (int i = max((int)(it - vModifierGenerators.begin()), vModifierLast[nHeight] + 1); i < (int)vModifierGenerators.size(); i++)
+    {
+        if (vModifierGenerators[i].nTime >= nTime)
+        {
+            pindexModifierRet = vModifierGenerators[i].pindex;
+            return true;
+        }
+    }
+    return false;
+}
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
-static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64& nStakeModifier, int& nStakeModifierHeight, int64& nStakeModifierTime, bool fPrintProofOfStake)
+// pindexModifierRet is the block the search ended on: while it is in the main
+// chain, so is every block between, and the modifier stays the same
+static bool GetKernelStakeModifier(const CBlockIndex* pindexFrom, uint64& nStakeModifier, int& nStakeModifierHeight, int64& nStakeModifierTime, const CBlockIndex*& pindexModifierRet, bool fPrintProofOfStake)
 {
+    uint256 hashBlockFrom = pindexFrom->GetBlockIDHash();
     nStakeModifier = 0;
-    if (!mapBlockIndex.count(hashBlockFrom))
-        return error("GetKernelStakeModifier() : block not indexed");
-    const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
     nStakeModifierHeight = pindexFrom->nHeight;
     nStakeModifierTime = pindexFrom->GetBlockTime();
     int64 nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
     const CBlockIndex* pindex = pindexFrom;
+    if (GetStakeModifierFromTable(pindexFrom, pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval, pindex))
+    {
+        nStakeModifier = pindex->nStakeModifier;
+        nStakeModifierHeight = pindex->nHeight;
+        nStakeModifierTime = pindex->GetBlockTime();
+        pindexModifierRet = pindex;
+        return true;
+    }
     // loop to find the stake modifier later by a selection interval
     while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval)
     {
@@ -279,9 +373,19 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64& nStakeModifier
         }
     }
     nStakeModifier = pindex->nStakeModifier;
+    pindexModifierRet = pindex;
     return true;
 }
 
+static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64& nStakeModifier, int& nStakeModifierHeight, int64& nStakeModifierTime, bool fPrintProofOfStake)
+{
+    nStakeModifier = 0;
+    if (!mapBlockIndex.count(hashBlockFrom))
+        return error("GetKernelStakeModifier() : block not indexed");
+    const CBlockIndex* pindexModifier;
+    return GetKernelStakeModifier(mapBlockIndex[hashBlockFrom], nStakeModifier, nStakeModifierHeight, nStakeModifierTime, pindexModifier, fPrintProofOfStake);
+}
+
 // ppcoin kernel protocol
 // coinstake must meet hash target according to the protocol:
 // kernel (input 0) must meet the formula
@@ -376,6 +480,139 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
     return true;
 }
 
+bool GetStakeKernelInput(const CBlockIndex* pindexFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, unsigned int nPrevout, CStakeKernelInput& input)
+{
+    int nStakeModifierHeight;
+    int64 nStakeModifierTime;
+    if (!GetKernelStakeModifier(pindexFrom, input.nStakeModifier, nStakeModifierHeight, nStakeModifierTime, input.pindexModifier, false))
+        return false;
+    input.pindexFrom = pindexFrom;
+    input.nTimeBlockFrom = pindexFrom->GetBlockTime();
+    input.nTxPrevOffset = nTxPrevOffset;
+    input.nTimeTxPrev = txPrev.nTime;
+    input.nPrevout = nPrevout;
+    input.nValueIn = txPrev.vout[nPrevout].nValue;
+    return true;
+}
+
+bool CheckStakeKernelHash(unsigned int nBits, const CStakeKernelInput& input, unsigned int nTimeTx, uint256& hashProofOfStake)
+{
+    if (!IsProtocolV03(nTimeTx))
+        return false;
+    if (nTimeTx < input.nTimeTxPrev || input.nTimeBlockFrom + nStakeMinAge > nTimeTx)
+        return false;
+
+    // the same bytes CheckStakeKernelHash() serializes
+    unsigned char pchKernel[28];
+    memcpy(&pchKernel[0], &input.nStakeModifier, 8);
+    memcpy(&pchKernel[8], &input.nTimeBlockFrom, 4);
+    memcpy(&pchKernel[12], &input.nTxPrevOffset, 4);
+    memcpy(&pchKernel[16], &input.nTimeTxPrev, 4);
+    memcpy(&pchKernel[20], &input.nPrevout, 4);
+    memcpy(&pchKernel[24], &nTimeTx, 4);
+    hashProofOfStake = Hash(BEGIN(pchKernel), END(pchKernel));
+
+    CBigNum bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    int64 nTimeWeight = min((int64)nTimeTx - input.nTimeTxPrev, (int64)STAKE_MAX_AGE) - nStakeMinAge;
+    CBigNum bnCoinDayWeight = CBigNum(input.nValueIn) * nTimeWeight / COIN / (24 * 60 * 60);
+    return CBigNum(hashProofOfStake) <= bnCoinDayWeight * bnTargetPerCoinDay;
+}
+
+// nValueIn * nTimeWeight / COIN / (24 * 60 * 60), rounded down as CBigNum
+// does, without overflowing 64 bits
+static uint64 GetCoinDayWeight(int64 nValueIn, int64 nTimeWeight)
+{
+    const uint64 nCoinDay = COIN * 24 * 60 * 60;
+    return (uint64)nValueIn / nCoinDay * nTimeWeight + (uint64)nValueIn % nCoinDay * nTimeWeight / nCoinDay;
+}
+
+// hash <= nWeight * target, with the product in 320 bits so it can't wrap
+static bool HashMeetsWeightedTarget(const uint256& hash, uint64 nWeight, const uint256& target)
+{
+    unsigned int pnHash[8], pnTarget[8], pnProduct[10];
+    for (int i = 0; i < 4; i++)
+    {
+        pnHash[2 * i] = (unsigned int)hash.Get64(i);
+        pnHash[2 * i + 1] = (unsigned int)(hash.Get64(i) >> 32);
+        pnTarget[2 * i] = (unsigned int)target.Get64(i);
+        pnTarget[2 * i + 1] = (unsigned int)(target.Get64(i) >> 32);
+    }
+    memset(pnProduct, 0, sizeof(pnProduct));
+    for (int j = 0; j < 2; j++)
+    {
+        uint64 nLimb = (j == 0 ? nWeight & 0xffffffff : nWeight >> 32);
+        uint64 nCarry = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            uint64 n = nLimb * pnTarget[i] + pnProduct[i + j] + nCarry;
+            pnProduct[i + j] = (unsigned int)n;
+            nCarry = n >> 32;
+        }
+        pnProduct[8 + j] = (unsigned int)nCarry;
+    }
+    if (pnProduct[8] || pnProduct[9])
+        return true;
+    for (int i = 7; i >= 0; i--)
+        if (pnHash[i] != pnProduct[i])
+            return pnHash[i] < pnProduct[i];
+    return true;
+}
+
+// The same checks as CheckStakeKernelHash for each time, with the hashes
+// done by CKernelHasher and the target compared in integers
+int FindStakeKernelTime(unsigned int nBits, const CStakeKernelInput& input, unsigned int nTimeTx, unsigned int nCount, uint256& hashProofOfStake)
+{
+    if (nCount == 0 || nTimeTx < nCount)
+        return -1;
+    if (!IsProtocolV03(nTimeTx - nCount + 1))
+    {
+        for (unsigned int n = 0; n < nCount; n++)
+            if (CheckStakeKernelHash(nBits, input, nTimeTx - n, hashProofOfStake))
+                return n;
+        return -1;
+    }
+
+    // times before the output's tx or its min age are never valid
+    unsigned int nTimeMin = max(input.nTimeTxPrev, input.nTimeBlockFrom + nStakeMinAge);
+    if (nTimeTx < nTimeMin)
+        return -1;
+    nCount = min(nCount, nTimeTx - nTimeMin + 1);
+
+    unsigned char pchFixed[24];
+    memcpy(&pchFixed[0], &input.nStakeModifier, 8);
+    memcpy(&pchFixed[8], &input.nTimeBlockFrom, 4);
+    memcpy(&pchFixed[12], &input.nTxPrevOffset, 4);
+    memcpy(&pchFixed[16], &input.nTimeTxPrev, 4);
+    memcpy(&pchFixed[20], &input.nPrevout, 4);
+    CKernelHasher hasher(pchFixed);
+
+    CBigNum bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    if (bnTargetPerCoinDay < 0)
+        return -1;
+    uint256 hashTargetPerCoinDay = bnTargetPerCoinDay.getuint256();
+
+    vector<unsigned int> vTime(nCount);
+    vector<uint256> vHash(nCount);
+    for (unsigned int n = 0; n < nCount; n++)
+        vTime[n] = nTimeTx - n;
+    hasher.Hash(&vTime[0], nCount, &vHash[0]);
+
+    for (unsigned int n = 0; n < nCount; n++)
+    {
+        int64 nTimeWeight = min((int64)vTime[n] - input.nTimeTxPrev, (int64)STAKE_MAX_AGE) - nStakeMinAge;
+        if (nTimeWeight < 0 || input.nValueIn < 0)
+            continue;
+        if (HashMeetsWeightedTarget(vHash[n], GetCoinDayWeight(input.nValueIn, nTimeWeight), hashTargetPerCoinDay))
+        {
+            hashProofOfStake = vHash[n];
+            return n;
+        }
+    }
+    return -1;
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake)
 {
@@ -27,6 +27,12 @@ bool IsProtocolV03(unsigned int nTimeCoinStake);
 // Whether a given block is subject to new v0.4 protocol
 bool IsProtocolV04(unsigned int nTimeBlock);
 
+// Get stake modifier selection interval (in seconds)
+int64 GetStakeModifierSelectionInterval();
+
+// Bring the stake modifier table in line with a new best chain
+void UpdateStakeModifierTable(const CBlockIndex* pindexNew);
+
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64& nStakeModifier, bool& fGeneratedStakeModifier);
 
@@ -34,6 +40,36 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexCurrent, uint64& nStakeMo
 // Sets hashProofOfStake on success return
 bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake=false);
 
+// The inputs of an output's stake kernel hash other than the coinstake time,
+// so a staking wallet can search timestamps without reading the block chain
+struct CStakeKernelInput
+{
+    const CBlockIndex* pindexFrom;      // block of the staked output
+    const CBlockIndex* pindexModifier;  // valid while this is in the main chain
+    uint64 nStakeModifier;
+    unsigned int nTimeBlockFrom;
+    unsigned int nTxPrevOffset;
+    unsigned int nTimeTxPrev;
+    unsigned int nPrevout;
+    int64 nValueIn;
+
+    bool IsValid() const
+    {
+        return pindexFrom->IsInMainChain() && pindexModifier->IsInMainChain();
+    }
+};
+
+// Fill in the kernel input of output nPrevout of txPrev, in block pindexFrom
+// at nTxPrevOffset; false if its stake modifier isn't in the chain yet
+bool GetStakeKernelInput(const CBlockIndex* pindexFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, unsigned int nPrevout, CStakeKernelInput& input);
+
+// CheckStakeKernelHash for a v0.3 coinstake, from a kernel input
+bool CheckStakeKernelHash(unsigned int nBits, const CStakeKernelInput& input, unsigned int nTimeTx, uint256& hashProofOfStake);
+
+// Search coinstake times nTimeTx, nTimeTx - 1, ... for nCount seconds for a
+// kernel meeting the hash target; returns how many seconds back it is, or -1
+int FindStakeKernelTime(unsigned int nBits, const CStakeKernelInput& input, unsigned int nTimeTx, unsigned int nCount, uint256& hashProofOfStake);
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake);
@@ -0,0 +1,161 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "kernelhash.h"
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+static const uint32_t pnSha256Init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t pnSha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// These work on scalars and GCC vectors alike
+#define ROTR(x, n)      (((x) >> (n)) | ((x) << (32 - (n))))
+#define Ch(x, y, z)     ((z) ^ ((x) & ((y) ^ (z))))
+#define Maj(x, y, z)    (((x) & (y)) | ((z) & ((x) | (y))))
+#define Sigma0(x)       (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define Sigma1(x)       (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define sigma0(x)       (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define sigma1(x)       (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+#define KERNELHASH_EXPAND(w) \
+    for (i = 16; i < 64; i++) \
+        w[i] = sigma1(w[i - 2]) + w[i - 7] + sigma0(w[i - 15]) + w[i - 16]
+
+#define KERNELHASH_ROUNDS(v, w, nFirst) \
+    for (i = (nFirst); i < 64; i++) \
+    { \
+        t1 = v[7] + Sigma1(v[4]) + Ch(v[4], v[5], v[6]) + pnSha256K[i] + w[i]; \
+        t2 = Sigma0(v[0]) + Maj(v[0], v[1], v[2]); \
+        v[7] = v[6]; v[6] = v[5]; v[5] = v[4]; v[4] = v[3] + t1; \
+        v[3] = v[2]; v[2] = v[1]; v[1] = v[0]; v[0] = t1 + t2; \
+    }
+
+static inline uint32_t ReadBE32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void WriteBE32(unsigned char* p, uint32_t n)
+{
+    p[0] = n >> 24;
+    p[1] = n >> 16;
+    p[2] = n >> 8;
+    p[3] = n;
+}
+
+#define KERNELHASH_LANES 1
+#define KERNELHASH_LANES_FN KernelHashLanes1
+#include "kernelhash_lanes.h"
+#undef KERNELHASH_LANES
+#undef KERNELHASH_LANES_FN
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELHASH_VECTOR
+
+#define KERNELHASH_LANES 4
+#define KERNELHASH_LANES_TARGET "sse2"
+#define KERNELHASH_LANES_FN KernelHashLanesSSE2
+#include "kernelhash_lanes.h"
+#undef KERNELHASH_LANES
+#undef KERNELHASH_LANES_TARGET
+#undef KERNELHASH_LANES_FN
+
+#define KERNELHASH_LANES 8
+#define KERNELHASH_LANES_TARGET "avx2"
+#define KERNELHASH_LANES_FN KernelHashLanesAVX2
+#include "kernelhash_lanes.h"
+#undef KERNELHASH_LANES
+#undef KERNELHASH_LANES_TARGET
+#undef KERNELHASH_LANES_FN
+#endif
+
+static int DetectKernelHashLanes()
+{
+#ifdef KERNELHASH_VECTOR
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return 8;
+    if (__builtin_cpu_supports("sse2"))
+        return 4;
+#endif
+    return 1;
+}
+
+int GetKernelHashLanes()
+{
+    static const int nLanes = DetectKernelHashLanes();
+    return nLanes;
+}
+
+CKernelHasher::CKernelHasher(const unsigned char pchFixed[24])
+{
+    uint32_t w[6], v[8], t1, t2;
+    int i;
+
+    for (i = 0; i < 6; i++)
+        w[i] = pnWords[i] = ReadBE32(&pchFixed[4 * i]);
+    for (i = 0; i < 8; i++)
+        v[i] = pnSha256Init[i];
+    for (i = 0; i < 6; i++)
+    {
+        t1 = v[7] + Sigma1(v[4]) + Ch(v[4], v[5], v[6]) + pnSha256K[i] + w[i];
+        t2 = Sigma0(v[0]) + Maj(v[0], v[1], v[2]);
+        v[7] = v[6]; v[6] = v[5]; v[5] = v[4]; v[4] = v[3] + t1;
+        v[3] = v[2]; v[2] = v[1]; v[1] = v[0]; v[0] = t1 + t2;
+    }
+    for (i = 0; i < 8; i++)
+        pnMidstate[i] = v[i];
+}
+
+void CKernelHasher::Hash(const unsigned int* pnTime, unsigned int nCount, uint256* phashRet) const
+{
+    const int nLanes = GetKernelHashLanes();
+    uint32_t pnWords32[6], pnMidstate32[8], pnTimeBE[8], pnOut[8 * 8];
+
+    std::copy(pnWords, pnWords + 6, pnWords32);
+    std::copy(pnMidstate, pnMidstate + 8, pnMidstate32);
+    for (unsigned int nDone = 0; nDone < nCount; nDone += nLanes)
+    {
+        // the time goes in as its serialized, little-endian bytes
+        unsigned int nNow = std::min((unsigned int)nLanes, nCount - nDone);
+        memset(pnTimeBE, 0, sizeof(pnTimeBE));
+        for (unsigned int j = 0; j < nNow; j++)
+        {
+            unsigned char pchTime[4];
+            memcpy(pchTime, &pnTime[nDone + j], 4);
+            pnTimeBE[j] = ReadBE32(pchTime);
+        }
+
+#ifdef KERNELHASH_VECTOR
+        if (nLanes == 8)
+            KernelHashLanesAVX2(pnWords32, pnMidstate32, pnTimeBE, pnOut);
+        else if (nLanes == 4)
+            KernelHashLanesSSE2(pnWords32, pnMidstate32, pnTimeBE, pnOut);
+        else
+#endif
+            KernelHashLanes1(pnWords32, pnMidstate32, pnTimeBE, pnOut);
+
+        for (unsigned int j = 0; j < nNow; j++)
+        {
+            unsigned char* pch = (unsigned char*)&phashRet[nDone + j];
+            for (int i = 0; i < 8; i++)
+                WriteBE32(&pch[4 * i], pnOut[j * 8 + i]);
+        }
+    }
+}
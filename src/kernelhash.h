@@ -0,0 +1,33 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SHINYCOIN_KERNELHASH_H
+#define SHINYCOIN_KERNELHASH_H
+
+#include "uint256.h"
+
+/** Double SHA-256 of v0.3 stake kernels differing only in the coinstake time.
+ *
+ * The kernel is 28 bytes: stake modifier, block time, tx offset, tx time,
+ * output index and the 4 byte coinstake time, so it fits one SHA-256 block.
+ * Its first 6 rounds see only the fixed 24 bytes and are run once, here;
+ * Hash() runs the rest for one coinstake time per SIMD lane.
+ */
+class CKernelHasher
+{
+private:
+    unsigned int pnWords[6];        // the fixed bytes as big-endian message words
+    unsigned int pnMidstate[8];     // working variables after rounds 0-5
+
+public:
+    CKernelHasher(const unsigned char pchFixed[24]);
+
+    // phashRet[i] is the kernel hash for coinstake time pnTime[i], i < nCount
+    void Hash(const unsigned int* pnTime, unsigned int nCount, uint256* phashRet) const;
+};
+
+// Coinstake times CKernelHasher hashes at once on this CPU
+int GetKernelHashLanes();
+
+#endif
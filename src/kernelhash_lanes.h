@@ -0,0 +1,62 @@
+/*
+ * Lane-parallel body of CKernelHasher::Hash, included by kernelhash.cpp
+ * once per instruction set with KERNELHASH_LANES and KERNELHASH_LANES_FN
+ * defined, and KERNELHASH_LANES_TARGET when it needs one.
+ *
+ * KERNELHASH_LANES kernels are hashed at once, one coinstake time per lane:
+ * the second half of the first block from the midstate, then the second
+ * SHA-256 over the 32 byte result. pnOut gets the 8 digest words of each
+ * lane in turn.
+ */
+
+#ifdef KERNELHASH_LANES_TARGET
+__attribute__((target(KERNELHASH_LANES_TARGET)))
+#endif
+static void KERNELHASH_LANES_FN(const uint32_t* pnWords, const uint32_t* pnMidstate,
+                                const uint32_t* pnTimeBE, uint32_t* pnOut)
+{
+#if KERNELHASH_LANES == 1
+    typedef uint32_t lanes_t;
+#else
+    typedef uint32_t lanes_t __attribute__((vector_size(4 * KERNELHASH_LANES)));
+#endif
+
+    lanes_t w[64], v[8], t1, t2, zero;
+    uint32_t pnLane[KERNELHASH_LANES];
+    int i, lane;
+
+    memset(&zero, 0, sizeof(zero));
+
+    // first block: the kernel and its padding, from round 6
+    for (i = 0; i < 6; i++)
+        w[i] = zero + pnWords[i];
+    memcpy(&w[6], pnTimeBE, sizeof(lanes_t));
+    w[7] = zero + 0x80000000;
+    for (i = 8; i < 15; i++)
+        w[i] = zero;
+    w[15] = zero + 28 * 8;
+    KERNELHASH_EXPAND(w);
+    for (i = 0; i < 8; i++)
+        v[i] = zero + pnMidstate[i];
+    KERNELHASH_ROUNDS(v, w, 6);
+
+    // second block: the first digest and its padding
+    for (i = 0; i < 8; i++)
+        w[i] = v[i] + pnSha256Init[i];
+    w[8] = zero + 0x80000000;
+    for (i = 9; i < 15; i++)
+        w[i] = zero;
+    w[15] = zero + 32 * 8;
+    KERNELHASH_EXPAND(w);
+    for (i = 0; i < 8; i++)
+        v[i] = zero + pnSha256Init[i];
+    KERNELHASH_ROUNDS(v, w, 0);
+
+    for (i = 0; i < 8; i++)
+    {
+        v[i] += pnSha256Init[i];
+        memcpy(pnLane, &v[i], sizeof(pnLane));
+        for (lane = 0; lane < KERNELHASH_LANES; lane++)
+            pnOut[lane * 8 + i] = pnLane[lane];
+    }
+}
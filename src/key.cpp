@@ -2,6 +2,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <list>
 #include <map>
 
 #include <openssl/ecdsa.h>
@@ -359,6 +360,132 @@ bool CKey::Verify(uint256 hash, const std::vector<unsigned char>& vchSig)
     return true;
 }
 
+// secp256k1 with a table of multiples of the generator, shared by every key
+// the cache parses, so the u1*G half of each verification is table lookups
+static EC_GROUP* NewVerifyGroup()
+{
+    EC_GROUP* group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+    if (group == NULL)
+        throw key_error("NewVerifyGroup() : EC_GROUP_new_by_curve_name failed");
+    if (!EC_GROUP_precompute_mult(group, NULL))
+        printf("NewVerifyGroup() : EC_GROUP_precompute_mult failed, verifying without it\n");
+    return group;
+}
+
+// Recently used public keys, parsed. Sharded by the last byte of the key,
+// which is part of a coordinate and so evenly spread.
+class CPubKeyCache
+{
+private:
+    enum { SHARDS = 16 };
+
+    typedef std::list<std::vector<unsigned char> > KeyList;
+    struct CShard
+    {
+        CCriticalSection cs;
+        KeyList listKeys;       // most recently used first
+        std::map<std::vector<unsigned char>, std::pair<EC_KEY*, KeyList::iterator> > mapKeys;
+        uint64 nHits;
+        uint64 nMisses;
+    };
+
+    EC_GROUP* group;
+    unsigned int nMaxPerShard;
+    CShard shards[SHARDS];
+
+public:
+    CPubKeyCache(unsigned int nMaxKeys)
+    {
+        group = NewVerifyGroup();
+        nMaxPerShard = std::max(nMaxKeys / SHARDS, 1U);
+        for (int i = 0; i < SHARDS; i++)
+            shards[i].nHits = shards[i].nMisses = 0;
+    }
+
+    // Returns a reference the caller frees, or NULL if the key doesn't parse
+    EC_KEY* Get(const std::vector<unsigned char>& vchPubKey)
+    {
+        if (vchPubKey.empty())
+            return NULL;
+        CShard& shard = shards[vchPubKey.back() % SHARDS];
+        {
+            LOCK(shard.cs);
+            std::map<std::vector<unsigned char>, std::pair<EC_KEY*, KeyList::iterator> >::iterator mi = shard.mapKeys.find(vchPubKey);
+            if (mi != shard.mapKeys.end())
+            {
+                shard.listKeys.splice(shard.listKeys.begin(), shard.listKeys, mi->second.second);
+                shard.nHits++;
+                EC_KEY_up_ref(mi->second.first);
+                return mi->second.first;
+            }
+            shard.nMisses++;
+        }
+
+        // parse outside the lock
+        EC_KEY* pkey = EC_KEY_new();
+        if (pkey == NULL)
+            return NULL;
+        const unsigned char* pbegin = &vchPubKey[0];
+        if (!EC_KEY_set_group(pkey, group) || !o2i_ECPublicKey(&pkey, &pbegin, vchPubKey.size()))
+        {
+            EC_KEY_free(pkey);
+            return NULL;
+        }
+
+        LOCK(shard.cs);
+        if (shard.mapKeys.count(vchPubKey))
+            return pkey;    // parsed by another thread meanwhile
+        shard.listKeys.push_front(vchPubKey);
+        shard.mapKeys[vchPubKey] = std::make_pair(pkey, shard.listKeys.begin());
+        EC_KEY_up_ref(pkey);
+        while (shard.mapKeys.size() > nMaxPerShard)
+        {
+            std::map<std::vector<unsigned char>, std::pair<EC_KEY*, KeyList::iterator> >::iterator mi = shard.mapKeys.find(shard.listKeys.back());
+            EC_KEY_free(mi->second.first);
+            shard.mapKeys.erase(mi);
+            shard.listKeys.pop_back();
+        }
+        return pkey;
+    }
+
+    void GetStats(uint64& nHits, uint64& nMisses)
+    {
+        nHits = nMisses = 0;
+        for (int i = 0; i < SHARDS; i++)
+        {
+            LOCK(shards[i].cs);
+            nHits += shards[i].nHits;
+            nMisses += shards[i].nMisses;
+        }
+    }
+};
+
+static CPubKeyCache& GetPubKeyCache()
+{
+    static CPubKeyCache pubKeyCache(PUBKEY_CACHE_SIZE);
+    return pubKeyCache;
+}
+
+bool CKey::VerifyPubKey(const std::vector<unsigned char>& vchPubKey, uint256 hash,
+                        const std::vector<unsigned char>& vchSig)
+{
+    if (vchSig.empty())
+        return false;
+    EC_KEY* pkey = GetPubKeyCache().Get(vchPubKey);
+    if (pkey == NULL)
+        return false;
+
+    // -1 = error, 0 = bad sig, 1 = good
+    bool fValid = ECDSA_verify(0, (unsigned char*)&hash, sizeof(hash), &vchSig[0], vchSig.size(), pkey) == 1;
+    EC_KEY_free(pkey);
+    return fValid;
+}
+
+void CKey::GetPubKeyCacheStats(uint64& nHits, uint64& nMisses)
+{
+    GetPubKeyCache().GetStats(nHits, nMisses);
+}
+
 bool CKey::VerifyCompact(uint256 hash, const std::vector<unsigned char>& vchSig)
 {
     CKey key;
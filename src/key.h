@@ -49,6 +49,9 @@ typedef std::vector<unsigned char, secure_allocator<unsigned char> > CPrivKey;
 // CSecret is a serialization of just the secret parameter (32 bytes)
 typedef std::vector<unsigned char, secure_allocator<unsigned char> > CSecret;
 
+// Parsed public keys CKey::VerifyPubKey() keeps for reuse
+static const unsigned int PUBKEY_CACHE_SIZE = 8192;
+
 /** An encapsulated OpenSSL Elliptic Curve key (public and/or private) */
 class CKey
 {
@@ -97,6 +100,12 @@ public:
 
     bool Verify(uint256 hash, const std::vector<unsigned char>& vchSig);
 
+    // Verify a signature against a serialized public key. Recently used keys
+    // stay parsed, on a curve with a precomputed table of generator multiples.
+    static bool VerifyPubKey(const std::vector<unsigned char>& vchPubKey, uint256 hash,
+                             const std::vector<unsigned char>& vchSig);
+    static void GetPubKeyCacheStats(uint64& nHits, uint64& nMisses);
+
     // Verify a compact signature
     bool VerifyCompact(uint256 hash, const std::vector<unsigned char>& vchSig);
 
@@ -14,7 +14,11 @@
 #include "txinfo.h"
 #include "alert.h"
 #include "signedhash.h"
+#include "hashblock/ramhog.h"
+#include "ramhogipc.h"
 #include "hashblock/ramhog_mt.h"
+#include "checkqueue.h"
+#include "unspent.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -35,7 +39,7 @@ CTxMemPool mempool;
 unsigned int nTransactionsUpdated = 0;
 
 CTxInfoStore *ptxinfoStore = NULL;
-CRamhogThreadPool *pramhogPool = NULL;
+CRamhogHasher *pramhogPool = NULL;
 
 map<uint256, CBlockIndex*> mapBlockIndex;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
@@ -94,6 +98,7 @@ int64 nHPSTimerStart;
 
 // Settings
 int64 nTransactionFee = MIN_TX_FEE;
+int nScriptCheckThreads = 0;
 
 
 
@@ -675,10 +680,10 @@ bool CTxMemPool::checkAccept(CTxDB& txdb, CTransaction &tx, bool fCheckInputs, b
         }
 
         {
-            CTxInfoView txInfoView(ptxinfoStore);
-            if (!tx.ProcessTxInfos(txdb))
+            // checked against the store without writing to it
+            CTxInfoOverlay txInfoOverlay(ptxinfoStore);
+            if (!tx.ProcessTxInfos(mapInputs, txInfoOverlay))
                 return error("CTxMemPool::accept() : ProcessTxInfos failed");
-            txInfoView.Rollback();
         }
     }
 
@@ -880,7 +885,13 @@ bool CBlock::GetPoWHash(uint256& powHash) const
 {
     uint256 idHash = GetIDHash();
     
-    if (SignedHash::GetPoWHash(idHash, powHash))
+    // the hash cache is indexed by height, which a new block only has through its parent
+    int nHeight = -1;
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
+    if (mi != mapBlockIndex.end())
+        nHeight = (*mi).second->nHeight + 1;
+    
+    if (SignedHash::GetPoWHash(idHash, powHash, nHeight))
         return true;
     
     const char *pbegin = BEGIN(nVersion), *pend = END(nNonce);
@@ -890,7 +901,7 @@ bool CBlock::GetPoWHash(uint256& powHash) const
                              false))
         return false;
     
-    SignedHash::UncheckedAddHash(idHash, powHash);
+    SignedHash::UncheckedAddHash(idHash, powHash, nHeight);
     
     return true;
 }
@@ -1237,6 +1248,35 @@ bool CTransaction::DisconnectInputs(CTxDB& txdb)
 }
 
 
+// Fill in the outputs of prev that tx spends from the unspent output set, if
+// it has all of them for the transaction at prev's tx index position
+static bool FetchUnspentOutputs(const CTransaction& tx, const uint256& hashPrev, CPrevTx& prev)
+{
+    if (!punspentCache)
+        return false;
+
+    const CTxIndex& txindex = prev.first;
+    CTransaction& txPrev = prev.second;
+    txPrev.vout.resize(txindex.vSpent.size());
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (txin.prevout.hash != hashPrev)
+            continue;
+        CUnspentOutput unspent;
+        if (txin.prevout.n >= txPrev.vout.size() || !punspentCache->Get(txin.prevout, unspent) || unspent.pos != txindex.pos)
+        {
+            txPrev.SetNull();
+            return false;
+        }
+        txPrev.vout[txin.prevout.n] = unspent.txout;
+        txPrev.nTime = unspent.nTime;
+        prev.fCoinBaseOrStake = (unspent.nFlags & (UNSPENT_COINBASE | UNSPENT_COINSTAKE)) != 0;
+        prev.nHeight = unspent.nHeight;
+    }
+    prev.fUnspent = true;
+    return true;
+}
+
 bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTestPool,
                                bool fBlock, bool fMiner, MapPrevTx& inputsRet, bool& fInvalid)
 {
@@ -1285,7 +1325,7 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
             if (!fFound)
                 txindex.vSpent.resize(txPrev.vout.size());
         }
-        else
+        else if (!FetchUnspentOutputs(*this, prevout.hash, inputsRet[prevout.hash]))
         {
             // Get prev tx from disk
             if (!txPrev.ReadFromDisk(txindex.pos))
@@ -1384,9 +1424,18 @@ unsigned int CTransaction::GetP2SHSigOpCount(const MapPrevTx& inputs) const
     return nSigOps;
 }
 
+bool CScriptCheck::operator()() const
+{
+    const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    if (!VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, nHashType))
+        return error("CScriptCheck() : %s VerifySignature failed on input %u", ptxTo->GetHash().ToString().substr(0,10).c_str(), nIn);
+    return true;
+}
+
 bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                                  map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner)
+                                 const CBlockIndex* pindexBlock, bool fBlock, bool fMiner,
+                                 std::vector<CScriptCheck> *pvChecks)
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -1400,6 +1449,7 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
         {
             COutPoint prevout = vin[i].prevout;
             assert(inputs.count(prevout.hash) > 0);
+            const CPrevTx& prev = inputs[prevout.hash];
             CTxIndex& txindex = inputs[prevout.hash].first;
             CTransaction& txPrev = inputs[prevout.hash].second;
 
@@ -1407,10 +1457,19 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                 return DoS(100, error("ConnectInputs() : %s prevout.n out of range %d %d %d prev tx %s\n%s", GetHash().ToString().substr(0,10).c_str(), prevout.n, txPrev.vout.size(), txindex.vSpent.size(), prevout.hash.ToString().substr(0,10).c_str(), txPrev.ToString().c_str()));
 
             // If prev is coinbase/coinstake, check that it's matured
-            if (txPrev.IsCoinBase() || txPrev.IsCoinStake())
-                for (const CBlockIndex* pindex = pindexBlock; pindex && pindexBlock->nHeight - pindex->nHeight < nCoinbaseMaturity; pindex = pindex->pprev)
-                    if (pindex->nBlockPos == txindex.pos.nBlockPos && pindex->nFile == txindex.pos.nFile)
-                        return error("ConnectInputs() : tried to spend coinbase/coinstake at depth %d", pindexBlock->nHeight - pindex->nHeight);
+            if (prev.IsCoinBaseOrStake())
+            {
+                // from the unspent output set its height is known
+                if (prev.fUnspent)
+                {
+                    if (pindexBlock && pindexBlock->nHeight - prev.nHeight < nCoinbaseMaturity)
+                        return error("ConnectInputs() : tried to spend coinbase/coinstake at depth %d", pindexBlock->nHeight - prev.nHeight);
+                }
+                else
+                    for (const CBlockIndex* pindex = pindexBlock; pindex && pindexBlock->nHeight - pindex->nHeight < nCoinbaseMaturity; pindex = pindex->pprev)
+                        if (pindex->nBlockPos == txindex.pos.nBlockPos && pindex->nFile == txindex.pos.nFile)
+                            return error("ConnectInputs() : tried to spend coinbase/coinstake at depth %d", pindexBlock->nHeight - pindex->nHeight);
+            }
 
             // ppcoin: check transaction timestamp
             if (txPrev.nTime > nTime)
@@ -1444,7 +1503,13 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
             if (!(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
             {
                 // Verify signature
-                if (!VerifySignature(txPrev, *this, i, 0))
+                CScriptCheck check(txPrev, *this, i, 0);
+                if (pvChecks)
+                {
+                    pvChecks->push_back(CScriptCheck());
+                    check.swap(pvChecks->back());
+                }
+                else if (!check())
                 {
                     return DoS(100,error("ConnectInputs() : %s VerifySignature failed", GetHash().ToString().substr(0,10).c_str()));
                 }
@@ -1488,48 +1553,170 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
     return true;
 }
 
-bool CTransaction::_procUndoTxInfos(CTxDB &txdb, const bool undoing, uint256 blockHash, unsigned int nTxInBlock) {
-    if (!ptxinfoStore->InTransaction())
-        throw new std::runtime_error("Proc info without store in transaction");
-
-    for (int i=undoing ? (vin.size()-1) : 0; undoing ? (i >= 0) : (i < vin.size()); undoing ? (i--) : (i++)) {
-        const CTxIn &txin = vin[i];
-
+bool CTransaction::ProcessTxInfos(const MapPrevTx& inputs, CTxInfoOverlay& overlay, uint256 blockHash, unsigned int nTxInBlock) const
+{
+    for (unsigned int i = 0; i < vin.size(); i++)
+    {
+        const CTxIn& txin = vin[i];
         if (txin.infos.empty())
             continue;
 
-        CTransaction prevTx;
-
-        if (!txdb.ReadDiskTx(txin.prevout.hash, prevTx))
-            return false;
-
         CBitcoinAddress addr;
-        if (!ExtractAddress(prevTx.vout[txin.prevout.n].scriptPubKey, addr))
+        if (!ExtractAddress(GetOutputFor(txin, inputs).scriptPubKey, addr))
             return false;
 
-        for (int j=undoing ? (txin.infos.size()-1) : 0; undoing ? (j >= 0) : (j < txin.infos.size()); undoing ? (j--) : (j++))
+        for (unsigned int j = 0; j < txin.infos.size(); j++)
         {
-            const CTxInfo &txinfo = txin.infos[j];
+            const CTxInfo& txinfo = txin.infos[j];
             std::string reason;
-            TxInfoRecord record(addr, txinfo, blockHash, nTxInBlock, i, j);
-            if (!(undoing ? ptxinfoStore->Undo(record, reason)
-                          : ptxinfoStore->Process(record, reason)))
-                return error(("%sTxInfos(): Could not process <%s: %s>: " + reason).c_str(),
-                             undoing ? "Undo" : "Process",
-                             txinfo.key.ToString().c_str(), txinfo.value.c_str());
+            if (!overlay.Process(TxInfoRecord(addr, txinfo, blockHash, nTxInBlock, i, j), reason))
+                return error("ProcessTxInfos() : Could not process <%s: %s>: %s",
+                             txinfo.key.ToString().c_str(), txinfo.value.c_str(), reason.c_str());
         }
     }
 
     return true;
 }
 
-bool CTransaction::UndoTxInfos(CTxDB &txdb, uint256 blockHash, unsigned int nTxInBlock)
+//
+// -rebuildtxinfo: refill the infostore from the block files
+//
+
+struct CTxInfoRebuildBatch
 {
-    return _procUndoTxInfos(txdb, true, blockHash, nTxInBlock);
+    vector<CBlockIndex*> vBlocks;
+    vector<vector<TxInfoRecord> > vRecords;   // per block, in ProcessTxInfos order
+    unsigned int nNext;
+    bool fFailed;
+    CCriticalSection cs;
+};
+
+// Takes blocks from the batch until none are left, decoding their tx infos.
+// An input's address comes from the block itself when it spends a
+// transaction in the same block, else from the tx index.
+static void ThreadDecodeTxInfos(CTxInfoRebuildBatch* batch)
+{
+    CTxDB txdb("r");
+    loop
+    {
+        unsigned int n;
+        {
+            LOCK(batch->cs);
+            if (batch->fFailed || batch->nNext == batch->vBlocks.size())
+                return;
+            n = batch->nNext++;
+        }
+
+        CBlockIndex* pindex = batch->vBlocks[n];
+        vector<TxInfoRecord>& vRecords = batch->vRecords[n];
+        CBlock block;
+        bool fOk = block.ReadFromDisk(pindex);
+        map<uint256, const CTransaction*> mapBlockTx;
+        for (unsigned int nTx = 0; fOk && nTx < block.vtx.size(); nTx++)
+        {
+            const CTransaction& tx = block.vtx[nTx];
+            mapBlockTx[tx.GetHash()] = &tx;
+            if (tx.IsCoinBase())
+                continue;
+
+            for (unsigned int i = 0; fOk && i < tx.vin.size(); i++)
+            {
+                const CTxIn& txin = tx.vin[i];
+                if (txin.infos.empty())
+                    continue;
+
+                CTransaction txPrevDisk;
+                const CTransaction* ptxPrev = &txPrevDisk;
+                map<uint256, const CTransaction*>::iterator mi = mapBlockTx.find(txin.prevout.hash);
+                if (mi != mapBlockTx.end())
+                    ptxPrev = mi->second;
+                else if (!txdb.ReadDiskTx(txin.prevout.hash, txPrevDisk))
+                {
+                    fOk = error("ThreadDecodeTxInfos() : %s not found", txin.prevout.hash.ToString().substr(0,10).c_str());
+                    break;
+                }
+
+                CBitcoinAddress addr;
+                if (txin.prevout.n >= ptxPrev->vout.size() ||
+                    !ExtractAddress(ptxPrev->vout[txin.prevout.n].scriptPubKey, addr))
+                {
+                    fOk = error("ThreadDecodeTxInfos() : no address for input %d of %s", i, tx.GetHash().ToString().substr(0,10).c_str());
+                    break;
+                }
+
+                for (unsigned int j = 0; j < txin.infos.size(); j++)
+                    vRecords.push_back(TxInfoRecord(addr, txin.infos[j], pindex->GetBlockIDHash(), nTx, i, j));
+            }
+        }
+
+        if (!fOk)
+        {
+            LOCK(batch->cs);
+            batch->fFailed = true;
+        }
+    }
 }
-bool CTransaction::ProcessTxInfos(CTxDB &txdb, uint256 blockHash, unsigned int nTxInBlock)
+
+bool RebuildTxInfoStore()
 {
-    return _procUndoTxInfos(txdb, false, blockHash, nTxInBlock);
+    int nThreads = boost::thread::hardware_concurrency();
+    if (nThreads < 1)
+        nThreads = 1;
+
+    // Blocks are decoded in parallel a batch at a time and their records
+    // inserted in chain order, unchecked: ConnectBlock accepted them already.
+    ptxinfoStore->BeginBulkLoad();
+    int nBlocks = 0, nRecords = 0;
+    CBlockIndex* pindex = pindexGenesisBlock;
+    while (pindex)
+    {
+        if (fRequestShutdown)
+        {
+            ptxinfoStore->Rollback();
+            ptxinfoStore->EndBulkLoad();
+            return error("RebuildTxInfoStore() : interrupted, the infostore is incomplete");
+        }
+
+        CTxInfoRebuildBatch batch;
+        for (; pindex && batch.vBlocks.size() < 1000; pindex = pindex->pnext)
+            batch.vBlocks.push_back(pindex);
+        batch.vRecords.resize(batch.vBlocks.size());
+        batch.nNext = 0;
+        batch.fFailed = false;
+
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&ThreadDecodeTxInfos, &batch));
+        threads.join_all();
+
+        if (batch.fFailed)
+        {
+            ptxinfoStore->Rollback();
+            ptxinfoStore->EndBulkLoad();
+            return error("RebuildTxInfoStore() : failed to decode blocks at height %d, the infostore is incomplete",
+                         batch.vBlocks[0]->nHeight);
+        }
+
+        BOOST_FOREACH(const vector<TxInfoRecord>& vRecords, batch.vRecords)
+        {
+            BOOST_FOREACH(const TxInfoRecord& record, vRecords)
+                ptxinfoStore->BulkInsert(record);
+            nRecords += vRecords.size();
+        }
+        nBlocks += batch.vBlocks.size();
+
+        if (ptxinfoStore->GetCommitByteEstimate() > 64 * 1024 * 1024)
+        {
+            ptxinfoStore->Commit();
+            ptxinfoStore->BeginTransaction();
+        }
+        if (fDebug)
+            printf("RebuildTxInfoStore() : %d blocks, %d records\n", nBlocks, nRecords);
+    }
+    ptxinfoStore->EndBulkLoad();
+
+    printf("RebuildTxInfoStore() : %d records from %d blocks\n", nRecords, nBlocks);
+    return true;
 }
 
 
@@ -1589,10 +1776,15 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
     {
         if (!vtx[i].DisconnectInputs(txdb))
             return false;
-        if (!vtx[i].UndoTxInfos(txdb))
-            return false;
+        if (punspentCache)
+            punspentCache->DisconnectTx(vtx[i]);
     }
 
+    // Each of the block's infostore rows records the row it replaced
+    unsigned int nTxInfosUndone = ptxinfoStore->UndoBlock(GetIDHash());
+    if (fDebug && nTxInfosUndone)
+        printf("DisconnectBlock() : undid %u tx infos\n", nTxInfosUndone);
+
     // Update block index on disk without changing it in memory.
     // The memory index structure will be changed after the db commits.
     if (pindex->pprev)
@@ -1610,6 +1802,13 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
     return true;
 }
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck(void* parg)
+{
+    scriptcheckqueue.Thread();
+}
+
 bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 {
     // Check it again in case a previous version let a bad block in
@@ -1641,7 +1840,13 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
     //// issue here: it doesn't know the version
     unsigned int nTxPos = pindex->nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(vtx.size());
 
+    // The block's signature checks run on the script-check threads while
+    // the rest of it is connected, and are waited for before anything is written
+    CCheckQueueControl<CScriptCheck> control(nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    vector<CScriptCheck> vChecks;
+
     map<uint256, CTxIndex> mapQueuedChanges;
+    CTxInfoOverlay txInfoOverlay(ptxinfoStore);
     int64 nFees = 0;
     int64 nValueIn = 0;
     int64 nValueOut = 0;
@@ -1679,14 +1884,18 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
             if (!tx.IsCoinStake())
                 nFees += nTxValueIn - nTxValueOut;
 
-            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false))
+            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false,
+                                  nScriptCheckThreads ? &vChecks : NULL))
                 return false;
+            control.Add(vChecks);
 
-            if (!tx.ProcessTxInfos(txdb, GetIDHash(), nTx))
+            if (!tx.ProcessTxInfos(mapInputs, txInfoOverlay, GetIDHash(), nTx))
                 return error("ConnectBlock() : ProcessTxInfos failed");
         }
 
         mapQueuedChanges[tx.GetHash()] = CTxIndex(posThisTx, tx.vout.size());
+        if (punspentCache)
+            punspentCache->ConnectTx(tx, posThisTx, pindex->nHeight);
         nTx++;
     }
 
@@ -1696,6 +1905,9 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
                              FormatMoney(vtx[0].GetValueOut()).c_str(),
                              FormatMoney(nCoinbaseReward).c_str()));
 
+    if (!control.Wait())
+        return DoS(100, error("ConnectBlock() : script verification failed"));
+
     // ppcoin: track money supply and mint amount info
     pindex->nMint = nValueOut - nValueIn + nFees;
     pindex->nMoneySupply = (pindex->pprev ? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
@@ -1721,6 +1933,11 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex)
             return error("ConnectBlock() : UpdateTxIndex failed");
     }
 
+    // Write the block's tx infos, into the caller's infostore transaction
+    std::string strReason;
+    if (!txInfoOverlay.Flush(strReason))
+        return error("ConnectBlock() : writing tx infos failed: %s", strReason.c_str());
+
     // Update block index on disk without changing it in memory.
     // The memory index structure will be changed after the db commits.
     if (pindex->pprev)
@@ -1954,6 +2171,14 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     hashBestChain = hash;
     pindexBest = pindexNew;
     nBestHeight = pindexBest->nHeight;
+    UpdateStakeModifierTable(pindexNew);
+    // Write back the unspent output set every block once caught up, and
+    // whenever it fills its cache before that
+    if (punspentCache && (!fIsInitialDownload || punspentCache->IsFull()) && !punspentCache->Flush())
+        error("SetBestChain() : failed to write back the unspent output set, will retry");
+    // stop mining hashes on the old tip right away, rather than at their next pad
+    if (pramhogPool)
+        pramhogPool->CancelMining();
     bnBestChainTrust = pindexNew->bnChainTrust;
     nTimeBestReceived = GetTime();
     nTransactionsUpdated++;
@@ -2585,8 +2810,21 @@ bool LoadBlockIndex(bool fAllowNew)
     if (nProcessors < 1)
         nProcessors = 1;
     
-    pramhogPool = new CRamhogThreadPool(nShinyScratchpads, nShinyHashChunks, nShinyHashIterations,
-                                        GetArg("-ramhogthreads", 0), GetArg("-ramhogworkers", nProcessors));
+    if (GetBoolArg("-ramhogd"))
+    {
+        printf("Using shinycoin-ramhogd at %s for ramhog hashes\n", GetRamhogdSocketPath().string().c_str());
+        pramhogPool = new CRamhogClient(GetRamhogdSocketPath());
+    }
+    else
+    {
+        ramhog_set_max_lanes(GetArg("-ramhoglanes", 4));
+        pramhogPool = new CRamhogThreadPool(nShinyScratchpads, nShinyHashChunks, nShinyHashIterations,
+                                            GetArg("-ramhogthreads", 0), GetArg("-ramhogworkers", nProcessors),
+                                            GetArg("-ramhoghugepages", "auto"), GetBoolArg("-ramhognuma", true),
+                                            GetBoolArg("-ramhogpipeline", true),
+                                            GetBoolArg("-ramhogbatchwalks", true),
+                                            GetArg("-ramhogmaxmem", 0) * 1024 * 1024);
+    }
     
     printf("%s Network: genesis=0x%s nBitsLimit=0x%08x nStakeMinAge=%d nCoinbaseMaturity=%d nModifierInterval=%d\n",
            fTestNet ? "ShinyCoinTest" : "ShinyCoin", hashGenesisBlock.ToString().substr(0, 20).c_str(), bnNewProofOfWorkLimit.GetCompact(),nStakeMinAge, nCoinbaseMaturity, nModifierInterval);
@@ -2811,41 +3049,25 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
                mapOrphanBlocks.count(inv.hash);
     
     case MSG_SIGNED_HASH:
-        return SignedHash::mapInvSignedHash.count(inv.hash);
+        return SignedHash::HaveInvSignedHash(inv.hash) ||
+               SignedHash::IsSignedHashPending(inv.hash);
     }
     // Don't know what it is, just say we already got one
     return true;
 }
 
-void static CatchUpSigHashes(CNode *pfrom)
-{
-    if (pfrom->nVersion >= PROTOCOL_VERSION_SIGNEDHASH_START && CSignedHash::strMasterPrivKey.empty())
-    {
-        for (CBlockIndex *pindex=pindexGenesisBlock->pnext; pindex; pindex = pindex->pnext)
-        {
-            uint256 idHash = pindex->GetBlockIDHash();
-            uint256 powHash;
-            std::vector<unsigned char> vchSig;
-            if (!SignedHash::GetSignedPoWHash(idHash, powHash, vchSig))
-            {
-                pfrom->PushMessage("getsigpowhas", idHash);
-                break;
-            }
-        }
-    }
-}
-
-
 static void ProcessSignedHashInvRequest(CNode *pfrom, const uint256 &idHash)
 {
     uint256 powHash;
     std::vector<unsigned char> vchSig;
     if (SignedHash::GetSignedPoWHash(idHash, powHash, vchSig))
     {
+        // GetSignedPoWHash only returns checked signatures, each checked once
         CSignedHash signedHash;
         signedHash.SetHashes(idHash, powHash);
-        if (signedHash.SetSignature(vchSig))
-            pfrom->PushInventory(CInv(MSG_SIGNED_HASH, signedHash.GetHash()));
+        signedHash.vchSig = vchSig;
+        SignedHash::AddInvSignedHash(signedHash);
+        pfrom->PushInventory(CInv(MSG_SIGNED_HASH, signedHash.GetHash()));
     }
     else if (!CSignedHash::strMasterPrivKey.empty())
         SignedHash::SendSignedHash(idHash);
@@ -2977,7 +3199,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                 Checkpoints::checkpointMessage.RelayTo(pfrom);
         }
         
-        CatchUpSigHashes(pfrom);
+        SignedHash::CatchUp(pfrom);
         
         pfrom->fSuccessfullyConnected = true;
 
@@ -3163,9 +3385,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             }
             else if (inv.type == MSG_SIGNED_HASH)
             {
-                std::map<uint256, CSignedHash>::iterator it = SignedHash::mapInvSignedHash.find(inv.hash);
-                if (it != SignedHash::mapInvSignedHash.end())
-                    pfrom->PushMessage("sigpowhash", (*it).second);
+                CSignedHash signedHash;
+                if (SignedHash::GetInvSignedHash(inv.hash, signedHash))
+                    pfrom->PushMessage("sigpowhash", signedHash);
             }
             else if (inv.IsKnownType())
             {
@@ -3346,7 +3568,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         CInv inv(MSG_BLOCK, block.GetIDHash());
         pfrom->AddInventoryKnown(inv);
         
-        if (GetArg("-ramhogthreads", 0) == 0 && !SignedHash::GetPoWHash(idHash, powHash))
+        if (GetArg("-ramhogthreads", 0) == 0 && !GetBoolArg("-ramhogd") && !SignedHash::GetPoWHash(idHash, powHash))
         {
             printf("received block %s but no hash\n", block.GetIDHash().ToString().substr(0,20).c_str());
             mapAlreadyAskedFor.erase(inv);
@@ -3493,7 +3715,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         else
             printf("getsignedhashes invalid block hash\n");
         
-        int nLimit = 20;
+        int nLimit = SignedHash::SIGNED_HASH_BATCH;
         
         for (; pindex && nLimit > 0; pindex = pindex->pnext, nLimit--)
             ProcessSignedHashInvRequest(pfrom, pindex->GetBlockIDHash());
@@ -3507,19 +3729,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         CInv inv(MSG_SIGNED_HASH, signedHash.GetHash());
         pfrom->AddInventoryKnown(inv);
         
-        if (!signedHash.ProcessRelaySignedHash(pfrom))
-            error("invalid signed hash for %s\n", signedHash.idHash.ToString().substr(0,20).c_str());
-        else
-        {
-            printf("received signed hash for %s\n", signedHash.idHash.ToString().substr(0,20).c_str());
-            
-            if (mapBlockIndex.find(signedHash.idHash) == mapBlockIndex.end())
-            {
-                CInv inv(MSG_BLOCK, signedHash.idHash);
-                mapAlreadyAskedFor.erase(inv);
-                pfrom->AskFor(inv);
-            }
-        }
+        // checked on the verifier threads; CommitVerifiedHashes stores and
+        // relays it and asks pfrom for the block if we don't have it
+        printf("received signed hash for %s\n", signedHash.idHash.ToString().substr(0,20).c_str());
+        SignedHash::QueueSignedHash(signedHash, pfrom);
     }
 
     else
@@ -3670,6 +3883,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
 {
     TRY_LOCK(cs_main, lockMain);
     if (lockMain) {
+        SignedHash::CommitVerifiedHashes();
+        
         // Don't send anything until we get their version message
         if (pto->nVersion == 0)
             return true;
@@ -3932,7 +4147,8 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfS
         tryAgain = false;
 
         CTxDB txdb("r");
-        CTxInfoView txInfoView(ptxinfoStore);
+        // infos of the transactions picked so far, never written to the store
+        CTxInfoOverlay txInfoOverlay(ptxinfoStore);
 
         // Priority order to process transactions
         list<COrphan> vOrphan; // list memory doesn't move
@@ -4039,7 +4255,7 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfS
             if (!tx.ConnectInputs(txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1,1,1), pindexPrev, false, true))
                 continue;
 
-            if (!tx.ProcessTxInfos(txdb))
+            if (!tx.ProcessTxInfos(mapInputs, txInfoOverlay))
             {
                 mempool.remove(tx);
                 tryAgain = true;
@@ -4077,8 +4293,6 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, CWallet* pwallet, bool fProofOfS
         if (fDebug && GetBoolArg("-printpriority"))
             printf("CreateNewBlock(): total size %lu\n", nBlockSize);
 
-        txInfoView.Rollback();
-
         } while (tryAgain);
     }
 
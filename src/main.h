@@ -65,6 +65,9 @@ static const int fHaveUPnP = false;
 
 static const int64 nMaxClockDrift = 2 * 60 * 60;        // two hours
 
+/** Maximum number of script-checking threads allowed */
+static const int MAX_SCRIPTCHECK_THREADS = 32;
+
 extern CScript COINBASE_FLAGS;
 
 
@@ -100,10 +103,11 @@ extern CCriticalSection cs_setpwalletRegistered;
 extern std::set<CWallet*> setpwalletRegistered;
 extern std::map<uint256, CBlock*> mapOrphanBlocks;
 extern CTxInfoStore *ptxinfoStore;
-extern CRamhogThreadPool *pramhogPool;
+extern CRamhogHasher *pramhogPool;
 
 // Settings
 extern int64 nTransactionFee;
+extern int nScriptCheckThreads;
 
 
 
@@ -112,6 +116,7 @@ extern int64 nTransactionFee;
 class CReserveKey;
 class CTxDB;
 class CTxIndex;
+class CScriptCheck;
 
 void RegisterWallet(CWallet* pwalletIn);
 void UnregisterWallet(CWallet* pwalletIn);
@@ -120,6 +125,7 @@ bool CheckDiskSpace(uint64 nAdditionalBytes=0);
 FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode="rb");
 FILE* AppendBlockFile(unsigned int& nFileRet);
 bool LoadBlockIndex(bool fAllowNew=true);
+bool RebuildTxInfoStore();
 void PrintBlockTree();
 bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
@@ -136,6 +142,7 @@ bool IsInitialBlockDownload();
 uint256 WantedByOrphan(const CBlock* pblockOrphan);
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 void BitcoinMiner(CWallet *pwallet, bool fProofOfStake);
+void ThreadScriptCheck(void* parg);
 
 
 
@@ -399,7 +406,7 @@ public:
         subCurrency.clear();
     }
 
-    bool IsNull()
+    bool IsNull() const
     {
         return (nValue == -1);
     }
@@ -468,7 +475,8 @@ enum CTransactionType
     TT_REMINT_SUBCURRENCY = 102,
 };
 
-typedef std::map<uint256, std::pair<CTxIndex, CTransaction> > MapPrevTx;
+class CPrevTx;
+typedef std::map<uint256, CPrevTx> MapPrevTx;
 
 /** The basic transaction that is broadcasted on the network and contained in
  * blocks.  A transaction can contain multiple inputs and outputs.
@@ -766,23 +774,22 @@ public:
         @param[in] pindexBlock
         @param[in] fBlock	true if called from ConnectBlock
         @param[in] fMiner	true if called from CreateNewBlock
+        @param[out] pvChecks	if not NULL, signature checks are appended here instead of being run
         @return Returns true if all checks succeed
      */
     bool ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                        std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner);
+                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner,
+                       std::vector<CScriptCheck> *pvChecks = NULL);
     bool ClientConnectInputs();
     bool CheckTransaction() const;
     bool AcceptToMemoryPool(CTxDB& txdb, bool fCheckInputs=true, bool* pfMissingInputs=NULL);
     bool GetCoinAge(CTxDB& txdb, uint64& nCoinAgeSeconds) const;  // ppcoin: get transaction coin age
     
-    bool ProcessTxInfos(CTxDB& txdb, uint256 blockHash=0, unsigned int nTxInBlock=-1);
-    bool UndoTxInfos(CTxDB& txdb, uint256 blockHash=0, unsigned int nTxInBlock=-1);
+    // Checks the infos and records them in the overlay, taking the address
+    // each is set on from the spent outputs in inputs (from FetchInputs)
+    bool ProcessTxInfos(const MapPrevTx& inputs, CTxInfoOverlay& overlay, uint256 blockHash=0, unsigned int nTxInBlock=-1) const;
 
-private:
-    bool _procUndoTxInfos(CTxDB& txdb, const bool undoing,
-                          uint256 blockHash, unsigned int nTxInBlock);
-    
 protected:
     const CTxOut& GetOutputFor(const CTxIn& input, const MapPrevTx& inputs) const;
 
@@ -844,6 +851,37 @@ public:
 
 
 
+/** One input's signature check, to be run later by a script-check thread.
+ * Keeps a pointer to the spending transaction, which must outlive it.
+ */
+class CScriptCheck
+{
+private:
+    CScript scriptPubKey;
+    const CTransaction *ptxTo;
+    unsigned int nIn;
+    int nHashType;
+
+public:
+    CScriptCheck() : ptxTo(NULL), nIn(0), nHashType(0) {}
+    CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn, int nHashTypeIn) :
+        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+        ptxTo(&txToIn), nIn(nInIn), nHashType(nHashTypeIn) {}
+
+    bool operator()() const;
+
+    void swap(CScriptCheck &check)
+    {
+        scriptPubKey.swap(check.scriptPubKey);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nIn, check.nIn);
+        std::swap(nHashType, check.nHashType);
+    }
+};
+
+
+
+
 /**  A txdb record that contains the disk location of a transaction and the
  * locations of transactions that spend its outputs.  vSpent is really only
  * used as a flag, but having the location is very helpful for debugging.
@@ -900,6 +938,30 @@ public:
 
 
 
+/** A previous transaction of one being connected: its tx index entry and the
+ * transaction. When it came from the unspent output set only the outputs
+ * spent are filled in, and the rest of what is checked about it is here.
+ */
+class CPrevTx : public std::pair<CTxIndex, CTransaction>
+{
+public:
+    bool fUnspent;
+    bool fCoinBaseOrStake;
+    int nHeight;
+
+    CPrevTx() : fUnspent(false), fCoinBaseOrStake(false), nHeight(-1) {}
+
+    CPrevTx(const std::pair<CTxIndex, CTransaction>& prev) :
+        std::pair<CTxIndex, CTransaction>(prev), fUnspent(false), fCoinBaseOrStake(false), nHeight(-1) {}
+
+    bool IsCoinBaseOrStake() const
+    {
+        return fUnspent ? fCoinBaseOrStake : (second.IsCoinBase() || second.IsCoinStake());
+    }
+};
+
+
+
 
 
 /** Nodes collect new transactions into a block, hash them into a hash tree,
@@ -222,12 +222,12 @@ WalletModel::SetInfosReturn WalletModel::setInfos(const QString &onAddress, cons
     
     {
         LOCK(cs_main);
-        CTxInfoView txInfoView(ptxinfoStore);
+        CTxInfoOverlay txInfoOverlay(ptxinfoStore);
         
         std::string reason;
         foreach(const CTxInfo &info, infos)
         {
-            if (!ptxinfoStore->Process(TxInfoRecord(address, info), reason))
+            if (!txInfoOverlay.Process(TxInfoRecord(address, info), reason))
             {
                 return SetInfosReturn(FailedProcessInfo, reason.c_str());
             }
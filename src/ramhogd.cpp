@@ -0,0 +1,117 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// shinycoin-ramhogd: owns the ramhog scratchpads and worker threads for
+// every node on the host. Nodes started with -ramhogd send it block headers
+// over a Unix domain socket (see ramhogipc.h) instead of each reserving
+// 15GB per -ramhogthreads slot themselves.
+//
+// Hashes for received blocks run before mining hashes, and preempt them
+// when every scratchpad set is busy. A request whose client hangs up (a
+// miner whose best block changed) is cancelled, queued or running. The
+// serving side is CRamhogServer in ramhogipc.cpp.
+//
+//   shinycoin-ramhogd [-testnet] [-ramhogthreads=<n>] [-ramhogworkers=<n>]
+//                     [-ramhogsocket=<path>] [other -ramhog* pool options]
+//
+
+#include "main.h"
+#include "wallet.h"
+#include "util.h"
+#include "ramhogipc.h"
+#include "hashblock/hashblock.h"
+#include "hashblock/ramhog.h"
+#include "hashblock/ramhog_mt.h"
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+
+#ifndef WIN32
+#include <signal.h>
+#endif
+
+using namespace std;
+
+// init.o is not linked in
+CWallet* pwalletMain;
+
+void Shutdown(void* parg)
+{
+    exit(0);
+}
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("--help"))
+    {
+        fprintf(stderr,
+                "Usage: shinycoin-ramhogd [options]\n"
+                "  -datadir=<dir>  \t  Specify data directory\n"
+                "  -testnet        \t  Hash with the testnet parameters\n"
+                "  -ramhogsocket=<path>\t  Listen on <path> (default: ramhogd.sock in the data directory)\n"
+                "  -ramhogthreads=<n>\t  Concurrent hashes, 15GB each on mainnet (default: 1)\n"
+                "  -ramhogworkers=<n>\t  Threads filling scratchpads (default: number of processors)\n"
+                "  -ramhoghugepages=<mode>\t  Scratchpad backing: auto, 1gb, 2mb, thp or none (default: auto)\n"
+                "  -ramhognuma     \t  Bind scratchpad sets to NUMA nodes (default: 1)\n"
+                "  -ramhoglanes=<n>\t  Pads filled at once in SIMD lanes: 1, 4 or 8 (default: 4)\n"
+                "  -ramhogpipeline \t  Overlap pad fills with walks (default: 1)\n"
+                "  -ramhogbatchwalks\t  Interleave concurrent walks on one thread (default: 1)\n"
+                "  -ramhogmaxmem=<n>\t  Scratchpad MB per concurrent hash, recomputing the rest (default: 0 = no limit)\n");
+        return 1;
+    }
+
+#ifdef WIN32
+    fprintf(stderr, "shinycoin-ramhogd: Unix domain sockets are not available on Windows\n");
+    return 1;
+#else
+    ReadConfigFile(mapArgs, mapMultiArgs);
+    fTestNet = GetBoolArg("-testnet");
+    fDebug = GetBoolArg("-debug");
+    fPrintToConsole = GetBoolArg("-printtoconsole", true);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int nProcessors = boost::thread::hardware_concurrency();
+    if (nProcessors < 1)
+        nProcessors = 1;
+    int nThreads = max((int)GetArg("-ramhogthreads", 1), 1);
+
+    ramhog_set_max_lanes(GetArg("-ramhoglanes", 4));
+    CRamhogThreadPool* pool;
+    try {
+        pool = new CRamhogThreadPool(fTestNet ? TEST_SHINY_PADS : MAIN_SHINY_PADS,
+                                     fTestNet ? TEST_SHINY_CHUNKS : MAIN_SHINY_CHUNKS,
+                                     fTestNet ? TEST_SHINY_ITERS : MAIN_SHINY_ITERS,
+                                     nThreads, GetArg("-ramhogworkers", nProcessors),
+                                     GetArg("-ramhoghugepages", "auto"), GetBoolArg("-ramhognuma", true),
+                                     GetBoolArg("-ramhogpipeline", true),
+                                     GetBoolArg("-ramhogbatchwalks", true),
+                                     GetArg("-ramhogmaxmem", 0) * 1024 * 1024);
+    }
+    catch (std::exception& e) {
+        fprintf(stderr, "shinycoin-ramhogd: %s\n", e.what());
+        return 1;
+    }
+
+    boost::filesystem::path pathSocket = GetRamhogdSocketPath();
+    CRamhogServer server(pool, nThreads);
+    if (!server.Listen(pathSocket))
+        return 1;
+
+    printf("shinycoin-ramhogd: %s, %d concurrent hashes, listening on %s\n",
+           fTestNet ? "testnet" : "mainnet", nThreads, pathSocket.string().c_str());
+
+    server.Run();
+    return 1;
+#endif
+}
@@ -0,0 +1,425 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "ramhogipc.h"
+#include "main.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+#ifndef WIN32
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+boost::filesystem::path GetRamhogdSocketPath()
+{
+    if (mapArgs.count("-ramhogsocket"))
+        return boost::filesystem::path(mapArgs["-ramhogsocket"]);
+    return GetDataDir() / "ramhogd.sock";
+}
+
+#ifndef WIN32
+static bool WriteAll(int fd, const char *pch, size_t nSize)
+{
+    while (nSize > 0)
+    {
+        ssize_t nWritten = send(fd, pch, nSize, MSG_NOSIGNAL);
+        if (nWritten <= 0)
+            return false;
+        pch += nWritten;
+        nSize -= nWritten;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, char *pch, size_t nSize)
+{
+    while (nSize > 0)
+    {
+        ssize_t nRead = recv(fd, pch, nSize, 0);
+        if (nRead <= 0)
+            return false;
+        pch += nRead;
+        nSize -= nRead;
+    }
+    return true;
+}
+#endif
+
+bool WriteRamhogMessage(int fd, const CDataStream &ss)
+{
+#ifdef WIN32
+    return false;
+#else
+    unsigned int nSize = ss.size();
+    return WriteAll(fd, (const char *)&nSize, sizeof(nSize)) &&
+           WriteAll(fd, &ss.begin()[0], nSize);
+#endif
+}
+
+bool ReadRamhogMessage(int fd, CDataStream &ss)
+{
+#ifdef WIN32
+    return false;
+#else
+    unsigned int nSize;
+    if (!ReadAll(fd, (char *)&nSize, sizeof(nSize)) || nSize > MAX_RAMHOGD_MESSAGE)
+        return false;
+    std::vector<char> vch(nSize);
+    if (nSize > 0 && !ReadAll(fd, &vch[0], nSize))
+        return false;
+    ss.clear();
+    ss.write(vch.empty() ? NULL : &vch[0], nSize);
+    return true;
+#endif
+}
+
+bool CRamhogClient::ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+                           bool fForMiner)
+{
+#ifdef WIN32
+    return error("CRamhogClient::ramhog() : shinycoin-ramhogd is not supported on Windows");
+#else
+    CBlockIndex *pindexForBest = pindexBest;
+
+    struct sockaddr_un addr;
+    std::string strPath = pathSocket.string();
+    if (strPath.size() >= sizeof(addr.sun_path))
+        return error("CRamhogClient::ramhog() : socket path %s too long", strPath.c_str());
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, strPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return error("CRamhogClient::ramhog() : socket() failed");
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return error("CRamhogClient::ramhog() : cannot connect to shinycoin-ramhogd at %s", strPath.c_str());
+    }
+
+    CRamhogRequest request;
+    request.nPriority = fForMiner ? RAMHOG_PRIORITY_MINE : RAMHOG_PRIORITY_VERIFY;
+    request.vchInput.assign(input, input + input_size);
+    request.nOutputSize = output_size;
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << request;
+    if (!WriteRamhogMessage(fd, ss))
+    {
+        close(fd);
+        return error("CRamhogClient::ramhog() : failed to send request");
+    }
+
+    // Wait for the reply. A mining hash that a new best block has made
+    // useless is dropped by hanging up, which ramhogd takes as a cancel.
+    loop
+    {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int nReady = poll(&pfd, 1, 100);
+        if (nReady > 0)
+            break;
+        if (nReady < 0 || fShutdown || (fForMiner && pindexForBest != pindexBest))
+        {
+            close(fd);
+            return fForMiner ? false : error("CRamhogClient::ramhog() : interrupted");
+        }
+    }
+
+    CRamhogReply reply;
+    bool fRead = ReadRamhogMessage(fd, ss);
+    close(fd);
+    if (!fRead)
+        return error("CRamhogClient::ramhog() : no reply from shinycoin-ramhogd");
+    try {
+        ss >> reply;
+    }
+    catch (std::exception &e) {
+        return error("CRamhogClient::ramhog() : malformed reply");
+    }
+
+    if (!reply.fSuccess || reply.vchOutput.size() != output_size)
+        return false;
+    memcpy(output, &reply.vchOutput[0], output_size);
+    return true;
+#endif
+}
+
+
+
+//
+// CRamhogServer
+//
+
+CRamhogServer::CRamhogServer(CRamhogThreadPool *poolIn, int nThreadsIn) :
+    pool(poolIn), fdListen(-1), nThreads(std::max(nThreadsIn, 1)),
+    nClients(0), nRunning(0), nCancelled(0), fStopping(false)
+{
+    for (int nPriority = 0; nPriority < RAMHOG_PRIORITY_COUNT; nPriority++)
+    {
+        psemJobs[nPriority] = new CSemaphore(0);
+        for (int i = 0; i < nThreads; i++)
+            runners.create_thread(boost::bind(&CRamhogServer::ThreadRunJobs, this, nPriority));
+    }
+}
+
+CRamhogServer::~CRamhogServer()
+{
+    Stop();
+
+    // clients cancel their jobs once stopping; the runners go after them
+    loop
+    {
+        {
+            LOCK(cs_queue);
+            if (nClients == 0)
+                break;
+        }
+        Sleep(50);
+    }
+    for (int nPriority = 0; nPriority < RAMHOG_PRIORITY_COUNT; nPriority++)
+        for (int i = 0; i < nThreads; i++)
+            psemJobs[nPriority]->post();
+    runners.join_all();
+    for (int nPriority = 0; nPriority < RAMHOG_PRIORITY_COUNT; nPriority++)
+        delete psemJobs[nPriority];
+
+#ifndef WIN32
+    if (fdListen >= 0)
+    {
+        close(fdListen);
+        unlink(pathSocket.string().c_str());
+    }
+#endif
+}
+
+static bool IsValidRequest(const CRamhogRequest &request)
+{
+    return request.nVersion == RAMHOGD_VERSION &&
+           request.nPriority >= 0 && request.nPriority < RAMHOG_PRIORITY_COUNT &&
+           !request.vchInput.empty() && request.vchInput.size() <= 256 &&
+           request.nOutputSize > 0 && request.nOutputSize <= 64;
+}
+
+// nThreads per priority: take the oldest queued job and hash it
+void CRamhogServer::ThreadRunJobs(int nPriority)
+{
+    loop
+    {
+        psemJobs[nPriority]->wait();
+
+        CJob *job;
+        {
+            LOCK(cs_queue);
+            if (fStopping)
+                return;
+            if (vQueue[nPriority].empty())
+                continue; // cancelled after it was counted
+            job = vQueue[nPriority].front();
+            vQueue[nPriority].pop_front();
+            job->fRunning = true;
+            nRunning++;
+        }
+
+        std::vector<unsigned char> vchOutput(job->request.nOutputSize);
+        bool fSuccess = pool->ramhog(&job->request.vchInput[0], job->request.vchInput.size(),
+                                     &vchOutput[0], vchOutput.size(), job->poolJob);
+
+        LOCK(cs_queue);
+        job->reply.fSuccess = fSuccess;
+        job->reply.vchOutput = vchOutput;
+        job->fDone = true;
+        nRunning--;
+    }
+}
+
+// Drop a queued job, or stop a running one; false if the caller still has
+// to wait for its runner to let go of it
+bool CRamhogServer::CancelJob(CJob *job)
+{
+    LOCK(cs_queue);
+    if (job->fDone)
+        return false;
+    if (job->fRunning)
+    {
+        pool->Cancel(job->poolJob);
+        nCancelled++;
+        return false;
+    }
+    std::deque<CJob *> &queue = vQueue[job->request.nPriority];
+    queue.erase(std::remove(queue.begin(), queue.end(), job), queue.end());
+    return true;
+}
+
+void CRamhogServer::ThreadHandleClient(int fd)
+{
+    ServeClient(fd);
+#ifndef WIN32
+    close(fd);
+#endif
+    LOCK(cs_queue);
+    nClients--;
+}
+
+void CRamhogServer::ServeClient(int fd)
+{
+#ifndef WIN32
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    CJob job;
+
+    try {
+        if (!ReadRamhogMessage(fd, ss))
+            throw std::runtime_error("short read");
+        ss >> job.request;
+    }
+    catch (std::exception &e) {
+        printf("CRamhogServer : dropping client with malformed request\n");
+        return;
+    }
+
+    if (!IsValidRequest(job.request))
+    {
+        ss.clear();
+        ss << job.reply;
+        WriteRamhogMessage(fd, ss);
+        return;
+    }
+
+    int nPriority = job.request.nPriority;
+    job.poolJob.fForMiner = (nPriority == RAMHOG_PRIORITY_MINE);
+    {
+        LOCK(cs_queue);
+        vQueue[nPriority].push_back(&job);
+    }
+    psemJobs[nPriority]->post();
+
+    // Wait for the result, watching for the client hanging up. Its job is
+    // cancelled whether it is still queued or already hashing.
+    bool fHungUp = false;
+    loop
+    {
+        bool fStop;
+        {
+            LOCK(cs_queue);
+            if (job.fDone)
+                break;
+            fStop = fStopping;
+        }
+        if (!fHungUp)
+        {
+            struct pollfd pfd = {fd, POLLIN, 0};
+            char ch;
+            if (fStop || (poll(&pfd, 1, 0) > 0 && recv(fd, &ch, 1, MSG_PEEK | MSG_DONTWAIT) <= 0))
+            {
+                fHungUp = true;
+                if (CancelJob(&job))
+                {
+                    if (fDebug)
+                        printf("CRamhogServer : request cancelled before it ran\n");
+                    break;
+                }
+            }
+        }
+        Sleep(50);
+    }
+
+    if (!fHungUp)
+    {
+        ss.clear();
+        ss << job.reply;
+        WriteRamhogMessage(fd, ss);
+    }
+#endif
+}
+
+bool CRamhogServer::Listen(const boost::filesystem::path &path)
+{
+#ifdef WIN32
+    return error("CRamhogServer::Listen() : Unix domain sockets are not available on Windows");
+#else
+    struct sockaddr_un addr;
+    std::string strPath = path.string();
+    if (strPath.size() >= sizeof(addr.sun_path))
+        return error("CRamhogServer::Listen() : socket path %s too long", strPath.c_str());
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, strPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return error("CRamhogServer::Listen() : socket() failed");
+
+    // a socket left behind by a daemon that didn't exit cleanly
+    unlink(strPath.c_str());
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0)
+    {
+        close(fd);
+        return error("CRamhogServer::Listen() : cannot listen on %s: %s", strPath.c_str(), strerror(errno));
+    }
+    // only nodes run by the same user may use it
+    chmod(strPath.c_str(), S_IRUSR | S_IWUSR);
+
+    fdListen = fd;
+    pathSocket = path;
+    return true;
+#endif
+}
+
+void CRamhogServer::Run()
+{
+#ifndef WIN32
+    loop
+    {
+        {
+            LOCK(cs_queue);
+            if (fStopping)
+                break;
+        }
+
+        // wake now and then to notice Stop()
+        struct pollfd pfd = {fdListen, POLLIN, 0};
+        int nReady = poll(&pfd, 1, 100);
+        if (nReady == 0 || (nReady < 0 && errno == EINTR))
+            continue;
+        int fd = nReady > 0 ? accept(fdListen, NULL, NULL) : -1;
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED)
+                continue;
+            error("CRamhogServer::Run() : accept failed: %s", strerror(errno));
+            break;
+        }
+
+        {
+            LOCK(cs_queue);
+            nClients++;
+        }
+        boost::thread(boost::bind(&CRamhogServer::ThreadHandleClient, this, fd)).detach();
+    }
+#endif
+}
+
+void CRamhogServer::Stop()
+{
+    LOCK(cs_queue);
+    fStopping = true;
+}
+
+void CRamhogServer::GetStats(int &nQueuedRet, int &nRunningRet, int &nCancelledRet)
+{
+    LOCK(cs_queue);
+    nQueuedRet = 0;
+    for (int nPriority = 0; nPriority < RAMHOG_PRIORITY_COUNT; nPriority++)
+        nQueuedRet += vQueue[nPriority].size();
+    nRunningRet = nRunning;
+    nCancelledRet = nCancelled;
+}
@@ -0,0 +1,151 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SHINYCOIN_RAMHOGIPC_H
+#define SHINYCOIN_RAMHOGIPC_H
+
+#include "serialize.h"
+#include "hashblock/ramhog_mt.h"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/thread.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+//
+// Local protocol between a node and shinycoin-ramhogd, over a Unix domain
+// socket. A client connects, sends one CRamhogRequest and reads back one
+// CRamhogReply; every message is a 4 byte length followed by the
+// serialized object. Closing the connection before the reply cancels the
+// request, whether it is still queued or already hashing.
+//
+
+static const int RAMHOGD_VERSION = 1;
+static const unsigned int MAX_RAMHOGD_MESSAGE = 1024;
+
+enum
+{
+    RAMHOG_PRIORITY_VERIFY = 0,     // hashes for blocks we received, run first
+    RAMHOG_PRIORITY_MINE,
+    RAMHOG_PRIORITY_COUNT,
+};
+
+class CRamhogRequest
+{
+public:
+    int nVersion;
+    int nPriority;
+    std::vector<unsigned char> vchInput;
+    unsigned int nOutputSize;
+
+    CRamhogRequest()
+    {
+        nVersion = RAMHOGD_VERSION;
+        nPriority = RAMHOG_PRIORITY_VERIFY;
+        nOutputSize = 0;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(this->nVersion);
+        nVersion = this->nVersion;
+        READWRITE(nPriority);
+        READWRITE(vchInput);
+        READWRITE(nOutputSize);
+    )
+};
+
+class CRamhogReply
+{
+public:
+    bool fSuccess;
+    std::vector<unsigned char> vchOutput;
+
+    CRamhogReply()
+    {
+        fSuccess = false;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(fSuccess);
+        READWRITE(vchOutput);
+    )
+};
+
+/** -ramhogsocket, or ramhogd.sock in the network's data directory. */
+boost::filesystem::path GetRamhogdSocketPath();
+
+bool WriteRamhogMessage(int fd, const CDataStream &ss);
+bool ReadRamhogMessage(int fd, CDataStream &ss);
+
+/** Computes hashes by handing them to a shinycoin-ramhogd on this host. */
+class CRamhogClient : public CRamhogHasher
+{
+private:
+    boost::filesystem::path pathSocket;
+
+public:
+    CRamhogClient(const boost::filesystem::path &pathSocketIn) : pathSocket(pathSocketIn) {}
+
+    bool ramhog(const uint8_t *input, size_t input_size, uint8_t *output, size_t output_size,
+                bool fForMiner);
+};
+
+/**
+ * The shinycoin-ramhogd side: hashes the requests of clients connecting to
+ * its socket on a CRamhogThreadPool.
+ *
+ * Each priority has its own runner threads, as many as the pool has pad
+ * sets, so a verify request always reaches the pool's scheduler and can
+ * preempt a mining hash there rather than wait behind it here.
+ */
+class CRamhogServer
+{
+private:
+    struct CJob
+    {
+        CRamhogRequest request;
+        CRamhogReply reply;
+        CRamhogPoolJob poolJob;
+        bool fRunning;
+        bool fDone;
+
+        CJob() : fRunning(false), fDone(false) {}
+    };
+
+    CRamhogThreadPool *pool;
+    int fdListen;
+    boost::filesystem::path pathSocket;
+
+    CCriticalSection cs_queue;
+    std::deque<CJob *> vQueue[RAMHOG_PRIORITY_COUNT];
+    CSemaphore *psemJobs[RAMHOG_PRIORITY_COUNT];
+    boost::thread_group runners;
+    int nThreads;
+    int nClients;
+    int nRunning;
+    int nCancelled;         // running hashes cancelled by their client hanging up
+    bool fStopping;
+
+    void ThreadRunJobs(int nPriority);
+    void ThreadHandleClient(int fd);
+    void ServeClient(int fd);
+    bool CancelJob(CJob *job);
+
+public:
+    CRamhogServer(CRamhogThreadPool *poolIn, int nThreadsIn);
+    ~CRamhogServer();
+
+    bool Listen(const boost::filesystem::path &path);
+    // Accept clients until Stop() or an error
+    void Run();
+    void Stop();
+
+    void GetStats(int &nQueuedRet, int &nRunningRet, int &nCancelledRet);
+};
+
+#endif
@@ -5,7 +5,6 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include <boost/foreach.hpp>
-#include <boost/tuple/tuple.hpp>
 
 using namespace std;
 using namespace boost;
@@ -1102,67 +1101,153 @@ uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int
 }
 
 
-// Valid signature cache, to avoid doing expensive ECDSA signature checking
-// twice for every transaction (once when accepted into memory pool, and
-// again when accepted into the block chain)
-
-class CSignatureCache
+CSignatureCache::CSignatureCache(uint64 nMaxBytes)
 {
-private:
-     // sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, std::vector<unsigned char> > sigdata_type;
-    std::set< sigdata_type> setValid;
-    CCriticalSection cs_sigcache;
-
-public:
-    bool
-    Get(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
+    salt = GetRandHash();
+    nBuckets = (unsigned int)min(nMaxBytes / BUCKET_SIZE / SHARDS, (uint64)std::numeric_limits<unsigned int>::max());
+    for (int i = 0; i < SHARDS; i++)
     {
-        LOCK(cs_sigcache);
+        CShard &shard = shards[i];
+        shard.pTable = NULL;
+        if (nBuckets)
+        {
+            shard.vchTable.assign((size_t)nBuckets * BUCKET_SIZE + BUCKET_SIZE - 1, 0);
+            uintptr_t nAddr = (uintptr_t)&shard.vchTable[0];
+            shard.pTable = &shard.vchTable[0] + (BUCKET_SIZE - nAddr % BUCKET_SIZE) % BUCKET_SIZE;
+        }
+        shard.nHits = shard.nMisses = shard.nEvictions = shard.nEntries = 0;
+    }
+}
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
+uint256 CSignatureCache::GetEntry(const uint256 &hash, const vector<unsigned char>& vchSig,
+                                  const vector<unsigned char>& vchPubKey) const
+{
+    // SHA256(salt || hash || sig size || sig || pubkey)
+    static unsigned char pblank[1];
+    unsigned int nSigSize = vchSig.size();
+    uint256 entry;
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    SHA256_Update(&ctx, (const unsigned char*)&salt, sizeof(salt));
+    SHA256_Update(&ctx, (const unsigned char*)&hash, sizeof(hash));
+    SHA256_Update(&ctx, &nSigSize, sizeof(nSigSize));
+    SHA256_Update(&ctx, vchSig.empty() ? pblank : &vchSig[0], vchSig.size());
+    SHA256_Update(&ctx, vchPubKey.empty() ? pblank : &vchPubKey[0], vchPubKey.size());
+    SHA256_Final((unsigned char*)&entry, &ctx);
+
+    // all zero marks an empty slot
+    if (entry == 0)
+        entry = 1;
+    return entry;
+}
+
+unsigned char *CSignatureCache::GetBucket(const uint256 &entry, CShard *&pshard) const
+{
+    pshard = &shards[entry.Get64(0) % SHARDS];
+    return pshard->pTable + (entry.Get64(1) % nBuckets) * BUCKET_SIZE;
+}
+
+bool CSignatureCache::Get(const uint256 &hash, const vector<unsigned char>& vchSig, const vector<unsigned char>& vchPubKey)
+{
+    if (nBuckets == 0)
         return false;
+
+    uint256 entry = GetEntry(hash, vchSig, vchPubKey);
+    CShard *pshard;
+    unsigned char *pBucket = GetBucket(entry, pshard);
+
+    LOCK(pshard->cs);
+    for (int i = 0; i < WAYS; i++)
+    {
+        if (memcmp(pBucket + i * ENTRY_SIZE, entry.begin(), ENTRY_SIZE) == 0)
+        {
+            pshard->nHits++;
+            return true;
+        }
     }
+    pshard->nMisses++;
+    return false;
+}
+
+void CSignatureCache::Set(const uint256 &hash, const vector<unsigned char>& vchSig, const vector<unsigned char>& vchPubKey)
+{
+    static const unsigned char pchEmpty[ENTRY_SIZE] = {};
+    if (nBuckets == 0)
+        return;
+
+    uint256 entry = GetEntry(hash, vchSig, vchPubKey);
+    CShard *pshard;
+    unsigned char *pBucket = GetBucket(entry, pshard);
 
-    void
-    Set(uint256 hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& pubKey)
+    LOCK(pshard->cs);
+    unsigned char *pSlot = NULL;
+    for (int i = 0; i < WAYS; i++)
+    {
+        unsigned char *p = pBucket + i * ENTRY_SIZE;
+        if (memcmp(p, entry.begin(), ENTRY_SIZE) == 0)
+            return;
+        if (!pSlot && memcmp(p, pchEmpty, ENTRY_SIZE) == 0)
+            pSlot = p;
+    }
+    if (pSlot)
+        pshard->nEntries++;
+    else
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64 nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        pSlot = pBucket + (entry.Get64(2) % WAYS) * ENTRY_SIZE;
+        pshard->nEvictions++;
+    }
+    memcpy(pSlot, entry.begin(), ENTRY_SIZE);
+}
 
-        LOCK(cs_sigcache);
+void CSignatureCache::GetStats(uint64 &nHits, uint64 &nMisses, uint64 &nEvictions, uint64 &nEntries) const
+{
+    nHits = nMisses = nEvictions = nEntries = 0;
+    for (int i = 0; i < SHARDS; i++)
+    {
+        LOCK(shards[i].cs);
+        nHits += shards[i].nHits;
+        nMisses += shards[i].nMisses;
+        nEvictions += shards[i].nEvictions;
+        nEntries += shards[i].nEntries;
+    }
+}
 
-        while (static_cast<int64>(setValid.size()) > nMaxCacheSize)
+// -maxsigcachesize, from before the cache had a size in megabytes, still
+// counts signatures; -sigcachesize takes precedence. Both are capped at
+// MAX_SIG_CACHE_SIZE megabytes, as the whole table is allocated up front.
+static uint64 GetMaxSigCacheBytes()
+{
+    if (!mapArgs.count("-sigcachesize") && mapArgs.count("-maxsigcachesize"))
+    {
+        uint64 nMaxEntries = ((uint64)MAX_SIG_CACHE_SIZE * 1024 * 1024) / CSignatureCache::GetBytesForEntries(1);
+        int64 nEntries = max(GetArg("-maxsigcachesize", 0), (int64)0);
+        if ((uint64)nEntries > nMaxEntries)
         {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+            printf("-maxsigcachesize=%"PRI64d" is more than %"PRI64u" signatures, using %"PRI64u"\n", nEntries, nMaxEntries, nMaxEntries);
+            nEntries = nMaxEntries;
         }
+        return CSignatureCache::GetBytesForEntries(nEntries);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    int64 nMaxSize = GetArg("-sigcachesize", DEFAULT_SIG_CACHE_SIZE);
+    if (nMaxSize > MAX_SIG_CACHE_SIZE)
+    {
+        printf("-sigcachesize=%"PRI64d" is more than %d MB, using %d MB\n", nMaxSize, MAX_SIG_CACHE_SIZE, MAX_SIG_CACHE_SIZE);
+        nMaxSize = MAX_SIG_CACHE_SIZE;
     }
-};
+    return (uint64)max(nMaxSize, (int64)0) * 1024 * 1024;
+}
+
+CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache signatureCache(GetMaxSigCacheBytes());
+    return signatureCache;
+}
 
 bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CScript scriptCode,
               const CTransaction& txTo, unsigned int nIn, int nHashType)
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
 
     // Hash type is one byte tacked on to the end of the signature
     if (vchSig.empty())
@@ -1178,11 +1263,7 @@ bool CheckSig(vector<unsigned char> vchSig, vector<unsigned char> vchPubKey, CSc
     if (signatureCache.Get(sighash, vchSig, vchPubKey))
         return true;
 
-    CKey key;
-    if (!key.SetPubKey(vchPubKey))
-        return false;
-
-    if (!key.Verify(sighash, vchSig))
+    if (!CKey::VerifyPubKey(vchPubKey, sighash, vchSig))
         return false;
 
     signatureCache.Set(sighash, vchSig, vchPubKey);
@@ -567,6 +567,7 @@ public:
 
 
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, const CTransaction& txTo, unsigned int nIn, int nHashType);
+bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, const CTransaction& txTo, unsigned int nIn, int nHashType);
 bool Solver(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<std::vector<unsigned char> >& vSolutionsRet);
 int ScriptSigArgsExpected(txnouttype t, const std::vector<std::vector<unsigned char> >& vSolutions);
 bool IsStandard(const CScript& scriptPubKey);
@@ -576,4 +577,64 @@ bool ExtractAddresses(const CScript& scriptPubKey, txnouttype& typeRet, std::vec
 bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
 bool VerifySignature(const CTransaction& txFrom, const CTransaction& txTo, unsigned int nIn, int nHashType);
 
+/** Default for -sigcachesize, in megabytes */
+static const int DEFAULT_SIG_CACHE_SIZE = 8;
+/** Largest -sigcachesize taken, in megabytes */
+static const int MAX_SIG_CACHE_SIZE = 16384;
+
+/** Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain).
+ *
+ * Entries are 32 byte salted digests of (signature hash, signature, public
+ * key), two to a cache-line aligned bucket of a fixed table. The table is
+ * split into shards with a lock each, so the script-check threads rarely wait
+ * on each other. Adding to a full bucket evicts one of its entries, and as
+ * the salt is random, which entries share a bucket can't be planned.
+ */
+class CSignatureCache
+{
+private:
+    enum
+    {
+        SHARDS = 32,
+        WAYS = 2,
+        ENTRY_SIZE = 32,
+        BUCKET_SIZE = WAYS * ENTRY_SIZE,
+    };
+
+    struct CShard
+    {
+        CCriticalSection cs;
+        std::vector<unsigned char> vchTable;
+        unsigned char *pTable;      // vchTable from its first bucket boundary
+        uint64 nHits;
+        uint64 nMisses;
+        uint64 nEvictions;
+        uint64 nEntries;
+    };
+
+    uint256 salt;
+    unsigned int nBuckets;          // per shard; 0 disables the cache
+    mutable CShard shards[SHARDS];
+
+    uint256 GetEntry(const uint256 &hash, const std::vector<unsigned char>& vchSig,
+                     const std::vector<unsigned char>& vchPubKey) const;
+    unsigned char *GetBucket(const uint256 &entry, CShard *&pshard) const;
+
+public:
+    CSignatureCache(uint64 nMaxBytes);
+
+    bool Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& vchPubKey);
+    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const std::vector<unsigned char>& vchPubKey);
+
+    uint64 GetMaxEntries() const { return (uint64)nBuckets * SHARDS * WAYS; }
+    // Table size that holds nEntries, for sizes given as a number of signatures
+    static uint64 GetBytesForEntries(uint64 nEntries) { return nEntries * ENTRY_SIZE; }
+    void GetStats(uint64 &nHits, uint64 &nMisses, uint64 &nEvictions, uint64 &nEntries) const;
+};
+
+/** The cache CheckSig() uses, sized by -sigcachesize on first use */
+CSignatureCache& GetSignatureCache();
+
 #endif
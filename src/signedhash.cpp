@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "signedhash.h"
+#include "hashcache.h"
 
 #include "uint256.h"
 #include "db.h"
@@ -11,6 +12,10 @@
 #include "net.h"
 #include "protocol.h"
 
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 const std::string CSignedHash::strMasterPubKey = "04de9cd6a14a2174db54c597a88248022b6bf0d51513ec00f789abe82096db245dc2fe5eb8a8d7163c5005b507da48771b41a65051687865a7ba825705f5eb0e04";
 
 std::string CSignedHash::strMasterPrivKey = "";
@@ -18,17 +23,188 @@ std::string CSignedHash::strMasterPrivKey = "";
 
 namespace SignedHash
 {
+    // Hashes of main chain blocks live in hashcache.dat, indexed by height.
+    // The maps (and the txdb behind them) only hold hashes of blocks that
+    // have no slot there, such as side chain blocks and blocks we haven't
+    // connected yet.
+    static CHashCacheFile hashCache;
     static std::map<uint256, uint256> mapPoWCache;
     static std::map<uint256, std::pair<uint256, std::vector<unsigned char> > > mapSigCache;
     
-    std::map<uint256, CSignedHash> mapInvSignedHash;
+    // Signatures in hashCache are checked on first use: 0 = not yet, 1 = good, -1 = bad
+    static std::vector<char> vSigChecked;
     
     static CCriticalSection cs_caches;
     
+    // Signed hashes we can serve to peers, by inv hash; guarded by cs_caches
+    static std::map<uint256, CSignedHash> mapInvSignedHash;
+    
+    static int GetHashCacheHeight(const uint256 &idHash, int nHeight)
+    {
+        if (nHeight >= 0)
+            return nHeight;
+        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(idHash);
+        if (mi == mapBlockIndex.end())
+            return -1;
+        return (*mi).second->nHeight;
+    }
+    
+    static bool ReadHashCache(const uint256 &idHash, int nHeight, CHashCacheRecord &record)
+    {
+        return nHeight >= 0 && hashCache.Read(nHeight, record) && record.idHash == idHash;
+    }
+    
+    static void SetSigChecked(int nHeight, char nChecked)
+    {
+        if (nHeight >= (int)vSigChecked.size())
+            vSigChecked.resize(nHeight + 1, 0);
+        vSigChecked[nHeight] = nChecked;
+    }
+    
+    // Call with cs_caches held
+    static bool CheckSignedHash(const uint256 &idHash, const uint256 &powHash, const std::vector<unsigned char> &vchSig)
+    {
+        CSignedHash signedHash;
+        signedHash.SetHashes(idHash, powHash);
+        if (!signedHash.SetSignature(vchSig))
+            return false;
+        mapInvSignedHash[signedHash.GetHash()] = signedHash;
+        return true;
+    }
+    
+    // Move the hashes of a block that lost its slot at nHeight to the maps
+    // and the txdb, so a reorg back to it doesn't have to hash it again
+    static bool SpillHashCache(int nHeight, const CHashCacheRecord &record, CTxDB &txdb)
+    {
+        bool fSuccess = true;
+        if (record.nFlags & HASHCACHE_SIGNED)
+        {
+            char nChecked = nHeight < (int)vSigChecked.size() ? vSigChecked[nHeight] : 0;
+            std::vector<unsigned char> vchSig = record.GetSig();
+            if (nChecked > 0 || (nChecked == 0 && CheckSignedHash(record.idHash, record.powHash, vchSig)))
+            {
+                mapSigCache[record.idHash] = std::make_pair(record.powHash, vchSig);
+                fSuccess &= txdb.WriteSignedHash(record.idHash, record.powHash, vchSig);
+            }
+        }
+        
+        mapPoWCache[record.idHash] = record.powHash;
+        fSuccess &= txdb.WritePoWHash(record.idHash, record.powHash);
+        
+        if (!fSuccess)
+            return error("SignedHash::SpillHashCache(): Failed to write displaced hashes to txdb");
+        return true;
+    }
+    
+    // Store a hash in the slot for nHeight. A slot taken by another block
+    // is only given up for a block on (or about to extend) the main chain.
+    // ptxdb is the caller's open txdb, if it has one.
+    static bool WriteHashCache(const uint256 &idHash, int nHeight, const uint256 &powHash,
+                               const std::vector<unsigned char> *pvchSig, bool fSigChecked,
+                               CTxDB *ptxdb=NULL)
+    {
+        if (nHeight < 0 || (pvchSig && pvchSig->size() > HASHCACHE_MAX_SIG_SIZE))
+            return false;
+        
+        CHashCacheRecord record;
+        if (!hashCache.Read(nHeight, record))
+            record.SetNull();
+        
+        if (!record.IsNull() && record.idHash != idHash)
+        {
+            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(idHash);
+            bool fMainChain = mi != mapBlockIndex.end() ? (*mi).second->IsInMainChain() : nHeight > nBestHeight;
+            if (!fMainChain)
+                return false;
+            if (ptxdb)
+                SpillHashCache(nHeight, record, *ptxdb);
+            else
+            {
+                CTxDB txdb;
+                SpillHashCache(nHeight, record, txdb);
+                txdb.Close();
+            }
+            if (nHeight < (int)vSigChecked.size())
+                vSigChecked[nHeight] = 0;
+            record.SetNull();
+        }
+        
+        if (record.idHash != idHash || record.powHash != powHash)
+            record.nFlags &= ~HASHCACHE_SIGNED;
+        record.idHash = idHash;
+        record.powHash = powHash;
+        record.nFlags |= HASHCACHE_POW;
+        if (pvchSig)
+        {
+            record.nFlags |= HASHCACHE_SIGNED;
+            record.SetSig(*pvchSig);
+        }
+        
+        if (!hashCache.Write(nHeight, record))
+            return false;
+        
+        if (pvchSig)
+            SetSigChecked(nHeight, fSigChecked ? 1 : 0);
+        return true;
+    }
+    
+    void AddInvSignedHash(const CSignedHash &signedHash)
+    {
+        LOCK(cs_caches);
+        mapInvSignedHash[signedHash.GetHash()] = signedHash;
+    }
+    
+    bool HaveInvSignedHash(const uint256 &hashInv)
+    {
+        LOCK(cs_caches);
+        return mapInvSignedHash.count(hashInv) > 0;
+    }
+    
+    bool GetInvSignedHash(const uint256 &hashInv, CSignedHash &signedHash)
+    {
+        LOCK(cs_caches);
+        std::map<uint256, CSignedHash>::iterator mi = mapInvSignedHash.find(hashInv);
+        if (mi == mapInvSignedHash.end())
+            return false;
+        signedHash = (*mi).second;
+        return true;
+    }
+    
+    bool HaveSignedPoWHash(const uint256 &idHash)
+    {
+        LOCK(cs_caches);
+        
+        CHashCacheRecord record;
+        int nHeight = GetHashCacheHeight(idHash, -1);
+        if (ReadHashCache(idHash, nHeight, record) && (record.nFlags & HASHCACHE_SIGNED))
+            return nHeight >= (int)vSigChecked.size() || vSigChecked[nHeight] >= 0;
+        
+        return mapSigCache.count(idHash) > 0;
+    }
+    
     bool GetSignedPoWHash(const uint256 &idHash, uint256 &powHash, std::vector<unsigned char> &vchSig)
     {
         LOCK(cs_caches);
         
+        CHashCacheRecord record;
+        int nHeight = GetHashCacheHeight(idHash, -1);
+        if (ReadHashCache(idHash, nHeight, record) && (record.nFlags & HASHCACHE_SIGNED))
+        {
+            if (nHeight >= (int)vSigChecked.size() || vSigChecked[nHeight] == 0)
+            {
+                bool fValid = CheckSignedHash(idHash, record.powHash, record.GetSig());
+                if (!fValid)
+                    error("SignedHash::GetSignedPoWHash(): hash cache contains invalid signed hash");
+                SetSigChecked(nHeight, fValid ? 1 : -1);
+            }
+            if (vSigChecked[nHeight] > 0)
+            {
+                powHash = record.powHash;
+                vchSig = record.GetSig();
+                return true;
+            }
+        }
+        
         std::map<uint256, std::pair<uint256, std::vector<unsigned char> > >::iterator mi = mapSigCache.find(idHash);
         if (mi != mapSigCache.end())
         {
@@ -38,15 +214,38 @@ namespace SignedHash
             return true;
         }
         
+        // left in the txdb by an earlier run while the block had no slot
+        if (nHeight >= 0 && !ReadHashCache(idHash, nHeight, record))
+        {
+            CTxDB txdb("r");
+            bool fFound = txdb.ReadSignedHash(idHash, powHash, vchSig);
+            txdb.Close();
+            if (fFound && CheckSignedHash(idHash, powHash, vchSig))
+            {
+                if (!WriteHashCache(idHash, nHeight, powHash, &vchSig, true))
+                    mapSigCache[idHash] = std::make_pair(powHash, vchSig);
+                return true;
+            }
+        }
+        
         return false;
     }
     
     size_t CountSignedHashes()
     {
-        return mapSigCache.size();
+        LOCK(cs_caches);
+        
+        size_t nCount = mapSigCache.size();
+        CHashCacheRecord record;
+        for (int nHeight = 0; nHeight < hashCache.Size(); nHeight++)
+        {
+            if (hashCache.Read(nHeight, record) && (record.nFlags & HASHCACHE_SIGNED))
+                nCount++;
+        }
+        return nCount;
     }
     
-    bool GetPoWHash(const uint256 &idHash, uint256 &powHash)
+    bool GetPoWHash(const uint256 &idHash, uint256 &powHash, int nHeight)
     {
         std::vector<unsigned char> vchSig;
         if (GetBoolArg("-usesignedhashes", true) && GetSignedPoWHash(idHash, powHash, vchSig))
@@ -60,6 +259,21 @@ namespace SignedHash
         
         LOCK(cs_caches);
         
+        CHashCacheRecord record;
+        nHeight = GetHashCacheHeight(idHash, nHeight);
+        bool fHaveRecord = ReadHashCache(idHash, nHeight, record);
+        if (fHaveRecord && (record.nFlags & HASHCACHE_POW))
+        {
+            powHash = record.powHash;
+            
+            if (fDebug)
+                printf("SignedHash::GetPoWHash(): Returning unsigned cached hash %s --> %s\n",
+                       idHash.ToString().substr(0,16).c_str(),
+                       powHash.ToString().substr(0,16).c_str());
+            
+            return true;
+        }
+        
         std::map<uint256, uint256>::iterator mi = mapPoWCache.find(idHash);
         if (mi != mapPoWCache.end())
         {
@@ -73,12 +287,30 @@ namespace SignedHash
             return true;
         }
         
+        // left in the txdb by an earlier run while the block had no slot
+        if (!fHaveRecord && mapBlockIndex.count(idHash))
+        {
+            CTxDB txdb("r");
+            bool fFound = txdb.ReadPoWHash(idHash, powHash);
+            txdb.Close();
+            if (fFound)
+            {
+                if (!WriteHashCache(idHash, nHeight, powHash, NULL, false))
+                    mapPoWCache[idHash] = powHash;
+                return true;
+            }
+        }
+        
         return false;
     }
     
-    bool UncheckedAddHash(const uint256 &idHash, const uint256 &powHash)
+    bool UncheckedAddHash(const uint256 &idHash, const uint256 &powHash, int nHeight)
     {
         LOCK(cs_caches);
+        
+        if (WriteHashCache(idHash, GetHashCacheHeight(idHash, nHeight), powHash, NULL, false))
+            return true;
+        
         mapPoWCache[idHash] = powHash;
         
         CTxDB txdb;
@@ -91,9 +323,46 @@ namespace SignedHash
         return true;
     }
     
+    bool UncheckedAddSignedHashes(const std::vector<CSignedHash> &vSignedHashes)
+    {
+        LOCK(cs_caches);
+        
+        // only the hashes without a slot in hashCache go to the txdb, all in one transaction
+        CTxDB txdb;
+        bool fTxn = false, fSuccess = true;
+        BOOST_FOREACH(const CSignedHash &signedHash, vSignedHashes)
+        {
+            mapInvSignedHash[signedHash.GetHash()] = signedHash;
+            
+            if (WriteHashCache(signedHash.idHash, GetHashCacheHeight(signedHash.idHash, -1),
+                               signedHash.powHash, &signedHash.vchSig, true, &txdb))
+                continue;
+            
+            mapSigCache[signedHash.idHash] = std::make_pair(signedHash.powHash, signedHash.vchSig);
+            
+            if (!fTxn && !(fTxn = txdb.TxnBegin()))
+                return error("SignedHash::UncheckedAddSignedHashes(): Failed to start txdb transaction");
+            fSuccess &= txdb.WriteSignedHash(signedHash.idHash, signedHash.powHash, signedHash.vchSig);
+        }
+        
+        if (fTxn && !txdb.TxnCommit())
+            fSuccess = false;
+        txdb.Close();
+        
+        if (!fSuccess)
+            return error("SignedHash::UncheckedAddSignedHashes(): Failed to write PoW hashes to txdb");
+        
+        return true;
+    }
+    
     bool UncheckedAddSignedHash(const uint256 &idHash, const uint256 &powHash, const std::vector<unsigned char> &vchSig)
     {
         LOCK(cs_caches);
+        
+        // only called once the signature has been checked
+        if (WriteHashCache(idHash, GetHashCacheHeight(idHash, -1), powHash, &vchSig, true))
+            return true;
+        
         mapSigCache[idHash] = std::make_pair(powHash, vchSig);
         
         CTxDB txdb;
@@ -106,10 +375,40 @@ namespace SignedHash
         return true;
     }
     
+    // One-off copy of the main chain's hashes out of the txdb, for a node
+    // that has no hashcache.dat yet. Signatures are checked on first use.
+    static void ImportHashCache(CTxDB &txdb)
+    {
+        int nPoW = 0, nSigned = 0;
+        int64 nStart = GetTimeMillis();
+        
+        for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev; pindex = pindex->pprev)
+        {
+            uint256 idHash = pindex->GetBlockIDHash();
+            uint256 powHash;
+            std::vector<unsigned char> vchSig;
+            
+            if (txdb.ReadSignedHash(idHash, powHash, vchSig) &&
+                WriteHashCache(idHash, pindex->nHeight, powHash, &vchSig, false, &txdb))
+                nSigned++;
+            else if (txdb.ReadPoWHash(idHash, powHash) &&
+                     WriteHashCache(idHash, pindex->nHeight, powHash, NULL, false, &txdb))
+                nPoW++;
+        }
+        
+        printf("LoadHashCache(): Imported %d unsigned hashes, %d signed hashes from txdb in %"PRI64d"ms\n",
+               nPoW, nSigned, GetTimeMillis() - nStart);
+    }
+    
     bool LoadHashCache()
     {
         LOCK(cs_caches);
         
+        bool fCreated;
+        if (!hashCache.Open(GetDataDir() / "hashcache.dat", Hash(CSignedHash::strMasterPubKey.begin(), CSignedHash::strMasterPubKey.end()), fCreated))
+            return error("LoadHashCache() : unable to open hashcache.dat");
+        vSigChecked.clear();
+        
         CTxDB txdb;
         
         {
@@ -130,39 +429,220 @@ namespace SignedHash
                 
                 if (!txdb.TxnCommit())
                     return error("LoadHashCache() : failed to commit new signed hash master key to db");
-                
-                return true;
             }
         }
         
-        for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev; pindex = pindex->pprev)
+        if (fCreated)
+            ImportHashCache(txdb);
+        
+        if (fDebug)
+            printf("LoadHashCache(): hashcache.dat has %d heights\n", hashCache.Size());
+        
+        return true;
+    }
+    
+    //
+    // Signed hashes from peers are checked on a pool of threads and committed
+    // in batches by CommitVerifiedHashes, from the message handler thread.
+    //
+    
+    struct CSignedHashJob
+    {
+        CSignedHash signedHash;
+        CNode *pfrom;
+        bool fValid;
+    };
+    
+    class CSignedHashVerifier
+    {
+    public:
+        boost::asio::io_service service;
+        boost::asio::io_service::work work;
+        boost::thread_group threads;
+        
+        CSignedHashVerifier(int nThreads) : work(service)
         {
-            uint256 idHash = pindex->GetBlockIDHash();
-            uint256 powHash;
-            std::vector<unsigned char> vchSig;
-            
-            if (txdb.ReadPoWHash(idHash, powHash))
-                mapPoWCache[idHash] = powHash;
+            for (int i=0; i < nThreads; i++)
+                threads.create_thread(boost::bind(&boost::asio::io_service::run, &service));
+        }
+        
+        ~CSignedHashVerifier()
+        {
+            service.stop();
+            threads.join_all();
+        }
+    };
+    
+    static CSignedHashVerifier *pverifier = NULL;
+    static bool fVerifierStopped = false;
+    static std::set<uint256> setPendingInv;
+    static std::map<CNode*, int> mapNodePending;
+    static std::vector<CSignedHashJob> vVerified;
+    static CCriticalSection cs_verify;
+    
+    static CBlockIndex *pindexCatchUp = NULL;
+    
+    static void VerifySignedHash(CSignedHashJob job)
+    {
+        job.fValid = job.signedHash.CheckSignature();
+        
+        LOCK(cs_verify);
+        vVerified.push_back(job);
+    }
+    
+    bool IsSignedHashPending(const uint256 &hashInv)
+    {
+        LOCK(cs_verify);
+        return setPendingInv.count(hashInv) > 0;
+    }
+    
+    bool QueueSignedHash(const CSignedHash &signedHash, CNode *pfrom)
+    {
+        LOCK2(cs_vNodes, cs_verify);
+        
+        if (fVerifierStopped || setPendingInv.count(signedHash.GetHash()))
+            return false;
+        
+        // each one costs a signature check, so a peer only gets so many in flight
+        if (pfrom && mapNodePending.count(pfrom) && mapNodePending[pfrom] >= SIGNED_HASH_MAX_PENDING)
+        {
+            printf("SignedHash::QueueSignedHash(): dropped signed hash from %s, %d pending\n",
+                   pfrom->addr.ToString().c_str(), mapNodePending[pfrom]);
+            pfrom->Misbehaving(1);
+            return false;
+        }
+        setPendingInv.insert(signedHash.GetHash());
+        
+        if (!pverifier)
+        {
+            int nThreads = GetArg("-signedhashthreads", boost::thread::hardware_concurrency());
+            pverifier = new CSignedHashVerifier(std::max(nThreads, 1));
+        }
+        
+        CSignedHashJob job = {signedHash, pfrom, false};
+        if (pfrom)
+        {
+            pfrom->AddRef();
+            mapNodePending[pfrom]++;
+        }
+        pverifier->service.post(boost::bind(VerifySignedHash, job));
+        return true;
+    }
+    
+    void CommitVerifiedHashes()
+    {
+        std::vector<CSignedHashJob> vJobs;
+        {
+            LOCK(cs_verify);
+            vJobs.swap(vVerified);
+        }
+        if (vJobs.empty())
+            return;
+        
+        std::vector<CSignedHash> vValid;
+        BOOST_FOREACH(const CSignedHashJob &job, vJobs)
+        {
+            if (job.fValid)
+                vValid.push_back(job.signedHash);
+            else
+            {
+                error("invalid signed hash for %s", job.signedHash.idHash.ToString().substr(0,20).c_str());
+                // pfrom is still referenced until the loop below releases it
+                if (job.pfrom)
+                    job.pfrom->Misbehaving(10);
+            }
+        }
+        
+        if (!vValid.empty())
+            UncheckedAddSignedHashes(vValid);
+        
+        if (fDebug)
+            printf("SignedHash::CommitVerifiedHashes(): committed %d of %d signed hashes\n",
+                   (int)vValid.size(), (int)vJobs.size());
+        
+        std::set<CNode*> setCaughtUp;
+        {
+            LOCK2(cs_vNodes, cs_verify);
+            BOOST_FOREACH(const CSignedHash &signedHash, vValid)
+            {
+                BOOST_FOREACH(CNode* pnode, vNodes)
+                    pnode->PushInventory(CInv(MSG_SIGNED_HASH, signedHash.GetHash()));
+            }
             
-            if (txdb.ReadSignedHash(idHash, powHash, vchSig))
+            BOOST_FOREACH(const CSignedHashJob &job, vJobs)
             {
-                CSignedHash signedHash;
-                signedHash.SetHashes(idHash, powHash);
-                if (signedHash.SetSignature(vchSig))
+                setPendingInv.erase(job.signedHash.GetHash());
+                if (!job.pfrom)
+                    continue;
+                
+                if (job.fValid && !job.pfrom->fDisconnect &&
+                    mapBlockIndex.find(job.signedHash.idHash) == mapBlockIndex.end())
                 {
-                    mapSigCache[idHash] = std::make_pair(powHash, vchSig);
-                    mapInvSignedHash[signedHash.GetHash()] = signedHash;
+                    CInv inv(MSG_BLOCK, job.signedHash.idHash);
+                    mapAlreadyAskedFor.erase(inv);
+                    job.pfrom->AskFor(inv);
+                }
+                
+                // a peer whose whole range has been committed is asked for the next one
+                if (--mapNodePending[job.pfrom] == 0)
+                {
+                    mapNodePending.erase(job.pfrom);
+                    if (job.fValid && !job.pfrom->fDisconnect)
+                        setCaughtUp.insert(job.pfrom->AddRef());
                 }
-                else
-                    error("LoadHashCache(): TxDB contains invalid signed hash");
+                job.pfrom->Release();
             }
         }
         
-        if (fDebug)
-            printf("LoadHashCache(): Have %d unsigned hashes, %d signed hashes\n",
-                   mapPoWCache.size(), mapSigCache.size());
+        BOOST_FOREACH(CNode *pnode, setCaughtUp)
+        {
+            CatchUp(pnode);
+            LOCK(cs_vNodes);
+            pnode->Release();
+        }
+    }
+    
+    void StopVerifier()
+    {
+        CSignedHashVerifier *p;
+        {
+            LOCK(cs_verify);
+            fVerifierStopped = true;
+            p = pverifier;
+            pverifier = NULL;
+        }
+        // stops the threads, dropping the jobs not yet started, and joins them
+        delete p;
         
-        return true;
+        // every job still pending holds a reference to its node
+        LOCK2(cs_vNodes, cs_verify);
+        for (std::map<CNode*, int>::iterator mi = mapNodePending.begin(); mi != mapNodePending.end(); ++mi)
+            for (int i = 0; i < (*mi).second; i++)
+                (*mi).first->Release();
+        mapNodePending.clear();
+        setPendingInv.clear();
+        vVerified.clear();
+    }
+    
+    void CatchUp(CNode *pfrom)
+    {
+        if (pfrom->nVersion < PROTOCOL_VERSION_SIGNEDHASH_START || !CSignedHash::strMasterPrivKey.empty())
+            return;
+        
+        // carry on from the last block known to be signed, rather than from genesis every time
+        if (!pindexCatchUp || !pindexCatchUp->IsInMainChain())
+            pindexCatchUp = pindexGenesisBlock;
+        
+        for (CBlockIndex *pindex=pindexCatchUp->pnext; pindex; pindex = pindex->pnext)
+        {
+            uint256 idHash = pindex->GetBlockIDHash();
+            if (!HaveSignedPoWHash(idHash))
+            {
+                pfrom->PushMessage("getsigpowhas", idHash);
+                break;
+            }
+            pindexCatchUp = pindex;
+        }
     }
     
     bool SetSignedHashPrivKey(std::string strPrivKey)
@@ -270,7 +750,7 @@ bool CSignedHash::ProcessRelaySignedHash(CNode* pfrom)
     
     SignedHash::UncheckedAddSignedHash(idHash, powHash, vchSig);
     
-    SignedHash::mapInvSignedHash[GetHash()] = *this;
+    SignedHash::AddInvSignedHash(*this);
     
     {
         LOCK(cs_vNodes);
@@ -26,14 +26,37 @@ class CSignedHash;
 
 namespace SignedHash
 {
-    extern std::map<uint256, CSignedHash> mapInvSignedHash;
+    // Signed hashes we can serve to peers, by inv hash
+    void AddInvSignedHash(const CSignedHash &signedHash);
+    bool HaveInvSignedHash(const uint256 &hashInv);
+    bool GetInvSignedHash(const uint256 &hashInv, CSignedHash &signedHash);
     
     size_t CountSignedHashes();
     
+    // Signed hashes served to peers per getsigpowhas request
+    static const int SIGNED_HASH_BATCH = 500;
+    // Signed hashes from one peer waiting to be checked and committed
+    static const int SIGNED_HASH_MAX_PENDING = 2 * SIGNED_HASH_BATCH;
+    
+    bool HaveSignedPoWHash(const uint256 &idHash);
     bool GetSignedPoWHash(const uint256 &idHash, uint256 &powHash, std::vector<unsigned char> &vchSig);
-    bool GetPoWHash(const uint256 &idHash, uint256 &powHash);
-    bool UncheckedAddHash(const uint256 &idHash, const uint256 &powHash);
+    // nHeight: the block's height if it isn't in mapBlockIndex yet, otherwise -1
+    bool GetPoWHash(const uint256 &idHash, uint256 &powHash, int nHeight=-1);
+    bool UncheckedAddHash(const uint256 &idHash, const uint256 &powHash, int nHeight=-1);
     bool UncheckedAddSignedHash(const uint256 &idHash, const uint256 &powHash, const std::vector<unsigned char> &vchSig);
+    bool UncheckedAddSignedHashes(const std::vector<CSignedHash> &vSignedHashes);
+    
+    // Check a signed hash from pfrom on the verifier threads; false if it
+    // was already pending or pfrom has too many pending
+    bool QueueSignedHash(const CSignedHash &signedHash, CNode *pfrom);
+    bool IsSignedHashPending(const uint256 &hashInv);
+    // Store and relay the signed hashes checked so far; call with cs_main held
+    void CommitVerifiedHashes();
+    // Join the verifier threads and drop what they hadn't committed
+    void StopVerifier();
+    
+    // Ask pfrom for the signed hashes from the first main chain block we lack one for
+    void CatchUp(CNode *pfrom);
     
     bool LoadHashCache();
     
@@ -0,0 +1,93 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "checkqueue.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+static boost::mutex mutexCount;
+static int nChecksRun = 0;
+
+struct CTestCheck
+{
+    bool fOk;
+
+    CTestCheck(bool fOkIn = true) : fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        boost::lock_guard<boost::mutex> lock(mutexCount);
+        nChecksRun++;
+        return fOk;
+    }
+
+    void swap(CTestCheck &check)
+    {
+        std::swap(fOk, check.fOk);
+    }
+};
+
+static void RunWorker(CCheckQueue<CTestCheck> *pqueue)
+{
+    pqueue->Thread();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_workers)
+{
+    CCheckQueue<CTestCheck> queue(16);
+    boost::thread_group workers;
+    for (int i = 0; i < 3; i++)
+        workers.create_thread(boost::bind(&RunWorker, &queue));
+
+    for (int nRound = 0; nRound < 20; nRound++)
+    {
+        nChecksRun = 0;
+        {
+            CCheckQueueControl<CTestCheck> control(&queue);
+            for (int i = 0; i < 100; i++)
+            {
+                vector<CTestCheck> vChecks(i % 7, CTestCheck());
+                control.Add(vChecks);
+                BOOST_CHECK(vChecks.empty());
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nChecksRun, 295);
+    }
+
+    // a failure is reported, and the queue is usable again after it
+    {
+        CCheckQueueControl<CTestCheck> control(&queue);
+        vector<CTestCheck> vChecks(1000, CTestCheck());
+        vChecks[500].fOk = false;
+        control.Add(vChecks);
+        BOOST_CHECK(!control.Wait());
+    }
+    {
+        CCheckQueueControl<CTestCheck> control(&queue);
+        vector<CTestCheck> vChecks(10, CTestCheck());
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_inline)
+{
+    nChecksRun = 0;
+    CCheckQueueControl<CTestCheck> control(NULL);
+    vector<CTestCheck> vChecks(10, CTestCheck());
+    vChecks[6].fOk = false;
+    control.Add(vChecks);
+    BOOST_CHECK(vChecks.empty());
+    BOOST_CHECK(!control.Wait());
+    // run in order, stopping at the failure
+    BOOST_CHECK_EQUAL(nChecksRun, 7);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "hashcache.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(hashcache_tests)
+
+static CHashCacheRecord MakeRecord(int n, bool fSigned)
+{
+    CHashCacheRecord record;
+    record.SetNull();
+    record.idHash = uint256(n + 1);
+    record.powHash = uint256(n + 1000);
+    record.nFlags = HASHCACHE_POW;
+    if (fSigned)
+    {
+        record.nFlags |= HASHCACHE_SIGNED;
+        record.SetSig(vector<unsigned char>(71, (unsigned char)n));
+    }
+    return record;
+}
+
+BOOST_AUTO_TEST_CASE(hashcache_roundtrip)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path("hashcache-%%%%%%%%.dat");
+    uint256 hashKey1 = 1, hashKey2 = 2;
+    bool fCreated;
+    CHashCacheRecord record;
+
+    {
+        CHashCacheFile file;
+        BOOST_CHECK(file.Open(path, hashKey1, fCreated));
+        BOOST_CHECK(fCreated);
+        BOOST_CHECK_EQUAL(file.Size(), 0);
+
+        for (int n = 0; n < 10; n++)
+            BOOST_CHECK(file.Write(n, MakeRecord(n, n % 2 == 0)));
+        // past the end: the heights in between read back as null records
+        BOOST_CHECK(file.Write(20, MakeRecord(20, true)));
+        BOOST_CHECK_EQUAL(file.Size(), 21);
+        BOOST_CHECK(file.Read(15, record) && record.IsNull());
+        BOOST_CHECK(!file.Read(21, record));
+    }
+
+    {
+        CHashCacheFile file;
+        BOOST_CHECK(file.Open(path, hashKey1, fCreated));
+        BOOST_CHECK(!fCreated);
+        BOOST_CHECK_EQUAL(file.Size(), 21);
+        for (int n = 0; n < 10; n++)
+        {
+            CHashCacheRecord expected = MakeRecord(n, n % 2 == 0);
+            BOOST_CHECK(file.Read(n, record));
+            BOOST_CHECK(memcmp(&record, &expected, sizeof(record)) == 0);
+        }
+        BOOST_CHECK(file.Read(20, record) && record.GetSig() == vector<unsigned char>(71, 20));
+
+        // a reorganization replaces a record in place
+        BOOST_CHECK(file.Write(5, MakeRecord(50, false)));
+        BOOST_CHECK(file.Read(5, record) && record.idHash == uint256(51));
+    }
+
+    {
+        // a new master key keeps the PoW hashes but drops the signatures
+        CHashCacheFile file;
+        BOOST_CHECK(file.Open(path, hashKey2, fCreated));
+        BOOST_CHECK(!fCreated);
+        BOOST_CHECK(file.Read(4, record));
+        BOOST_CHECK(record.nFlags == HASHCACHE_POW && record.nSigSize == 0);
+        BOOST_CHECK(record.powHash == uint256(1004));
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
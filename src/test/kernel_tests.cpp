@@ -0,0 +1,160 @@
+#include <boost/test/unit_test.hpp>
+
+#include "kernel.h"
+#include "kernelhash.h"
+#include "util.h"
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+BOOST_AUTO_TEST_CASE(kernelhash_matches_hash)
+{
+    for (int nRound = 0; nRound < 50; nRound++)
+    {
+        unsigned char pchKernel[28];
+        for (int i = 0; i < 24; i++)
+            pchKernel[i] = (unsigned char)GetRand(256);
+        CKernelHasher hasher(pchKernel);
+
+        // counts around the lane widths
+        unsigned int nCount = nRound + 1;
+        vector<unsigned int> vTime(nCount);
+        vector<uint256> vHash(nCount);
+        for (unsigned int i = 0; i < nCount; i++)
+            vTime[i] = (unsigned int)GetRand(0x100000000LL);
+        hasher.Hash(&vTime[0], nCount, &vHash[0]);
+
+        for (unsigned int i = 0; i < nCount; i++)
+        {
+            memcpy(&pchKernel[24], &vTime[i], 4);
+            BOOST_CHECK(vHash[i] == Hash(BEGIN(pchKernel), END(pchKernel)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(kernel_find_time)
+{
+    unsigned int nTimeTx = 1400000000;
+    int nFound = 0, nMissed = 0;
+
+    for (int nRound = 0; nRound < 200; nRound++)
+    {
+        CStakeKernelInput input;
+        input.pindexFrom = input.pindexModifier = NULL;
+        input.nStakeModifier = GetRand(0x7fffffffffffffffLL);
+        input.nTimeBlockFrom = nTimeTx - nStakeMinAge - GetRand(STAKE_MAX_AGE);
+        input.nTxPrevOffset = 80 + GetRand(1000);
+        input.nTimeTxPrev = input.nTimeBlockFrom - GetRand(100);
+        input.nPrevout = GetRand(4);
+        input.nValueIn = GetRand(10000 * COIN);
+
+        // so that some inputs find a kernel within the 60 seconds and some don't
+        CBigNum bnTarget(~uint256(0) >> 25);
+        unsigned int nBits = bnTarget.GetCompact();
+
+        uint256 hashProofOfStake, hashExpected;
+        int nExpected = -1;
+        for (unsigned int n = 0; n < 60 && nExpected < 0; n++)
+            if (CheckStakeKernelHash(nBits, input, nTimeTx - n, hashExpected))
+                nExpected = n;
+
+        BOOST_CHECK_EQUAL(FindStakeKernelTime(nBits, input, nTimeTx, 60, hashProofOfStake), nExpected);
+        if (nExpected >= 0)
+        {
+            BOOST_CHECK(hashProofOfStake == hashExpected);
+            nFound++;
+        }
+        else
+            nMissed++;
+    }
+    BOOST_CHECK(nFound > 0 && nMissed > 0);
+
+    // a target so large the weighted product passes 256 bits meets every hash
+    CStakeKernelInput input;
+    input.pindexFrom = input.pindexModifier = NULL;
+    input.nStakeModifier = 1;
+    input.nTimeBlockFrom = nTimeTx - STAKE_MAX_AGE;
+    input.nTxPrevOffset = 80;
+    input.nTimeTxPrev = input.nTimeBlockFrom;
+    input.nPrevout = 0;
+    input.nValueIn = 1000000 * COIN;
+    uint256 hashProofOfStake;
+    BOOST_CHECK_EQUAL(FindStakeKernelTime(CBigNum(~uint256(0) >> 4).GetCompact(), input, nTimeTx, 60, hashProofOfStake), 0);
+    // and none are found before the min age
+    input.nTimeBlockFrom = input.nTimeTxPrev = nTimeTx - nStakeMinAge + 60;
+    BOOST_CHECK_EQUAL(FindStakeKernelTime(CBigNum(~uint256(0) >> 4).GetCompact(), input, nTimeTx, 60, hashProofOfStake), -1);
+}
+
+// GetKernelStakeModifier as it was, walking pnext
+static const CBlockIndex* WalkStakeModifier(const CBlockIndex* pindexFrom)
+{
+    int64 nStakeModifierTime = pindexFrom->GetBlockTime();
+    const CBlockIndex* pindex = pindexFrom;
+    while (nStakeModifierTime < pindexFrom->GetBlockTime() + GetStakeModifierSelectionInterval())
+    {
+        if (!pindex->pnext)
+            return NULL;
+        pindex = pindex->pnext;
+        if (pindex->GeneratedStakeModifier())
+            nStakeModifierTime = pindex->GetBlockTime();
+    }
+    return pindex;
+}
+
+static void BuildBranch(vector<CBlockIndex>& vBranch, CBlockIndex* pindexPrev)
+{
+    for (unsigned int i = 0; i < vBranch.size(); i++)
+    {
+        CBlockIndex& index = vBranch[i];
+        index.pprev = (i == 0 ? pindexPrev : &vBranch[i - 1]);
+        index.pnext = (i + 1 < vBranch.size() ? &vBranch[i + 1] : NULL);
+        index.nHeight = index.pprev ? index.pprev->nHeight + 1 : 0;
+        // now and then a timestamp well behind the one before
+        index.nTime = (index.pprev ? index.pprev->nTime : 1400000000) + 600 - (GetRand(20) == 0 ? GetRand(5000) : GetRand(300));
+        index.SetStakeModifier(GetRand(0x7fffffffffffffffLL), GetRand(8) == 0);
+    }
+    if (pindexPrev)
+        pindexPrev->pnext = &vBranch[0];
+}
+
+static void CheckStakeModifiers(const vector<CBlockIndex>& vBranch)
+{
+    CTransaction txPrev;
+    txPrev.vout.push_back(CTxOut(COIN, CScript()));
+    BOOST_FOREACH(const CBlockIndex& index, vBranch)
+    {
+        const CBlockIndex* pindexExpected = WalkStakeModifier(&index);
+        CStakeKernelInput input;
+        BOOST_CHECK_EQUAL(GetStakeKernelInput(&index, 0, txPrev, 0, input), pindexExpected != NULL);
+        if (pindexExpected)
+            BOOST_CHECK(input.pindexModifier == pindexExpected && input.nStakeModifier == pindexExpected->nStakeModifier);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(kernel_stake_modifier_table)
+{
+    CBlockIndex* pindexBestOrig = pindexBest;
+
+    vector<CBlockIndex> vChain(3000);
+    BuildBranch(vChain, NULL);
+    pindexBest = &vChain.back();
+    CheckStakeModifiers(vChain);
+
+    // reorganize to a branch off height 2000, as Reorganize() leaves pnext
+    vector<CBlockIndex> vBranch(1500);
+    for (unsigned int i = 2000; i < vChain.size(); i++)
+        vChain[i].pprev->pnext = NULL;
+    BuildBranch(vBranch, &vChain[1999]);
+    pindexBest = &vBranch.back();
+    UpdateStakeModifierTable(pindexBest);
+    CheckStakeModifiers(vChain);
+    CheckStakeModifiers(vBranch);
+
+    pindexBest = pindexBestOrig;
+    UpdateStakeModifierTable(NULL);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
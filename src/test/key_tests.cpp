@@ -82,6 +82,12 @@ BOOST_AUTO_TEST_CASE(key_test1)
         BOOST_CHECK(!key2C.Verify(hashMsg, sign1C));
         BOOST_CHECK( key2C.Verify(hashMsg, sign2C));
 
+        // the same through the parsed key cache
+        BOOST_CHECK( CKey::VerifyPubKey(key1C.GetPubKey(), hashMsg, sign1C));
+        BOOST_CHECK(!CKey::VerifyPubKey(key1C.GetPubKey(), hashMsg, sign2C));
+        BOOST_CHECK(!CKey::VerifyPubKey(key2C.GetPubKey(), hashMsg, sign1C));
+        BOOST_CHECK( CKey::VerifyPubKey(key2C.GetPubKey(), hashMsg, sign2C));
+
         // compact signatures (with key recovery)
 
         vector<unsigned char> csign1C, csign2C;
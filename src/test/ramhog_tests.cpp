@@ -0,0 +1,264 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <string.h>
+#include <vector>
+
+#include "hashblock/ramhog.h"
+#include "hashblock/ramhog_mt.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(ramhog_tests)
+
+static const uint32_t nTestPads = 16;
+static const uint32_t nTestChunks = 65536;
+
+static void GenScalar(const unsigned char* input, vector<vector<uint64_t> >& pads)
+{
+    pads.assign(nTestPads, vector<uint64_t>(nTestChunks));
+    for (uint32_t i = 0; i < nTestPads; i++)
+        ramhog_gen_pad(input, 80, nTestChunks, i, &pads[i][0]);
+}
+
+BOOST_AUTO_TEST_CASE(ramhog_lanes_match_scalar)
+{
+    unsigned char input[80];
+    for (int i = 0; i < 80; i++)
+        input[i] = i * 3;
+
+    vector<vector<uint64_t> > vRef;
+    GenScalar(input, vRef);
+
+    const uint32_t lanes[] = {1, 4, 8};
+    for (unsigned int k = 0; k < sizeof(lanes)/sizeof(lanes[0]); k++)
+    {
+        ramhog_set_max_lanes(lanes[k]);
+
+        // whole set, then an odd-sized, unaligned run of pads
+        vector<vector<uint64_t> > vPads(nTestPads, vector<uint64_t>(nTestChunks, 0));
+        uint64_t* pads[nTestPads];
+        for (uint32_t i = 0; i < nTestPads; i++)
+            pads[i] = &vPads[i][0];
+
+        ramhog_gen_pads(input, 80, nTestChunks, 0, nTestPads, pads);
+        for (uint32_t i = 0; i < nTestPads; i++)
+            BOOST_CHECK_MESSAGE(vPads[i] == vRef[i], "pad " << i << " differs with " << ramhog_lanes() << " lanes");
+
+        for (uint32_t i = 0; i < nTestPads; i++)
+            memset(pads[i], 0, nTestChunks * sizeof(uint64_t));
+        ramhog_gen_pads(input, 80, nTestChunks, 3, 11, &pads[3]);
+        for (uint32_t i = 3; i < 14; i++)
+            BOOST_CHECK_MESSAGE(vPads[i] == vRef[i], "pad " << i << " differs with " << ramhog_lanes() << " lanes");
+    }
+    ramhog_set_max_lanes(4);
+}
+
+BOOST_AUTO_TEST_CASE(ramhog_full_hash_lanes)
+{
+    unsigned char input[80];
+    for (int i = 0; i < 80; i++)
+        input[i] = 255 - i;
+
+    vector<vector<uint64_t> > vPads(nTestPads, vector<uint64_t>(nTestChunks));
+    uint64_t* pads[nTestPads];
+    for (uint32_t i = 0; i < nTestPads; i++)
+        pads[i] = &vPads[i][0];
+
+    unsigned char hashScalar[32], hashLanes[32];
+    ramhog_set_max_lanes(1);
+    ramhog(input, 80, hashScalar, 32, nTestPads, nTestChunks, 4096, pads);
+    ramhog_set_max_lanes(8);
+    ramhog(input, 80, hashLanes, 32, nTestPads, nTestChunks, 4096, pads);
+    ramhog_set_max_lanes(4);
+
+    BOOST_CHECK(memcmp(hashScalar, hashLanes, 32) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ramhog_multi_walk_matches_single)
+{
+    const uint32_t nWalks = 3;
+    vector<vector<vector<uint64_t> > > vSets(nWalks);
+    vector<vector<uint64_t*> > vSetPtrs(nWalks);
+    unsigned char inputs[nWalks][80], outputs[nWalks][32], expected[nWalks][32];
+    const uint8_t* pinputs[nWalks];
+    size_t input_sizes[nWalks];
+    uint8_t* poutputs[nWalks];
+    uint64_t** scratchpads[nWalks];
+
+    for (uint32_t k = 0; k < nWalks; k++)
+    {
+        for (int i = 0; i < 80; i++)
+            inputs[k][i] = i + 17 * k;
+        GenScalar(inputs[k], vSets[k]);
+        for (uint32_t i = 0; i < nTestPads; i++)
+            vSetPtrs[k].push_back(&vSets[k][i][0]);
+        ramhog_run_iterations(inputs[k], 80, expected[k], 32, nTestPads, nTestChunks, 4096, &vSetPtrs[k][0]);
+
+        pinputs[k] = inputs[k];
+        input_sizes[k] = 80;
+        poutputs[k] = outputs[k];
+        scratchpads[k] = &vSetPtrs[k][0];
+    }
+
+    ramhog_run_iterations_multi(nWalks, pinputs, input_sizes, poutputs, 32, nTestPads, nTestChunks, 4096, scratchpads);
+    for (uint32_t k = 0; k < nWalks; k++)
+        BOOST_CHECK(memcmp(outputs[k], expected[k], 32) == 0);
+
+    // walks that join at different times, advanced in uneven slices
+    ramhog_walk walks[nWalks];
+    ramhog_walk* pwalks[nWalks];
+    memset(outputs, 0, sizeof(outputs));
+    for (uint32_t k = 0; k < nWalks; k++)
+    {
+        ramhog_walk_init(&walks[k], inputs[k], 80, outputs[k], 32, nTestPads, nTestChunks, 4096, scratchpads[k]);
+        pwalks[k] = &walks[k];
+    }
+    ramhog_walk_steps(pwalks, 1, 1000);
+    ramhog_walk_steps(pwalks, 2, 777);
+    while (!ramhog_walk_done(&walks[0]))
+        ramhog_walk_steps(pwalks, 3, 500);
+    while (!ramhog_walk_done(&walks[2]))
+        ramhog_walk_steps(pwalks + 1, 2, 500);
+    for (uint32_t k = 0; k < nWalks; k++)
+        BOOST_CHECK(memcmp(outputs[k], expected[k], 32) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(ramhog_pad_reachable_pads)
+{
+    // the walk picks a pad from the top 32 bits of a word, which for a
+    // power of two pad count always lands on pad 0
+    BOOST_CHECK(ramhog_pad_reachable(16, 0));
+    for (uint32_t i = 1; i < 16; i++)
+        BOOST_CHECK(!ramhog_pad_reachable(16, i));
+    // the seed reads the first words of every pad's final chunk
+    BOOST_CHECK(ramhog_pad_reachable(64, 1));
+    BOOST_CHECK(!ramhog_pad_reachable(64, 2));
+    for (uint32_t i = 0; i < 3; i++)
+        BOOST_CHECK(ramhog_pad_reachable(3, i));
+}
+
+BOOST_AUTO_TEST_CASE(ramhog_lowmem_matches_full)
+{
+    const uint32_t vN[] = {16, 3, 6};
+    const uint64_t vMaxMem[] = {0, 1 << 20, 256 << 10, 16 << 10};
+
+    for (unsigned int n = 0; n < sizeof(vN) / sizeof(vN[0]); n++)
+    {
+        uint32_t N = vN[n];
+        unsigned char input[80], expected[32], output[32];
+        for (int i = 0; i < 80; i++)
+            input[i] = i * 3 + N;
+
+        vector<vector<uint64_t> > vPads(N, vector<uint64_t>(nTestChunks));
+        vector<uint64_t*> vPadPtrs;
+        for (uint32_t i = 0; i < N; i++)
+        {
+            ramhog_gen_pad(input, 80, nTestChunks, i, &vPads[i][0]);
+            vPadPtrs.push_back(&vPads[i][0]);
+        }
+        ramhog_run_iterations(input, 80, expected, 32, N, nTestChunks, 4096, &vPadPtrs[0]);
+
+        for (unsigned int m = 0; m < sizeof(vMaxMem) / sizeof(vMaxMem[0]); m++)
+        {
+            uint32_t nSegmentChunks = vMaxMem[m] ? ramhog_lowmem_segment_chunks(N, nTestChunks, vMaxMem[m]) : 0;
+            vector<ramhog_lowmem_pad> vLowmem(N);
+            memset(&vLowmem[0], 0, sizeof(ramhog_lowmem_pad) * N);
+            for (uint32_t i = 0; i < N; i++)
+            {
+                if (!ramhog_pad_reachable(N, i))
+                    continue;
+                BOOST_REQUIRE(ramhog_lowmem_alloc(&vLowmem[i], nTestChunks, nSegmentChunks));
+                ramhog_lowmem_fill(&vLowmem[i], input, 80, i, NULL);
+                for (uint32_t c = 0; c < nTestChunks; c += 4099)
+                    BOOST_CHECK(ramhog_lowmem_chunk(&vLowmem[i], c) == vPads[i][c]);
+            }
+
+            memset(output, 0, sizeof(output));
+            ramhog_run_iterations_lowmem(input, 80, output, 32, N, nTestChunks, 4096, &vLowmem[0], NULL);
+            BOOST_CHECK(memcmp(output, expected, 32) == 0);
+
+            for (uint32_t i = 0; i < N; i++)
+                ramhog_lowmem_free(&vLowmem[i]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ramhog_cancellable)
+{
+    // long enough to reach a cancellation check after the first chunk
+    const uint32_t C = RAMHOG_CANCEL_CHUNKS + 1024;
+    unsigned char input[80];
+    for (int i = 0; i < 80; i++)
+        input[i] = i;
+
+    vector<uint64_t> vPad(C), vExpected(C);
+    uint64_t* ppad = &vPad[0];
+    volatile int fCancel = 0;
+
+    ramhog_gen_pad(input, 80, C, 3, &vExpected[0]);
+    BOOST_CHECK(ramhog_gen_pads_cancellable(input, 80, C, 3, 1, &ppad, &fCancel));
+    BOOST_CHECK(vPad == vExpected);
+
+    fCancel = 1;
+    BOOST_CHECK(!ramhog_gen_pads_cancellable(input, 80, C, 3, 1, &ppad, &fCancel));
+
+    ramhog_lowmem_pad pad;
+    BOOST_REQUIRE(ramhog_lowmem_alloc(&pad, C, 1 << 16));
+    BOOST_CHECK(!ramhog_lowmem_fill(&pad, input, 80, 3, &fCancel));
+    fCancel = 0;
+    BOOST_CHECK(ramhog_lowmem_fill(&pad, input, 80, 3, &fCancel));
+    BOOST_CHECK(ramhog_lowmem_chunk(&pad, C - 1) == vExpected[C - 1]);
+    ramhog_lowmem_free(&pad);
+}
+
+static void MineUntilStopped(CRamhogThreadPool* pool, volatile bool* pfStop, unsigned char nMiner)
+{
+    unsigned char input[80], output[32];
+    memset(input, nMiner, sizeof(input));
+    for (uint32_t nNonce = 0; !*pfStop; nNonce++)
+    {
+        memcpy(input + 76, &nNonce, 4);
+        pool->ramhog(input, 80, output, 32, true);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ramhog_pipeline_verify_preempts_fill)
+{
+    // two pipelined pad sets whose hash time is almost all pad fill, so a
+    // verifier waiting behind a miner's fill would take half as long again
+    CRamhogThreadPool pool(64, 1 << 18, 4096, 2, 2, "none", false, true);
+    unsigned char input[80], output[32];
+    memset(input, 0xaa, sizeof(input));
+
+    int64 nHashTime = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        int64 nStart = GetTimeMillis();
+        BOOST_REQUIRE(pool.ramhog(input, 80, output, 32, false));
+        int64 nTime = GetTimeMillis() - nStart;
+        nHashTime = i ? min(nHashTime, nTime) : nTime;
+    }
+
+    // keep both pad sets filling for miners, and verify a quarter of the
+    // way into a fill
+    volatile bool fStop = false;
+    boost::thread_group miners;
+    for (int i = 0; i < 2; i++)
+        miners.create_thread(boost::bind(&MineUntilStopped, &pool, &fStop, (unsigned char)(i + 1)));
+    Sleep(nHashTime + nHashTime / 4);
+
+    int64 nStart = GetTimeMillis();
+    BOOST_CHECK(pool.ramhog(input, 80, output, 32, false));
+    int64 nVerifyTime = GetTimeMillis() - nStart;
+
+    fStop = true;
+    miners.join_all();
+
+    BOOST_TEST_MESSAGE("hash " << nHashTime << "ms, verify while mining " << nVerifyTime << "ms");
+    BOOST_CHECK(nVerifyTime < nHashTime + nHashTime / 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,133 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include "ramhogipc.h"
+#include "util.h"
+
+#include <string.h>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(ramhogipc_tests)
+
+#ifndef WIN32
+static boost::filesystem::path TempSocketPath()
+{
+    return boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path("ramhogd-%%%%%%%%.sock");
+}
+
+// Connect and send a request without waiting for the reply
+static int SendRequest(const boost::filesystem::path& path, const CRamhogRequest& request)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.string().c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    BOOST_REQUIRE(fd >= 0);
+    BOOST_REQUIRE(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << request;
+    BOOST_CHECK(WriteRamhogMessage(fd, ss));
+    return fd;
+}
+
+static CRamhogRequest MakeRequest(int nPriority)
+{
+    CRamhogRequest request;
+    request.nPriority = nPriority;
+    for (int i = 0; i < 80; i++)
+        request.vchInput.push_back(i * 7);
+    request.nOutputSize = 32;
+    return request;
+}
+
+// Wait up to five seconds for the server to reach the given counts
+static bool WaitStats(CRamhogServer& server, int nQueued, int nRunning, int nCancelled)
+{
+    int nQueuedNow, nRunningNow, nCancelledNow;
+    for (int i = 0; i < 100; i++)
+    {
+        server.GetStats(nQueuedNow, nRunningNow, nCancelledNow);
+        if (nQueuedNow == nQueued && nRunningNow == nRunning && nCancelledNow == nCancelled)
+            return true;
+        Sleep(50);
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(ramhogipc_roundtrip)
+{
+    CRamhogThreadPool pool(16, 4096, 4096, 1, 2);
+    boost::filesystem::path path = TempSocketPath();
+    CRamhogServer server(&pool, 1);
+    BOOST_REQUIRE(server.Listen(path));
+    boost::thread threadRun(boost::bind(&CRamhogServer::Run, &server));
+
+    CRamhogRequest request = MakeRequest(RAMHOG_PRIORITY_VERIFY);
+    unsigned char hashExpected[32], hash[32];
+    BOOST_CHECK(pool.ramhog(&request.vchInput[0], request.vchInput.size(), hashExpected, 32, false));
+
+    CRamhogClient client(path);
+    for (int fForMiner = 0; fForMiner < 2; fForMiner++)
+    {
+        memset(hash, 0, sizeof(hash));
+        BOOST_CHECK(client.ramhog(&request.vchInput[0], request.vchInput.size(), hash, 32, fForMiner));
+        BOOST_CHECK(memcmp(hash, hashExpected, 32) == 0);
+    }
+
+    // a request the server won't run still gets a reply
+    request.nOutputSize = 0;
+    int fd = SendRequest(path, request);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    CRamhogReply reply;
+    reply.fSuccess = true;
+    BOOST_CHECK(ReadRamhogMessage(fd, ss));
+    ss >> reply;
+    BOOST_CHECK(!reply.fSuccess);
+    close(fd);
+
+    server.Stop();
+    threadRun.join();
+}
+
+BOOST_AUTO_TEST_CASE(ramhogipc_disconnect)
+{
+    // so many iterations that only a cancel ends a hash within the test
+    CRamhogThreadPool pool(16, 4096, 1 << 30, 1, 2);
+    boost::filesystem::path path = TempSocketPath();
+    CRamhogServer server(&pool, 1);
+    BOOST_REQUIRE(server.Listen(path));
+    boost::thread threadRun(boost::bind(&CRamhogServer::Run, &server));
+
+    int fdRunning = SendRequest(path, MakeRequest(RAMHOG_PRIORITY_MINE));
+    BOOST_CHECK(WaitStats(server, 0, 1, 0));
+
+    // the only mining runner is busy, so this one waits in the queue
+    int fdQueued = SendRequest(path, MakeRequest(RAMHOG_PRIORITY_MINE));
+    BOOST_CHECK(WaitStats(server, 1, 1, 0));
+
+    // hanging up drops a queued request without running it...
+    close(fdQueued);
+    BOOST_CHECK(WaitStats(server, 0, 1, 0));
+
+    // ...and stops a running one
+    close(fdRunning);
+    BOOST_CHECK(WaitStats(server, 0, 0, 1));
+
+    server.Stop();
+    threadRun.join();
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
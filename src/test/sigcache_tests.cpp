@@ -0,0 +1,66 @@
+#include <boost/test/unit_test.hpp>
+
+#include "script.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+static vector<unsigned char> MakeSig(int n)
+{
+    vector<unsigned char> vchSig(71, 0x30);
+    vchSig[70] = (unsigned char)n;
+    vchSig[69] = (unsigned char)(n >> 8);
+    return vchSig;
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_get_set)
+{
+    CSignatureCache cache(64 * 1024);
+    vector<unsigned char> vchPubKey(33, 2), vchPubKey2(33, 3);
+    uint64 nHits, nMisses, nEvictions, nEntries;
+
+    BOOST_CHECK_EQUAL(cache.GetMaxEntries(), 2048);
+    BOOST_CHECK(!cache.Get(1, MakeSig(1), vchPubKey));
+    cache.Set(1, MakeSig(1), vchPubKey);
+    BOOST_CHECK(cache.Get(1, MakeSig(1), vchPubKey));
+    // any difference in the hash, signature or key misses
+    BOOST_CHECK(!cache.Get(2, MakeSig(1), vchPubKey));
+    BOOST_CHECK(!cache.Get(1, MakeSig(2), vchPubKey));
+    BOOST_CHECK(!cache.Get(1, MakeSig(1), vchPubKey2));
+
+    // adding the same entry again is a no-op
+    cache.Set(1, MakeSig(1), vchPubKey);
+    cache.GetStats(nHits, nMisses, nEvictions, nEntries);
+    BOOST_CHECK(nHits == 1 && nMisses == 4 && nEvictions == 0 && nEntries == 1);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_eviction)
+{
+    // one bucket per shard
+    CSignatureCache cache(32 * 64);
+    vector<unsigned char> vchPubKey(33, 2);
+    uint64 nHits, nMisses, nEvictions, nEntries;
+
+    BOOST_CHECK_EQUAL(cache.GetMaxEntries(), 64);
+    for (int n = 0; n < 1000; n++)
+        cache.Set(n, MakeSig(n), vchPubKey);
+    cache.GetStats(nHits, nMisses, nEvictions, nEntries);
+    BOOST_CHECK(nEntries <= 64 && nEntries > 32);
+    BOOST_CHECK_EQUAL(nEvictions + nEntries, 1000);
+
+    int nFound = 0;
+    for (int n = 0; n < 1000; n++)
+        if (cache.Get(n, MakeSig(n), vchPubKey))
+            nFound++;
+    BOOST_CHECK_EQUAL(nFound, nEntries);
+
+    // a zero size cache keeps nothing
+    CSignatureCache disabled(0);
+    disabled.Set(1, MakeSig(1), vchPubKey);
+    BOOST_CHECK(!disabled.Get(1, MakeSig(1), vchPubKey));
+    BOOST_CHECK_EQUAL(disabled.GetMaxEntries(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,130 @@
+#include <boost/test/unit_test.hpp>
+
+#include "signedhash.h"
+#include "main.h"
+#include "db.h"
+#include "net.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(signedhash_tests)
+
+static CService ip(uint32_t i)
+{
+    struct in_addr s;
+    s.s_addr = i;
+    return CService(CNetAddr(s), GetDefaultPort());
+}
+
+// A signed hash whose signature isn't the master key's
+static CSignedHash BadSignedHash(int n)
+{
+    CSignedHash signedHash;
+    signedHash.SetHashes(uint256(n), uint256(n + 1000000));
+    signedHash.vchSig.assign(72, (unsigned char)n);
+    return signedHash;
+}
+
+// Commit, as SendMessages does, until hashInv has been through the verifier
+static bool WaitCommitted(const uint256 &hashInv)
+{
+    for (int i = 0; i < 1000 && SignedHash::IsSignedHashPending(hashInv); i++)
+    {
+        Sleep(10);
+        LOCK(cs_main);
+        SignedHash::CommitVerifiedHashes();
+    }
+    return !SignedHash::IsSignedHashPending(hashInv);
+}
+
+BOOST_AUTO_TEST_CASE(signedhash_queue_commit)
+{
+    CNode::ClearBanned();
+    mapArgs["-banscore"] = "10";
+    CAddress addr1(ip(0xa0b0c001));
+    CNode node1(INVALID_SOCKET, addr1, true);
+
+    CSignedHash signedHash = BadSignedHash(1);
+    BOOST_CHECK(SignedHash::QueueSignedHash(signedHash, &node1));
+    BOOST_CHECK(SignedHash::IsSignedHashPending(signedHash.GetHash()));
+    // the same inv again isn't checked twice
+    BOOST_CHECK(!SignedHash::QueueSignedHash(signedHash, &node1));
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), 1);
+
+    // not stored, and its sender penalised
+    BOOST_CHECK(WaitCommitted(signedHash.GetHash()));
+    BOOST_CHECK(!SignedHash::HaveSignedPoWHash(signedHash.idHash));
+    BOOST_CHECK(CNode::IsBanned(addr1));
+    BOOST_CHECK(node1.fDisconnect);
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), 0);
+
+    // once checked it can be queued again
+    BOOST_CHECK(SignedHash::QueueSignedHash(signedHash, NULL));
+    BOOST_CHECK(WaitCommitted(signedHash.GetHash()));
+
+    mapArgs.erase("-banscore");
+    CNode::ClearBanned();
+}
+
+BOOST_AUTO_TEST_CASE(signedhash_pending_limit)
+{
+    CNode::ClearBanned();
+    CNode node1(INVALID_SOCKET, CAddress(ip(0xa0b0c001)), true);
+    CNode node2(INVALID_SOCKET, CAddress(ip(0xa0b0c002)), true);
+
+    for (int n = 0; n < SignedHash::SIGNED_HASH_MAX_PENDING; n++)
+        BOOST_CHECK(SignedHash::QueueSignedHash(BadSignedHash(100 + n), &node1));
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), SignedHash::SIGNED_HASH_MAX_PENDING);
+
+    // node1 has to wait for its hashes to be committed; node2 doesn't
+    CSignedHash signedHashMore = BadSignedHash(99);
+    BOOST_CHECK(!SignedHash::QueueSignedHash(signedHashMore, &node1));
+    BOOST_CHECK(!SignedHash::IsSignedHashPending(signedHashMore.GetHash()));
+    BOOST_CHECK(SignedHash::QueueSignedHash(signedHashMore, &node2));
+
+    for (int n = 0; n < SignedHash::SIGNED_HASH_MAX_PENDING; n++)
+        BOOST_CHECK(WaitCommitted(BadSignedHash(100 + n).GetHash()));
+    BOOST_CHECK(WaitCommitted(signedHashMore.GetHash()));
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), 0);
+    BOOST_CHECK_EQUAL(node2.GetRefCount(), 0);
+
+    CNode::ClearBanned();
+}
+
+BOOST_AUTO_TEST_CASE(signedhash_hashcache_collision)
+{
+    BOOST_CHECK(SignedHash::LoadHashCache());
+
+    // two blocks at the same height: the second takes the slot, the first
+    // is kept outside hashcache.dat
+    uint256 idHash1 = 501, idHash2 = 502, powHash;
+    BOOST_CHECK(SignedHash::UncheckedAddHash(idHash1, uint256(1501), 5));
+    BOOST_CHECK(SignedHash::UncheckedAddHash(idHash2, uint256(1502), 5));
+
+    BOOST_CHECK(SignedHash::GetPoWHash(idHash1, powHash, 5));
+    BOOST_CHECK(powHash == uint256(1501));
+    BOOST_CHECK(SignedHash::GetPoWHash(idHash2, powHash, 5));
+    BOOST_CHECK(powHash == uint256(1502));
+
+    CTxDB txdb("r");
+    BOOST_CHECK(txdb.ReadPoWHash(idHash1, powHash));
+    BOOST_CHECK(powHash == uint256(1501));
+    txdb.Close();
+}
+
+// last, as the verifier can't be started again
+BOOST_AUTO_TEST_CASE(signedhash_stop_verifier)
+{
+    CNode node1(INVALID_SOCKET, CAddress(ip(0xa0b0c001)), true);
+
+    CSignedHash signedHash = BadSignedHash(2);
+    BOOST_CHECK(SignedHash::QueueSignedHash(signedHash, &node1));
+    SignedHash::StopVerifier();
+    BOOST_CHECK(!SignedHash::IsSignedHashPending(signedHash.GetHash()));
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), 0);
+    BOOST_CHECK(!SignedHash::QueueSignedHash(signedHash, &node1));
+    BOOST_CHECK_EQUAL(node1.GetRefCount(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
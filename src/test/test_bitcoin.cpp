@@ -1,16 +1,26 @@
 #define BOOST_TEST_MODULE Bitcoin Test Suite
 #include <boost/test/unit_test.hpp>
 
+#include <boost/filesystem.hpp>
+
 #include "main.h"
 #include "wallet.h"
+#include "db.h"
 #include "checkpoints.h"
 
 CWallet* pwalletMain;
 
 extern bool fPrintToConsole;
 struct TestingSetup {
+    boost::filesystem::path pathTemp;
+
     TestingSetup() {
         fPrintToConsole = true; // don't want to write to debug.log file
+        // databases opened by tests go in a data directory of their own
+        pathTemp = boost::filesystem::temp_directory_path() /
+            boost::filesystem::unique_path("test_shinycoin-%%%%%%%%");
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
         pwalletMain = new CWallet();
         RegisterWallet(pwalletMain);
 
@@ -26,6 +36,8 @@ struct TestingSetup {
     {
         delete pwalletMain;
         pwalletMain = NULL;
+        DBFlush(true);
+        boost::filesystem::remove_all(pathTemp);
     }
 };
 
@@ -0,0 +1,273 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+
+#include "txinfo.h"
+#include "util.h"
+
+using namespace std;
+
+// Each case gets an infostore path of its own, removed afterwards even if
+// the case throws
+struct TxInfoFixture
+{
+    boost::filesystem::path path;
+    CBitcoinAddress addr1, addr2, addr3;
+    TxInfoKey keyName, keyNote;
+
+    TxInfoFixture() :
+        path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("infostore-%%%%%%%%.db3")),
+        addr1(uint160(1)), addr2(uint160(2)), addr3(uint160(3)),
+        keyName(INFO_ID, "n"), keyNote("note")
+    {
+    }
+
+    ~TxInfoFixture()
+    {
+        boost::filesystem::remove(path);
+        boost::filesystem::remove(path.string() + "-wal");
+        boost::filesystem::remove(path.string() + "-shm");
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(txinfo_tests, TxInfoFixture)
+
+BOOST_AUTO_TEST_CASE(txinfo_overlay)
+{
+    CTxInfoStore store(path);
+    BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyName, "alice"))));
+    BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyNote, "one"))));
+
+    CTxInfoOverlay overlay(&store);
+    // checked against the store
+    BOOST_CHECK(!overlay.Process(TxInfoRecord(addr2, CTxInfo(keyName, "alice"))));
+    BOOST_CHECK(!overlay.Process(TxInfoRecord(addr1, CTxInfo(keyName, "bob"))));
+    // and against its own pending writes
+    BOOST_CHECK(overlay.Process(TxInfoRecord(addr2, CTxInfo(keyName, "bob"))));
+    BOOST_CHECK(!overlay.Process(TxInfoRecord(addr2, CTxInfo(keyName, "carol"))));
+    BOOST_CHECK(overlay.Process(TxInfoRecord(addr1, CTxInfo(keyNote, "two"))));
+    BOOST_CHECK_EQUAL(overlay.GetPendingCount(), 2);
+
+    BOOST_CHECK(*overlay.Get(addr1, keyNote) == "two");
+    BOOST_CHECK(*overlay.UniqueAddressWithValue(keyName, "bob") == addr2);
+    BOOST_CHECK(overlay.AddressesWithValue(keyNote, "one").empty());
+
+    // nothing reached the store
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "one");
+    BOOST_CHECK(!store.UniqueAddressWithValue(keyName, "bob"));
+
+    store.BeginTransaction();
+    BOOST_CHECK(overlay.Flush());
+    store.Commit();
+    BOOST_CHECK_EQUAL(overlay.GetPendingCount(), 0);
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "two");
+    BOOST_CHECK(*store.UniqueAddressWithValue(keyName, "bob") == addr2);
+    BOOST_CHECK_EQUAL(store.CountRecords(addr1, keyNote), 2);
+}
+
+BOOST_AUTO_TEST_CASE(txinfo_latest_cache)
+{
+    uint64 nHits, nMisses;
+    unsigned int nEntries;
+
+    CTxInfoStore store(path, 2);
+    BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyNote, "one"))));
+
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "one");
+    BOOST_CHECK(!store.Get(addr2, keyNote));
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "one");
+    BOOST_CHECK(!store.Get(addr2, keyNote));
+    store.GetLatestCacheStats(nHits, nMisses, nEntries);
+    BOOST_CHECK(nHits == 2 && nMisses == 2 && nEntries == 2);
+
+    // written in a transaction: read through until it ends
+    store.BeginTransaction();
+    BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyNote, "two"))));
+    BOOST_CHECK(store.Process(TxInfoRecord(addr2, CTxInfo(keyNote, "two"))));
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "two");
+    BOOST_CHECK(*store.Get(addr2, keyNote) == "two");
+    store.Rollback();
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "one");
+    BOOST_CHECK(!store.Get(addr2, keyNote));
+
+    store.BeginTransaction();
+    BOOST_CHECK(store.Process(TxInfoRecord(addr2, CTxInfo(keyNote, "three"))));
+    store.Commit();
+    BOOST_CHECK(*store.Get(addr2, keyNote) == "three");
+    BOOST_CHECK(store.Undo(TxInfoRecord(addr2, CTxInfo(keyNote, "three"))));
+    BOOST_CHECK(!store.Get(addr2, keyNote));
+
+    // the least recently used key is evicted
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "one");
+    BOOST_CHECK(!store.Get(addr3, keyNote));
+    store.GetLatestCacheStats(nHits, nMisses, nEntries);
+    BOOST_CHECK_EQUAL(nEntries, 2);
+    uint64 nMissesBefore = nMisses;
+    BOOST_CHECK(!store.Get(addr2, keyNote));
+    store.GetLatestCacheStats(nHits, nMisses, nEntries);
+    BOOST_CHECK(nMisses == nMissesBefore + 1);
+}
+
+BOOST_AUTO_TEST_CASE(txinfo_bulk_load)
+{
+    CTxInfoStore store(path);
+    BOOST_CHECK(store.Process(TxInfoRecord(addr2, CTxInfo(keyNote, "stale"))));
+
+    store.BeginBulkLoad();
+    store.BulkInsert(TxInfoRecord(addr1, CTxInfo(keyName, "alice"), uint256(1), 1, 0, 0));
+    store.BulkInsert(TxInfoRecord(addr1, CTxInfo(keyNote, "one"), uint256(1), 1, 0, 1));
+    store.Commit();
+    store.BeginTransaction();
+    store.BulkInsert(TxInfoRecord(addr1, CTxInfo(keyNote, "two"), uint256(2), 1, 0, 0));
+    store.EndBulkLoad();
+
+    BOOST_CHECK(!store.InTransaction());
+    BOOST_CHECK(!store.Get(addr2, keyNote));
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "two");
+    BOOST_CHECK(*store.UniqueAddressWithValue(keyName, "alice") == addr1);
+    BOOST_CHECK_EQUAL(store.CountRecords(addr1, keyNote), 2);
+    vector<TxInfoRecord> vRecords = store.RecordsWithBlockHash(uint256(1));
+    BOOST_CHECK_EQUAL(vRecords.size(), 2);
+    BOOST_CHECK(vRecords[0].addr == addr1 && vRecords[1].info.value == "one" && vRecords[1].indexInfo == 1);
+
+    // and is checked and undone as usual afterwards
+    BOOST_CHECK(!store.Process(TxInfoRecord(addr2, CTxInfo(keyName, "alice"))));
+    BOOST_CHECK(store.Undo(TxInfoRecord(addr1, CTxInfo(keyNote, "two"), uint256(2), 1, 0, 0)));
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "one");
+}
+
+BOOST_AUTO_TEST_CASE(txinfo_paged_queries)
+{
+    CTxInfoStore store(path);
+    BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyName, "alice"))));
+    BOOST_CHECK(store.Process(TxInfoRecord(addr2, CTxInfo(keyName, "alan"))));
+    for (int i = 0; i < 5; i++)
+        BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyNote, strprintf("%d", i)))));
+
+    int64 nCursor = 0;
+    vector<TxInfoRecord> vRecords = store.RecordsWithAddress(addr1, false, nCursor, 4);
+    BOOST_CHECK_EQUAL(vRecords.size(), 4);
+    BOOST_CHECK(vRecords[0].info.value == "alice" && vRecords[3].info.value == "2");
+    vRecords = store.RecordsWithAddress(addr1, false, nCursor, 4);
+    BOOST_CHECK_EQUAL(vRecords.size(), 2);
+    BOOST_CHECK(vRecords[1].info.value == "4");
+    int64 nCursorEnd = nCursor;
+    BOOST_CHECK(store.RecordsWithAddress(addr1, false, nCursor, 4).empty());
+    BOOST_CHECK(nCursor == nCursorEnd);
+
+    nCursor = 0;
+    BOOST_CHECK_EQUAL(store.RecordsWithAddress(addr1, true, nCursor, 100).size(), 2);
+    nCursor = 0;
+    TxInfoValue value("3");
+    vRecords = store.RecordsWithKey(keyNote, &value, false, nCursor, 100);
+    BOOST_CHECK(vRecords.size() == 1 && vRecords[0].addr == addr1 && vRecords[0].info.value == "3");
+    nCursor = 0;
+    BOOST_CHECK_EQUAL(store.RecordsWithKey(keyNote, NULL, true, nCursor, 100).size(), 1);
+
+    nCursor = 0;
+    vRecords = store.RecordsWithKeyPrefix(INFO_ID, "", nCursor, 100);
+    BOOST_CHECK_EQUAL(vRecords.size(), 2);
+    nCursor = 0;
+    BOOST_CHECK_EQUAL(store.RecordsWithKeyPrefix(INFO_NORMAL, "no", nCursor, 100).size(), 1);
+    nCursor = 0;
+    BOOST_CHECK(store.RecordsWithKeyPrefix(INFO_NORMAL, "notes", nCursor, 100).empty());
+}
+
+static void GetOnOtherThread(CTxInfoStore *store, CBitcoinAddress addr, TxInfoKey key, boost::optional<TxInfoValue> *result)
+{
+    *result = store->Get(addr, key);
+}
+
+BOOST_AUTO_TEST_CASE(txinfo_wal_reader)
+{
+    boost::optional<TxInfoValue> result;
+
+    {
+        // no latest value cache, so every Get reads from SQLite
+        CTxInfoStore store(path, 0, true, 1 << 20, 1);
+        BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyNote, "one"))));
+
+        store.BeginTransaction();
+        BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyNote, "two"))));
+        // the writer sees its own records, other threads the last commit
+        BOOST_CHECK(*store.Get(addr1, keyNote) == "two");
+        boost::thread(boost::bind(&GetOnOtherThread, &store, addr1, keyNote, &result)).join();
+        BOOST_CHECK(*result == "one");
+        store.Commit();
+
+        boost::thread(boost::bind(&GetOnOtherThread, &store, addr1, keyNote, &result)).join();
+        BOOST_CHECK(*result == "two");
+    }
+
+    {
+        // back to a rollback journal
+        CTxInfoStore store(path);
+        BOOST_CHECK(*store.Get(addr1, keyNote) == "two");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(txinfo_undo_block)
+{
+    CTxInfoStore store(path);
+    BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyNote, "one"), uint256(1), 1, 0, 0)));
+
+    store.BeginTransaction();
+    BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyNote, "two"), uint256(2), 1, 0, 0)));
+    BOOST_CHECK(store.Process(TxInfoRecord(addr1, CTxInfo(keyNote, "three"), uint256(2), 2, 0, 0)));
+    BOOST_CHECK(store.Process(TxInfoRecord(addr2, CTxInfo(keyName, "bob"), uint256(2), 2, 0, 1)));
+    store.Commit();
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "three");
+
+    // a block setting the same key twice goes back to before the block
+    store.BeginTransaction();
+    BOOST_CHECK_EQUAL(store.UndoBlock(uint256(2)), 3);
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "one");
+    store.Commit();
+    BOOST_CHECK(*store.Get(addr1, keyNote) == "one");
+    BOOST_CHECK(!store.Get(addr2, keyName));
+    BOOST_CHECK(!store.UniqueAddressWithValue(keyName, "bob"));
+    BOOST_CHECK_EQUAL(store.CountRecords(addr1, keyNote), 1);
+
+    BOOST_CHECK_EQUAL(store.UndoBlock(uint256(2)), 0);
+    BOOST_CHECK_EQUAL(store.UndoBlock(uint256(1)), 1);
+    BOOST_CHECK(!store.Get(addr1, keyNote));
+}
+
+BOOST_AUTO_TEST_CASE(txinfo_migrate_text_schema)
+{
+    CBitcoinAddress addr(uint160(7));
+    uint256 blockHash(12345);
+
+    {
+        // the version 1 table, with text addresses and block hashes
+        SQLite::Database db(path.string(), SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE);
+        db.exec("CREATE TABLE TxDbEntry (id INTEGER PRIMARY KEY AUTOINCREMENT, is_latest INTEGER, address TEXT, "
+                "key_type INTEGER, key TEXT, value TEXT, block_hash TEXT, "
+                "index_tx INTEGER, index_txin INTEGER, index_info INTEGER)");
+        db.exec("INSERT INTO TxDbEntry VALUES (1, 0, '" + addr.ToString() + "', 0, 'note', 'old', '" +
+                blockHash.GetHex() + "', 1, 0, 0)");
+        db.exec("INSERT INTO TxDbEntry VALUES (2, 1, '" + addr.ToString() + "', 0, 'note', 'new', '" +
+                blockHash.GetHex() + "', 2, 0, 0)");
+    }
+
+    {
+        CTxInfoStore store(path);
+        BOOST_CHECK(*store.Get(addr, keyNote) == "new");
+        vector<TxInfoRecord> vRecords = store.RecordsWithAddress(addr);
+        BOOST_CHECK_EQUAL(vRecords.size(), 2);
+        BOOST_CHECK(vRecords[0].blockHash == blockHash && vRecords[1].indexTx == 2);
+
+        // new records go after the converted ones
+        BOOST_CHECK(store.Process(TxInfoRecord(addr, CTxInfo(keyNote, "newer"))));
+        BOOST_CHECK(*store.Get(addr, keyNote) == "newer");
+        BOOST_CHECK(store.Undo(TxInfoRecord(addr, CTxInfo(keyNote, "newer"))));
+        BOOST_CHECK(*store.Get(addr, keyNote) == "new");
+    }
+
+    {
+        SQLite::Database db(path.string(), SQLITE_OPEN_READONLY);
+        BOOST_CHECK(!db.tableExists("TxDbEntry"));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
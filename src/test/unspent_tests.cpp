@@ -0,0 +1,122 @@
+#include <boost/test/unit_test.hpp>
+
+#include "unspent.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(unspent_tests)
+
+static CTransaction MakeTx(const uint256& hashPrev, int nOutputs, bool fCoinStake=false)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, 0);
+    if (fCoinStake)
+        tx.vout.push_back(CTxOut());
+    for (int i = 0; i < nOutputs; i++)
+        tx.vout.push_back(CTxOut((i + 1) * COIN, CScript() << OP_TRUE));
+    if (fCoinStake)
+        tx.vout[0].SetEmpty();
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(unspent_connect_disconnect)
+{
+    CUnspentCache cache(100, false);
+    CUnspentOutput unspent;
+
+    CTransaction txA = MakeTx(0, 2);
+    CDiskTxPos posA(1, 100, 200);
+    cache.ConnectTx(txA, posA, 10);
+    BOOST_CHECK(cache.Get(COutPoint(txA.GetHash(), 1), unspent));
+    BOOST_CHECK(unspent.txout == txA.vout[1]);
+    BOOST_CHECK(unspent.pos == posA);
+    BOOST_CHECK_EQUAL(unspent.nHeight, 10);
+    BOOST_CHECK_EQUAL(unspent.nTime, txA.nTime);
+    BOOST_CHECK_EQUAL(unspent.nFlags, 0U);
+    BOOST_CHECK(!cache.Get(COutPoint(txA.GetHash(), 2), unspent));
+
+    // spending txA's first output leaves its second
+    CTransaction txB = MakeTx(txA.GetHash(), 1);
+    cache.ConnectTx(txB, CDiskTxPos(1, 300, 400), 11);
+    BOOST_CHECK(!cache.Get(COutPoint(txA.GetHash(), 0), unspent));
+    BOOST_CHECK(cache.Get(COutPoint(txA.GetHash(), 1), unspent));
+    BOOST_CHECK(cache.Get(COutPoint(txB.GetHash(), 0), unspent));
+
+    cache.DisconnectTx(txB);
+    BOOST_CHECK(!cache.Get(COutPoint(txB.GetHash(), 0), unspent));
+
+    // a coinstake's empty marker output is not an output to spend
+    CTransaction txStake = MakeTx(txA.GetHash(), 1, true);
+    BOOST_CHECK(txStake.IsCoinStake());
+    cache.ConnectTx(txStake, CDiskTxPos(2, 100, 200), 12);
+    BOOST_CHECK(!cache.Get(COutPoint(txStake.GetHash(), 0), unspent));
+    BOOST_CHECK(cache.Get(COutPoint(txStake.GetHash(), 1), unspent));
+    BOOST_CHECK_EQUAL(unspent.nFlags, (unsigned int)UNSPENT_COINSTAKE);
+}
+
+BOOST_AUTO_TEST_CASE(unspent_flush)
+{
+    CUnspentCache cache(4, false);
+    CUnspentOutput unspent;
+
+    CTransaction txA = MakeTx(0, 3);
+    cache.ConnectTx(txA, CDiskTxPos(1, 100, 200), 1);
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 4U);
+    BOOST_CHECK(cache.IsFull());
+
+    // the erased input goes, the outputs stay
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetDirtyCount(), 0U);
+    BOOST_CHECK(!cache.IsFull());
+    BOOST_CHECK(cache.Get(COutPoint(txA.GetHash(), 2), unspent));
+
+    // past the limit, a flush empties the cache
+    CTransaction txB = MakeTx(txA.GetHash(), 3);
+    cache.ConnectTx(txB, CDiskTxPos(1, 300, 400), 2);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!cache.Get(COutPoint(txB.GetHash(), 0), unspent));
+
+    uint64 nHits, nMisses, nEntries;
+    cache.GetStats(nHits, nMisses, nEntries);
+    BOOST_CHECK_EQUAL(nHits, 1U);
+    BOOST_CHECK_EQUAL(nMisses, 1U);
+    BOOST_CHECK_EQUAL(nEntries, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(unspent_database)
+{
+    CUnspentOutput unspent;
+    CTransaction txA = MakeTx(0, 3);
+    CTransaction txB = MakeTx(txA.GetHash(), 1);
+    {
+        // small enough that each flush empties it, so reads go to unspent.dat
+        CUnspentCache cache(2);
+        BOOST_CHECK(!cache.Get(COutPoint(txA.GetHash(), 0), unspent));
+        cache.ConnectTx(txA, CDiskTxPos(1, 100, 200), 1);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(cache.Get(COutPoint(txA.GetHash(), 2), unspent));
+        BOOST_CHECK(unspent.txout == txA.vout[2]);
+        BOOST_CHECK_EQUAL(unspent.nHeight, 1);
+
+        cache.ConnectTx(txB, CDiskTxPos(1, 300, 400), 2);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(!cache.Get(COutPoint(txA.GetHash(), 0), unspent));
+        BOOST_CHECK(cache.Get(COutPoint(txB.GetHash(), 0), unspent));
+    }
+
+    // a new cache reads what the last one wrote back
+    CUnspentCache cache;
+    BOOST_CHECK(cache.Get(COutPoint(txA.GetHash(), 1), unspent));
+    BOOST_CHECK(!cache.Get(COutPoint(txA.GetHash(), 0), unspent));
+    cache.DisconnectTx(txB);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!cache.Get(COutPoint(txB.GetHash(), 0), unspent));
+
+    // closed, it no longer reads unspent.dat, only what it holds
+    cache.Close();
+    BOOST_CHECK(cache.Get(COutPoint(txA.GetHash(), 1), unspent));
+    BOOST_CHECK(!cache.Get(COutPoint(txA.GetHash(), 2), unspent));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -101,43 +101,323 @@ std::string CTxInfo::ToString() const
 
 //------------------------------------------
 
+// Addresses are stored as their version byte and hash160, block hashes as their 32 raw bytes
+static std::vector<unsigned char> AddressKey(const CBitcoinAddress &addr)
+{
+    return addr.GetVersionedData();
+}
+
+static void BindAddress(SQLite::Statement &query, int index, const std::vector<unsigned char> &vchAddr)
+{
+    query.bind(index, vchAddr.empty() ? NULL : (const void *)&vchAddr[0], vchAddr.size());
+}
+
+static void BindBlockHash(SQLite::Statement &query, int index, uint256 blockHash)
+{
+    query.bind(index, (const void *)blockHash.begin(), blockHash.size());
+}
+
+static CBitcoinAddress GetAddressColumn(SQLite::Statement &query, int index)
+{
+    SQLite::Column column = query.getColumn(index);
+    CBitcoinAddress addr;
+    addr.SetVersionedData((const unsigned char *)column.getBlob(), column.getBytes());
+    return addr;
+}
+
+static uint256 GetBlockHashColumn(SQLite::Statement &query, int index)
+{
+    SQLite::Column column = query.getColumn(index);
+    uint256 blockHash = 0;
+    if (column.getBytes() == (int)blockHash.size())
+        memcpy(blockHash.begin(), column.getBlob(), blockHash.size());
+    return blockHash;
+}
+
+// Reads "id, address, key_type, key, value, block_hash, index_tx, index_txin, index_info" rows
+static std::vector<TxInfoRecord> GetRecordPage(SQLite::Statement &query, int64 &nCursor)
+{
+    std::vector<TxInfoRecord> vecRecords;
+    while (query.executeStep())
+    {
+        nCursor = query.getColumn(0).getInt64();
+        CBitcoinAddress address = GetAddressColumn(query, 1);
+        int keyType = query.getColumn(2);
+        std::string keyString = query.getColumn(3);
+        std::string valueString = query.getColumn(4);
+        uint256 blockHash = GetBlockHashColumn(query, 5);
+        int indexTx = query.getColumn(6);
+        int indexTxIn = query.getColumn(7);
+        int indexInfo = query.getColumn(8);
+        
+        vecRecords.push_back(TxInfoRecord(address, CTxInfo(TxInfoKey((TxInfoType)keyType, keyString), valueString),
+                                          blockHash, indexTx, indexTxIn, indexInfo));
+    }
+    return vecRecords;
+}
+
+/** Resets a cached statement on leaving scope, so that it doesn't hold a read lock. */
+class CStatementReset
+{
+private:
+    SQLite::Statement &query;
+public:
+    explicit CStatementReset(SQLite::Statement &queryIn) : query(queryIn) {}
+    ~CStatementReset() { query.reset(); }
+};
+
 void CTxInfoStore::Initialize()
 {
-    db.exec("CREATE TABLE IF NOT EXISTS TxDbEntry ("
+    int nVersion = db.execAndGet("PRAGMA user_version");
+    if (nVersion == 2)
+        db.exec("ALTER TABLE TxInfoEntry ADD COLUMN prev_latest_id INTEGER");
+    
+    CreateTable();
+    CreateIndexes();
+    
+    if (db.tableExists("TxDbEntry"))
+        MigrateTxDbEntry();
+    if (nVersion < TXINFO_STORE_VERSION)
+        FillPrevLatest();
+    
+    db.exec(strprintf("PRAGMA user_version=%d", TXINFO_STORE_VERSION));
+}
+
+void CTxInfoStore::CreateTable()
+{
+    db.exec("CREATE TABLE IF NOT EXISTS TxInfoEntry ("
             "    id INTEGER PRIMARY KEY AUTOINCREMENT,"
-            "    is_latest ls tesINTEGER,"
-            "    address TEXT,"
+            "    is_latest INTEGER,"
+            "    address BLOB,"
             "    key_type INTEGER,"
             "    key TEXT,"
             "    value TEXT,"
-            "    block_hash TEXT,"
+            "    block_hash BLOB,"
             "    index_tx INTEGER,"
             "    index_txin INTEGER,"
-            "    index_info INTEGER)");
+            "    index_info INTEGER,"
+            "    prev_latest_id INTEGER)");    // the record this one replaced as latest, or 0
+}
+
+void CTxInfoStore::CreateIndexes()
+{
+    db.exec("CREATE INDEX IF NOT EXISTS address_key_index ON TxInfoEntry (address, key_type, key, is_latest);");
+    db.exec("CREATE INDEX IF NOT EXISTS key_value_index   ON TxInfoEntry (key_type, key, value);");
+    db.exec("CREATE INDEX IF NOT EXISTS block_hash_index  ON TxInfoEntry (block_hash);");
+}
+
+void CTxInfoStore::FillPrevLatest()
+{
+    SQLite::Transaction transaction(db);
+    db.exec("UPDATE TxInfoEntry SET prev_latest_id=COALESCE("
+            "    (SELECT MAX(prev.id) FROM TxInfoEntry prev "
+            "     WHERE prev.address=TxInfoEntry.address AND prev.key_type=TxInfoEntry.key_type "
+            "       AND prev.key=TxInfoEntry.key AND prev.id<TxInfoEntry.id), 0) "
+            "WHERE prev_latest_id IS NULL");
+    transaction.commit();
+}
+
+void CTxInfoStore::MigrateTxDbEntry()
+{
+    printf("CTxInfoStore : converting the infostore to version %d\n", TXINFO_STORE_VERSION);
+    
+    SQLite::Transaction transaction(db);
+    {
+        SQLite::Statement select(db, "SELECT id, is_latest, address, key_type, key, value, "
+                                 "       block_hash, index_tx, index_txin, index_info "
+                                 "FROM TxDbEntry ORDER BY id");
+        SQLite::Statement insert(db, "INSERT INTO TxInfoEntry (id, is_latest, address, key_type, key, value, "
+                                 "                         block_hash, index_tx, index_txin, index_info) "
+                                 "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+        int count = 0;
+        while (select.executeStep())
+        {
+            std::string addressString = select.getColumn(2);
+            std::string keyString = select.getColumn(4);
+            std::string valueString = select.getColumn(5);
+            std::string blockHashString = select.getColumn(6);
+            uint256 blockHash;
+            blockHash.SetHex(blockHashString);
+            
+            insert.reset();
+            insert.bind(1, (sqlite3_int64)select.getColumn(0).getInt64());
+            insert.bind(2, (int)select.getColumn(1));
+            BindAddress(insert, 3, AddressKey(CBitcoinAddress(addressString)));
+            insert.bind(4, (int)select.getColumn(3));
+            insert.bind(5, keyString);
+            insert.bind(6, valueString);
+            BindBlockHash(insert, 7, blockHash);
+            insert.bind(8, (int)select.getColumn(7));
+            insert.bind(9, (int)select.getColumn(8));
+            insert.bind(10, (int)select.getColumn(9));
+            insert.exec();
+            count++;
+        }
+        printf("CTxInfoStore : converted %d records\n", count);
+    }
+    db.exec("DROP TABLE TxDbEntry");
+    transaction.commit();
+}
+
+static void SetCachePragmas(SQLite::Database &database, int64 nMmapSize, int nPageCacheMB)
+{
+    if (nMmapSize > 0)
+        database.exec(strprintf("PRAGMA mmap_size=%" PRI64d, nMmapSize));
+    if (nPageCacheMB > 0)
+        database.exec(strprintf("PRAGMA cache_size=%d", -1024 * nPageCacheMB));   // negative: in KiB
+}
+
+void CTxInfoStore::Configure(const boost::filesystem::path &path, int64 nMmapSize, int nPageCacheMB)
+{
+    if (fWAL)
+    {
+        db.exec("PRAGMA journal_mode=WAL");
+        // a crash may lose the last commits but can't corrupt the file
+        db.exec("PRAGMA synchronous=NORMAL");
+        pdbRead = new SQLite::Database(path.string(), SQLITE_OPEN_READONLY);
+    }
+    else
+        db.exec("PRAGMA journal_mode=DELETE");
+    
+    SetCachePragmas(db, nMmapSize, nPageCacheMB);
+    if (pdbRead)
+        SetCachePragmas(*pdbRead, nMmapSize, nPageCacheMB);
+}
+
+SQLite::Statement &CTxInfoStore::Prepare(SQLite::Database &database, std::map<std::string, SQLite::Statement *> &mapCache,
+                                         const char *pszQuery)
+{
+    std::map<std::string, SQLite::Statement *>::iterator it = mapCache.find(pszQuery);
+    if (it == mapCache.end())
+        it = mapCache.insert(std::make_pair(std::string(pszQuery), new SQLite::Statement(database, pszQuery))).first;
+    it->second->reset();
+    return *it->second;
+}
+
+SQLite::Statement &CTxInfoStore::Prepare(const char *pszQuery)
+{
+    return Prepare(db, mapStatements, pszQuery);
+}
+
+/** Locks and prepares queries on the connection a read should use: the
+ * read-only one, unless there is none or the caller is writing and must
+ * see its own uncommitted records.
+ */
+class CTxInfoStore::CReader
+{
+private:
+    CTxInfoStore *store;
+    bool fReadConnection;
+    
+public:
+    explicit CReader(CTxInfoStore *storeIn) : store(storeIn)
+    {
+        {
+            LOCK(store->cs_store);
+            fReadConnection = store->pdbRead &&
+                !(store->curTransaction && store->idWriter == boost::this_thread::get_id());
+        }
+        if (fReadConnection)
+            store->cs_read.lock();
+        else
+            store->cs_store.lock();
+    }
+    
+    ~CReader()
+    {
+        if (fReadConnection)
+            store->cs_read.unlock();
+        else
+            store->cs_store.unlock();
+    }
+    
+    SQLite::Statement &Prepare(const char *pszQuery)
+    {
+        if (fReadConnection)
+            return CTxInfoStore::Prepare(*store->pdbRead, store->mapReadStatements, pszQuery);
+        return store->Prepare(pszQuery);
+    }
+};
+
+CTxInfoStore::LatestKey CTxInfoStore::MakeLatestKey(const std::vector<unsigned char> &vchAddr, const TxInfoKey &key)
+{
+    return std::make_pair(vchAddr, std::make_pair(key.type, key.keyString));
+}
+
+void CTxInfoStore::CacheLatest(const LatestKey &latestKey, const boost::optional<TxInfoValue> &value)
+{
+    if (nLatestCacheSize == 0)
+        return;
+    
+    std::map<LatestKey, LatestList::iterator>::iterator mi = mapLatest.find(latestKey);
+    if (mi != mapLatest.end())
+        listLatest.erase(mi->second);
+    listLatest.push_front(std::make_pair(latestKey, value));
+    mapLatest[latestKey] = listLatest.begin();
+    
+    while (listLatest.size() > nLatestCacheSize)
+    {
+        mapLatest.erase(listLatest.back().first);
+        listLatest.pop_back();
+    }
+}
+
+void CTxInfoStore::ForgetDirtyLatest()
+{
+    // committed or rolled back, the cached values for these keys may be stale
+    for (std::set<LatestKey>::const_iterator it = setLatestDirty.begin(); it != setLatestDirty.end(); ++it)
+    {
+        std::map<LatestKey, LatestList::iterator>::iterator mi = mapLatest.find(*it);
+        if (mi == mapLatest.end())
+            continue;
+        listLatest.erase(mi->second);
+        mapLatest.erase(mi);
+    }
+    setLatestDirty.clear();
+    nLatestGeneration++;
+}
+
+void CTxInfoStore::GetLatestCacheStats(uint64 &nHits, uint64 &nMisses, unsigned int &nEntries) const
+{
+    LOCK(cs_store);
+    nHits = nLatestHits;
+    nMisses = nLatestMisses;
+    nEntries = mapLatest.size();
+}
+
+void CTxInfoStore::ClearStatements()
+{
+    for (std::map<std::string, SQLite::Statement *>::iterator it = mapStatements.begin(); it != mapStatements.end(); ++it)
+        delete it->second;
+    mapStatements.clear();
     
-    db.exec("CREATE INDEX IF NOT EXISTS address_index    ON TxDbEntry (address);");
-    db.exec("CREATE INDEX IF NOT EXISTS key_index        ON TxDbEntry (key_type, key);");
-    db.exec("CREATE INDEX IF NOT EXISTS value_index      ON TxDbEntry (value);");
-    db.exec("CREATE INDEX IF NOT EXISTS block_hash_index ON TxDbEntry (block_hash);");
+    LOCK(cs_read);
+    for (std::map<std::string, SQLite::Statement *>::iterator it = mapReadStatements.begin(); it != mapReadStatements.end(); ++it)
+        delete it->second;
+    mapReadStatements.clear();
 }
 
 
 bool CTxInfoStore::InTransaction() const
 {
+    LOCK(cs_store);
     return curTransaction != NULL;
 }
 
 void CTxInfoStore::BeginTransaction()
 {
+    LOCK(cs_store);
     if (InTransaction())
         throw std::runtime_error("Database view already has a transaction");
     
     byteEstimate = 0;
     curTransaction = new SQLite::Transaction(db);
+    idWriter = boost::this_thread::get_id();
 }
 
 void CTxInfoStore::Commit()
 {
+    LOCK(cs_store);
     if (!InTransaction())
         throw std::runtime_error("Can't Commit() without a transaction");
     
@@ -145,10 +425,12 @@ void CTxInfoStore::Commit()
     delete curTransaction;
     curTransaction = NULL;
     byteEstimate = 0;
+    ForgetDirtyLatest();
 }
 
 unsigned int CTxInfoStore::GetCommitByteEstimate() const
 {
+    LOCK(cs_store);
     if (!InTransaction())
         return 0;
     
@@ -157,12 +439,14 @@ unsigned int CTxInfoStore::GetCommitByteEstimate() const
 
 void CTxInfoStore::Rollback()
 {
+    LOCK(cs_store);
     if (!InTransaction())
         throw std::runtime_error("Can't Rollback() without a transaction");
     
     delete curTransaction;
     curTransaction = NULL;
     byteEstimate = 0;
+    ForgetDirtyLatest();
 }
 
 
@@ -172,76 +456,109 @@ bool CTxInfoStore::_Process(const TxInfoRecord &infoRecord, std::string &reason)
     if (!IsValid(infoRecord, reason))
         return false;
     
+    std::vector<unsigned char> vchAddr = AddressKey(infoRecord.addr);
+    setLatestDirty.insert(MakeLatestKey(vchAddr, infoRecord.info.key));
+    
+    sqlite3_int64 prevLatestId = 0;
     {
-        SQLite::Statement query(db, "UPDATE TxDbEntry "
-                                "SET is_latest=0 "
-                                "WHERE address=? AND key_type=? AND key=?");
-        query.bind(1, infoRecord.addr.ToString());
+        SQLite::Statement &query = Prepare("SELECT id "
+                                           "FROM TxInfoEntry "
+                                           "WHERE address=? AND key_type=? AND key=? AND is_latest=1");
+        CStatementReset reset(query);
+        BindAddress(query, 1, vchAddr);
         query.bind(2, infoRecord.info.key.type);
         query.bind(3, infoRecord.info.key.keyString);
+        if (query.executeStep())
+            prevLatestId = query.getColumn(0).getInt64();
+    }
+    
+    if (prevLatestId)
+    {
+        SQLite::Statement &query = Prepare("UPDATE TxInfoEntry SET is_latest=0 WHERE id=?");
+        CStatementReset reset(query);
+        query.bind(1, prevLatestId);
         query.exec();
     }
     
     {
-        SQLite::Statement query(db,
-                                "INSERT INTO TxDbEntry (is_latest, address, key_type, key, value, "
-                                "                       block_hash, index_tx, index_txin, index_info) "
-                                "VALUES (1, ?, ?, ?, ?, ?, ?, ?, ?)");
-        query.bind(1, infoRecord.addr.ToString());
+        SQLite::Statement &query = Prepare("INSERT INTO TxInfoEntry (is_latest, address, key_type, key, value, "
+                                           "                         block_hash, index_tx, index_txin, index_info, prev_latest_id) "
+                                           "VALUES (1, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+        CStatementReset reset(query);
+        BindAddress(query, 1, vchAddr);
         query.bind(2, infoRecord.info.key.type);
         query.bind(3, infoRecord.info.key.keyString);
         query.bind(4, infoRecord.info.value);
-        query.bind(5, infoRecord.blockHash.GetHex(64));
+        BindBlockHash(query, 5, infoRecord.blockHash);
         query.bind(6, infoRecord.indexTx);
         query.bind(7, infoRecord.indexTxIn);
         query.bind(8, infoRecord.indexInfo);
+        query.bind(9, prevLatestId);
         query.exec();
     }
     
-    byteEstimate += 4 + 1 + infoRecord.addr.ToString().size() + 1 + infoRecord.info.key.keyString.size() + infoRecord.info.value.size() + infoRecord.blockHash.GetHex(64).size() + 12;
+    byteEstimate += 4 + 1 + vchAddr.size() + 1 + infoRecord.info.key.keyString.size() + infoRecord.info.value.size() + sizeof(uint256) + 20;
     
     return true;
 }
 
 bool CTxInfoStore::_Undo(const TxInfoRecord &infoRecord, std::string &reason)
 {
+    std::vector<unsigned char> vchAddr = AddressKey(infoRecord.addr);
+    
+    sqlite3_int64 id, prevLatestId;
     {
-        SQLite::Statement query(db, "DELETE FROM TxDbEntry "
-                                "WHERE is_latest=1 AND address=? AND key_type=? AND key=? AND value=? "
-                                "  AND block_hash=? AND index_tx=? AND index_txin=? AND index_info=?");
-        query.bind(1, infoRecord.addr.ToString());
+        SQLite::Statement &query = Prepare("SELECT id, prev_latest_id "
+                                           "FROM TxInfoEntry "
+                                           "WHERE is_latest=1 AND address=? AND key_type=? AND key=? AND value=? "
+                                           "  AND block_hash=? AND index_tx=? AND index_txin=? AND index_info=?");
+        CStatementReset reset(query);
+        BindAddress(query, 1, vchAddr);
         query.bind(2, infoRecord.info.key.type);
         query.bind(3, infoRecord.info.key.keyString);
         query.bind(4, infoRecord.info.value);
-        query.bind(5, infoRecord.blockHash.GetHex(64));
+        BindBlockHash(query, 5, infoRecord.blockHash);
         query.bind(6, infoRecord.indexTx);
         query.bind(7, infoRecord.indexTxIn);
         query.bind(8, infoRecord.indexInfo);
-        int rowsChanged = query.exec();
         
-        if (rowsChanged == 0)
+        if (!query.executeStep())
         {
             reason = "Nothing to undo";
             return false;
         }
+        id = query.getColumn(0).getInt64();
+        prevLatestId = query.getColumn(1).getInt64();
     }
     
+    _UndoEntry(id, prevLatestId, MakeLatestKey(vchAddr, infoRecord.info.key));
+    return true;
+}
+
+void CTxInfoStore::_UndoEntry(int64 id, int64 prevLatestId, const LatestKey &latestKey)
+{
+    setLatestDirty.insert(latestKey);
+    
     {
-        SQLite::Statement query(db, "UPDATE TxDbEntry "
-                                "SET is_latest=1 "
-                                "WHERE id=(SELECT MAX(id) FROM TxDbEntry WHERE address=? AND key_type=? AND key=?)");
-        query.bind(1, infoRecord.addr.ToString());
-        query.bind(2, infoRecord.info.key.type);
-        query.bind(3, infoRecord.info.key.keyString);
+        SQLite::Statement &query = Prepare("DELETE FROM TxInfoEntry WHERE id=?");
+        CStatementReset reset(query);
+        query.bind(1, (sqlite3_int64)id);
         query.exec();
     }
     
-    return true;
+    if (prevLatestId)
+    {
+        SQLite::Statement &query = Prepare("UPDATE TxInfoEntry SET is_latest=1 WHERE id=?");
+        CStatementReset reset(query);
+        query.bind(1, (sqlite3_int64)prevLatestId);
+        query.exec();
+    }
 }
 
 
 bool CTxInfoStore::Process(const TxInfoRecord &infoRecord, std::string &reason)
 {
+    LOCK(cs_store);
     if (InTransaction())
         return _Process(infoRecord, reason);
     
@@ -256,6 +573,7 @@ bool CTxInfoStore::Process(const TxInfoRecord &infoRecord, std::string &reason)
 
 bool CTxInfoStore::Undo(const TxInfoRecord &infoRecord, std::string &reason)
 {
+    LOCK(cs_store);
     if (InTransaction())
         return _Undo(infoRecord, reason);
     
@@ -268,31 +586,105 @@ bool CTxInfoStore::Undo(const TxInfoRecord &infoRecord, std::string &reason)
     return false;
 }
 
+unsigned int CTxInfoStore::UndoBlock(uint256 blockHash)
+{
+    LOCK(cs_store);
+    if (InTransaction())
+        return _UndoBlock(blockHash);
+    
+    CTxInfoView view(this);
+    unsigned int nUndone = _UndoBlock(blockHash);
+    view.Commit();
+    return nUndone;
+}
+
+unsigned int CTxInfoStore::_UndoBlock(uint256 blockHash)
+{
+    // The block's records carry the ids they replaced as latest, so the
+    // undo is a delete and an update by primary key per record
+    std::vector<std::pair<std::pair<int64, int64>, LatestKey> > vEntries;
+    {
+        SQLite::Statement &query = Prepare("SELECT id, prev_latest_id, address, key_type, key "
+                                           "FROM TxInfoEntry "
+                                           "WHERE block_hash=? "
+                                           "ORDER BY id DESC");
+        CStatementReset reset(query);
+        BindBlockHash(query, 1, blockHash);
+        while (query.executeStep())
+        {
+            SQLite::Column address = query.getColumn(2);
+            const unsigned char *pchAddress = (const unsigned char *)address.getBlob();
+            std::string keyString = query.getColumn(4);
+            LatestKey latestKey = std::make_pair(std::vector<unsigned char>(pchAddress, pchAddress + address.getBytes()),
+                                                 std::make_pair((unsigned char)(int)query.getColumn(3), keyString));
+            vEntries.push_back(std::make_pair(std::make_pair((int64)query.getColumn(0).getInt64(),
+                                                             (int64)query.getColumn(1).getInt64()),
+                                              latestKey));
+        }
+    }
+    
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+        _UndoEntry(vEntries[i].first.first, vEntries[i].first.second, vEntries[i].second);
+    
+    return vEntries.size();
+}
+
 
 boost::optional<TxInfoValue> CTxInfoStore::Get(const CBitcoinAddress &addr, const TxInfoKey &key)
 {
-    SQLite::Statement query(db, "SELECT value "
-                            "FROM TxDbEntry "
-                            "WHERE id=(SELECT MAX(id) FROM TxDbEntry WHERE address=? AND key_type=? AND key=?)");
-    query.bind(1, addr.ToString());
-    query.bind(2, key.type);
-    query.bind(3, key.keyString);
+    std::vector<unsigned char> vchAddr = AddressKey(addr);
+    LatestKey latestKey = MakeLatestKey(vchAddr, key);
+    unsigned int nGeneration;
+    {
+        LOCK(cs_store);
+        if (!setLatestDirty.count(latestKey))
+        {
+            std::map<LatestKey, LatestList::iterator>::iterator mi = mapLatest.find(latestKey);
+            if (mi != mapLatest.end())
+            {
+                nLatestHits++;
+                listLatest.splice(listLatest.begin(), listLatest, mi->second);
+                return mi->second->second;
+            }
+        }
+        nLatestMisses++;
+        nGeneration = nLatestGeneration;
+    }
     
-    if (query.executeStep())
+    boost::optional<TxInfoValue> result;
     {
-        std::string value = query.getColumn(0);
-        return boost::optional<TxInfoValue>(value);
+        CReader reader(this);
+        SQLite::Statement &query = reader.Prepare("SELECT value "
+                                                  "FROM TxInfoEntry "
+                                                  "WHERE address=? AND key_type=? AND key=? AND is_latest=1");
+        CStatementReset reset(query);
+        BindAddress(query, 1, vchAddr);
+        query.bind(2, key.type);
+        query.bind(3, key.keyString);
+        
+        if (query.executeStep())
+        {
+            std::string value = query.getColumn(0);
+            result = value;
+        }
     }
     
-    return boost::optional<TxInfoValue>();
+    // an uncommitted value must not outlive a rollback, nor one read
+    // before a commit outlive the commit
+    LOCK(cs_store);
+    if (!setLatestDirty.count(latestKey) && nGeneration == nLatestGeneration)
+        CacheLatest(latestKey, result);
+    return result;
 }
 
 
 std::vector<CBitcoinAddress> CTxInfoStore::AddressesWithValue(const TxInfoKey &key, const TxInfoValue &value)
 {
-    SQLite::Statement query(db, "SELECT address "
-                            "FROM TxDbEntry "
-                            "WHERE key_type=? and key=? and value=? and is_latest=1");
+    CReader reader(this);
+    SQLite::Statement &query = reader.Prepare("SELECT address "
+                                              "FROM TxInfoEntry "
+                                              "WHERE key_type=? and key=? and value=? and is_latest=1");
+    CStatementReset reset(query);
     query.bind(1, key.type);
     query.bind(2, key.keyString);
     query.bind(3, value);
@@ -301,8 +693,7 @@ std::vector<CBitcoinAddress> CTxInfoStore::AddressesWithValue(const TxInfoKey &k
     
     while (query.executeStep())
     {
-        std::string encodedAddress = query.getColumn(0);
-        result.push_back(CBitcoinAddress(encodedAddress));
+        result.push_back(GetAddressColumn(query, 0));
     }
     
     return result;
@@ -324,10 +715,12 @@ boost::optional<CBitcoinAddress> CTxInfoStore::UniqueAddressWithValue(const TxIn
 
 std::vector<TxInfoRecord> CTxInfoStore::RecordsWithAddress(const CBitcoinAddress &addr)
 {
-    SQLite::Statement query(db, "SELECT key_type, key, value, block_hash, index_tx, index_txin, index_info "
-                            "FROM TxDbEntry "
-                            "WHERE address=?");
-    query.bind(1, addr.ToString());
+    CReader reader(this);
+    SQLite::Statement &query = reader.Prepare("SELECT key_type, key, value, block_hash, index_tx, index_txin, index_info "
+                                              "FROM TxInfoEntry "
+                                              "WHERE address=?");
+    CStatementReset reset(query);
+    BindAddress(query, 1, AddressKey(addr));
 
     std::vector<TxInfoRecord> vecRecords;
     while (query.executeStep())
@@ -335,7 +728,7 @@ std::vector<TxInfoRecord> CTxInfoStore::RecordsWithAddress(const CBitcoinAddress
         int keyType = query.getColumn(0);
         std::string keyString = query.getColumn(1);
         std::string valueString = query.getColumn(2);
-        std::string blockHashString = query.getColumn(3);
+        uint256 blockHash = GetBlockHashColumn(query, 3);
         int indexTx = query.getColumn(4);
         int indexTxIn = query.getColumn(5);
         int indexInfo = query.getColumn(6);
@@ -343,9 +736,6 @@ std::vector<TxInfoRecord> CTxInfoStore::RecordsWithAddress(const CBitcoinAddress
         TxInfoKey key((TxInfoType)keyType, keyString);
         TxInfoValue value(valueString);
         CTxInfo info(key, value);
-
-        uint256 blockHash;
-        blockHash.SetHex(blockHashString);
         
         vecRecords.push_back(TxInfoRecord(addr, info, blockHash, indexTx, indexTxIn, indexInfo));
     }
@@ -355,26 +745,23 @@ std::vector<TxInfoRecord> CTxInfoStore::RecordsWithAddress(const CBitcoinAddress
 
 std::vector<TxInfoRecord> CTxInfoStore::RecordsWithKey(const TxInfoKey &key)
 {
-    SQLite::Statement query(db, "SELECT address, value, block_hash, index_tx, index_txin, index_info "
-                            "FROM TxDbEntry "
-                            "WHERE key_type=? AND key=?");
+    CReader reader(this);
+    SQLite::Statement &query = reader.Prepare("SELECT address, value, block_hash, index_tx, index_txin, index_info "
+                                              "FROM TxInfoEntry "
+                                              "WHERE key_type=? AND key=?");
+    CStatementReset reset(query);
     query.bind(1, key.type);
     query.bind(2, key.keyString);
     
     std::vector<TxInfoRecord> vecRecords;
     while (query.executeStep())
     {
-        std::string addressString = query.getColumn(0);
+        CBitcoinAddress address = GetAddressColumn(query, 0);
         std::string valueString = query.getColumn(1);
-        std::string blockHashString = query.getColumn(2);
+        uint256 blockHash = GetBlockHashColumn(query, 2);
         int indexTx = query.getColumn(3);
         int indexTxIn = query.getColumn(4);
         int indexInfo = query.getColumn(5);
-
-        CBitcoinAddress address(addressString);
-        
-        uint256 blockHash;
-        blockHash.SetHex(blockHashString);
         
         vecRecords.push_back(TxInfoRecord(address, CTxInfo(key, valueString),
                                           blockHash, indexTx, indexTxIn, indexInfo));
@@ -383,9 +770,96 @@ std::vector<TxInfoRecord> CTxInfoStore::RecordsWithKey(const TxInfoKey &key)
     return vecRecords;
 }
 
+std::vector<TxInfoRecord> CTxInfoStore::RecordsWithBlockHash(uint256 blockHash)
+{
+    CReader reader(this);
+    SQLite::Statement &query = reader.Prepare("SELECT address, key_type, key, value, index_tx, index_txin, index_info "
+                                              "FROM TxInfoEntry "
+                                              "WHERE block_hash=? "
+                                              "ORDER BY id");
+    CStatementReset reset(query);
+    BindBlockHash(query, 1, blockHash);
+    
+    std::vector<TxInfoRecord> vecRecords;
+    while (query.executeStep())
+    {
+        CBitcoinAddress address = GetAddressColumn(query, 0);
+        int keyType = query.getColumn(1);
+        std::string keyString = query.getColumn(2);
+        std::string valueString = query.getColumn(3);
+        int indexTx = query.getColumn(4);
+        int indexTxIn = query.getColumn(5);
+        int indexInfo = query.getColumn(6);
+        
+        vecRecords.push_back(TxInfoRecord(address, CTxInfo(TxInfoKey((TxInfoType)keyType, keyString), valueString),
+                                          blockHash, indexTx, indexTxIn, indexInfo));
+    }
+    
+    return vecRecords;
+}
+
+std::vector<TxInfoRecord> CTxInfoStore::RecordsWithAddress(const CBitcoinAddress &addr, bool fLatestOnly,
+                                                           int64 &nCursor, unsigned int nLimit)
+{
+    CReader reader(this);
+    SQLite::Statement &query = reader.Prepare("SELECT id, address, key_type, key, value, block_hash, index_tx, index_txin, index_info "
+                                              "FROM TxInfoEntry "
+                                              "WHERE address=? AND is_latest>=? AND id>? "
+                                              "ORDER BY id LIMIT ?");
+    CStatementReset reset(query);
+    BindAddress(query, 1, AddressKey(addr));
+    query.bind(2, fLatestOnly ? 1 : 0);
+    query.bind(3, (sqlite3_int64)nCursor);
+    query.bind(4, (int)nLimit);
+    return GetRecordPage(query, nCursor);
+}
+
+std::vector<TxInfoRecord> CTxInfoStore::RecordsWithKey(const TxInfoKey &key, const TxInfoValue *pvalue, bool fLatestOnly,
+                                                       int64 &nCursor, unsigned int nLimit)
+{
+    CReader reader(this);
+    SQLite::Statement &query = pvalue ?
+        reader.Prepare("SELECT id, address, key_type, key, value, block_hash, index_tx, index_txin, index_info "
+                       "FROM TxInfoEntry "
+                       "WHERE key_type=? AND key=? AND is_latest>=? AND id>? AND value=? "
+                       "ORDER BY id LIMIT ?") :
+        reader.Prepare("SELECT id, address, key_type, key, value, block_hash, index_tx, index_txin, index_info "
+                       "FROM TxInfoEntry "
+                       "WHERE key_type=? AND key=? AND is_latest>=? AND id>? "
+                       "ORDER BY id LIMIT ?");
+    CStatementReset reset(query);
+    query.bind(1, key.type);
+    query.bind(2, key.keyString);
+    query.bind(3, fLatestOnly ? 1 : 0);
+    query.bind(4, (sqlite3_int64)nCursor);
+    if (pvalue)
+        query.bind(5, *pvalue);
+    query.bind(pvalue ? 6 : 5, (int)nLimit);
+    return GetRecordPage(query, nCursor);
+}
+
+std::vector<TxInfoRecord> CTxInfoStore::RecordsWithKeyPrefix(unsigned char keyType, const std::string &strPrefix,
+                                                             int64 &nCursor, unsigned int nLimit)
+{
+    CReader reader(this);
+    // keys are made of ID characters, which all sort before '~'
+    SQLite::Statement &query = reader.Prepare("SELECT id, address, key_type, key, value, block_hash, index_tx, index_txin, index_info "
+                                              "FROM TxInfoEntry "
+                                              "WHERE key_type=? AND key>=? AND key<? AND is_latest=1 AND id>? "
+                                              "ORDER BY id LIMIT ?");
+    CStatementReset reset(query);
+    query.bind(1, keyType);
+    query.bind(2, strPrefix);
+    query.bind(3, strPrefix + "~");
+    query.bind(4, (sqlite3_int64)nCursor);
+    query.bind(5, (int)nLimit);
+    return GetRecordPage(query, nCursor);
+}
+
 
 bool CTxInfoStore::IsValid(const TxInfoRecord &record, std::string &reason)
 {
+    LOCK(cs_store);
     const CTxInfo &txDb = record.info;
     
     if (!txDb.IsValid(reason))
@@ -402,19 +876,7 @@ bool CTxInfoStore::IsValid(const TxInfoRecord &record, std::string &reason)
     
     if (txDb.key.type == INFO_UNIQUE || txDb.key.type == INFO_ID || txDb.key.type == INFO_WRITE_ONCE)
     {
-        SQLite::Statement query(db, "SELECT COUNT(*) "
-                                "FROM TxDbEntry "
-                                "WHERE address=? AND key_type=? AND key=?");
-        query.bind(1, record.addr.ToString());
-        query.bind(2, txDb.key.type);
-        query.bind(3, txDb.key.keyString);
-        int count = 0;
-        while (query.executeStep())
-        {
-            count = query.getColumn(0);
-        }
-        
-        if (count > 0)
+        if (CountRecords(record.addr, txDb.key) > 0)
         {
             reason = "A non-overwritable value has already been set";
             return false;
@@ -424,26 +886,211 @@ bool CTxInfoStore::IsValid(const TxInfoRecord &record, std::string &reason)
     return true;
 }
 
+int CTxInfoStore::CountRecords(const CBitcoinAddress &addr, const TxInfoKey &key)
+{
+    CReader reader(this);
+    SQLite::Statement &query = reader.Prepare("SELECT COUNT(*) "
+                                              "FROM TxInfoEntry "
+                                              "WHERE address=? AND key_type=? AND key=?");
+    CStatementReset reset(query);
+    BindAddress(query, 1, AddressKey(addr));
+    query.bind(2, key.type);
+    query.bind(3, key.keyString);
+    int count = 0;
+    while (query.executeStep())
+    {
+        count = query.getColumn(0);
+    }
+    return count;
+}
+
+void CTxInfoStore::BeginBulkLoad()
+{
+    LOCK(cs_store);
+    if (InTransaction())
+        throw std::runtime_error("Can't BeginBulkLoad() in a transaction");
+    
+    ClearStatements();
+    listLatest.clear();
+    mapLatest.clear();
+    setLatestDirty.clear();
+    nLatestGeneration++;
+    
+    // dropping the table drops its indexes, which are built once at the end
+    db.exec("DROP TABLE IF EXISTS TxInfoEntry");
+    CreateTable();
+    // a crash mid-load loses nothing that can't be rebuilt again
+    db.exec("PRAGMA synchronous=OFF");
+    BeginTransaction();
+}
+
+void CTxInfoStore::BulkInsert(const TxInfoRecord &infoRecord)
+{
+    LOCK(cs_store);
+    if (!InTransaction())
+        throw std::runtime_error("Can't BulkInsert() without a transaction");
+    
+    std::vector<unsigned char> vchAddr = AddressKey(infoRecord.addr);
+    SQLite::Statement &query = Prepare("INSERT INTO TxInfoEntry (is_latest, address, key_type, key, value, "
+                                       "                         block_hash, index_tx, index_txin, index_info) "
+                                       "VALUES (0, ?, ?, ?, ?, ?, ?, ?, ?)");
+    CStatementReset reset(query);
+    BindAddress(query, 1, vchAddr);
+    query.bind(2, infoRecord.info.key.type);
+    query.bind(3, infoRecord.info.key.keyString);
+    query.bind(4, infoRecord.info.value);
+    BindBlockHash(query, 5, infoRecord.blockHash);
+    query.bind(6, infoRecord.indexTx);
+    query.bind(7, infoRecord.indexTxIn);
+    query.bind(8, infoRecord.indexInfo);
+    query.exec();
+    
+    byteEstimate += 4 + 1 + vchAddr.size() + 1 + infoRecord.info.key.keyString.size() + infoRecord.info.value.size() + sizeof(uint256) + 12;
+}
+
+void CTxInfoStore::EndBulkLoad()
+{
+    LOCK(cs_store);
+    if (InTransaction())
+        Commit();
+    
+    {
+        SQLite::Transaction transaction(db);
+        // ids follow chain order, so the latest value of each key has the highest one
+        db.exec("UPDATE TxInfoEntry SET is_latest=1 "
+                "WHERE id IN (SELECT MAX(id) FROM TxInfoEntry GROUP BY address, key_type, key)");
+        CreateIndexes();
+        transaction.commit();
+    }
+    FillPrevLatest();
+    db.exec(fWAL ? "PRAGMA synchronous=NORMAL" : "PRAGMA synchronous=FULL");
+}
+
 void CTxInfoStore::DumpLatestInfos()
 {
-    SQLite::Statement query(db, "SELECT address, key_type, key, value "
-                                "FROM TxDbEntry "
-                                "WHERE is_latest=1 "
-                                "ORDER BY address");
-    while (query.executeStep()) {
-        std::string addr = query.getColumn(0);
-        int keyType = query.getColumn(1);
-        std::string key = query.getColumn(2);
-        std::string value = query.getColumn(3);
-        
-        printf("%s: %s\n", addr.c_str(), CTxInfo(TxInfoKey((TxInfoType)keyType, key), value).ToString().c_str());
+    {
+        CReader reader(this);
+        SQLite::Statement &query = reader.Prepare("SELECT address, key_type, key, value "
+                                                  "FROM TxInfoEntry "
+                                                  "WHERE is_latest=1 "
+                                                  "ORDER BY address");
+        CStatementReset reset(query);
+        while (query.executeStep()) {
+            std::string addr = GetAddressColumn(query, 0).ToString();
+            int keyType = query.getColumn(1);
+            std::string key = query.getColumn(2);
+            std::string value = query.getColumn(3);
+            
+            printf("%s: %s\n", addr.c_str(), CTxInfo(TxInfoKey((TxInfoType)keyType, key), value).ToString().c_str());
+        }
     }
+    
+    uint64 nHits, nMisses;
+    unsigned int nEntries;
+    GetLatestCacheStats(nHits, nMisses, nEntries);
+    printf("latest value cache: %d entries, %" PRI64u " hits, %" PRI64u " misses\n", nEntries, nHits, nMisses);
 }
 
+//------------------------------------------
 
+bool CTxInfoOverlay::IsValid(const TxInfoRecord &record, std::string &reason)
+{
+    const CTxInfo &txDb = record.info;
+    
+    if (!txDb.IsValid(reason))
+        return false;
+    
+    if (txDb.key.type == INFO_UNIQUE || txDb.key.type == INFO_ID)
+    {
+        if (UniqueAddressWithValue(txDb.key, txDb.value))
+        {
+            reason = "Unique value is already set";
+            return false;
+        }
+    }
+    
+    if (txDb.key.type == INFO_UNIQUE || txDb.key.type == INFO_ID || txDb.key.type == INFO_WRITE_ONCE)
+    {
+        if (mapLatest.count(MakeKey(record.addr.ToString(), txDb.key)) ||
+            store->CountRecords(record.addr, txDb.key) > 0)
+        {
+            reason = "A non-overwritable value has already been set";
+            return false;
+        }
+    }
+    
+    return true;
+}
 
+bool CTxInfoOverlay::Process(const TxInfoRecord &record, std::string &reason)
+{
+    if (!IsValid(record, reason))
+        return false;
+    
+    vPending.push_back(record);
+    mapLatest[MakeKey(record.addr.ToString(), record.info.key)] = record.info.value;
+    return true;
+}
 
+boost::optional<TxInfoValue> CTxInfoOverlay::Get(const CBitcoinAddress &addr, const TxInfoKey &key)
+{
+    std::map<LatestKey, TxInfoValue>::const_iterator it = mapLatest.find(MakeKey(addr.ToString(), key));
+    if (it != mapLatest.end())
+        return boost::optional<TxInfoValue>(it->second);
+    return store->Get(addr, key);
+}
 
+std::vector<CBitcoinAddress> CTxInfoOverlay::AddressesWithValue(const TxInfoKey &key, const TxInfoValue &value)
+{
+    std::vector<CBitcoinAddress> result;
+    
+    // the store's latest values, unless a pending write replaced them
+    std::vector<CBitcoinAddress> stored = store->AddressesWithValue(key, value);
+    for (std::vector<CBitcoinAddress>::const_iterator it = stored.begin(); it != stored.end(); ++it)
+    {
+        std::map<LatestKey, TxInfoValue>::const_iterator mi = mapLatest.find(MakeKey(it->ToString(), key));
+        if (mi == mapLatest.end() || mi->second == value)
+            result.push_back(*it);
+    }
+    
+    for (std::map<LatestKey, TxInfoValue>::const_iterator mi = mapLatest.begin(); mi != mapLatest.end(); ++mi)
+    {
+        if (mi->first.second.first != key.type || mi->first.second.second != key.keyString || mi->second != value)
+            continue;
+        CBitcoinAddress addr(mi->first.first);
+        if (std::find(result.begin(), result.end(), addr) == result.end())
+            result.push_back(addr);
+    }
+    
+    return result;
+}
 
+boost::optional<CBitcoinAddress> CTxInfoOverlay::UniqueAddressWithValue(const TxInfoKey &key, const TxInfoValue &value)
+{
+    if (!(key.type == INFO_UNIQUE || key.type == INFO_ID))
+        throw std::runtime_error("Only unique-type keys can have a unique address for a given value");
+    
+    std::vector<CBitcoinAddress> resultSet = AddressesWithValue(key, value);
+    if (resultSet.empty())
+        return boost::optional<CBitcoinAddress>();
+    if (resultSet.size() > 1)
+        throw std::runtime_error("Unique key has multiple addresses for one value!");
+    return boost::optional<CBitcoinAddress>(resultSet.front());
+}
 
+bool CTxInfoOverlay::Flush(std::string &reason)
+{
+    for (std::vector<TxInfoRecord>::const_iterator it = vPending.begin(); it != vPending.end(); ++it)
+    {
+        if (!store->Process(*it, reason))
+            return false;
+    }
+    Clear();
+    return true;
+}
 
+void CTxInfoOverlay::Clear()
+{
+    vPending.clear();
+    mapLatest.clear();
+}
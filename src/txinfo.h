@@ -6,12 +6,16 @@
 #define SHINYCOIN_TXINFO_H
 
 #include <algorithm>
+#include <list>
+#include <map>
+#include <set>
 
 #include <boost/optional/optional.hpp>
 #include <boost/filesystem.hpp>
 #include "SQLiteCpp/SQLiteCpp.h"
 
 #include "base58.h"
+#include "util.h"
 
 
 static std::string ignoreReason;
@@ -114,41 +118,114 @@ struct TxInfoRecord
         blockHash(blockHash_in), indexTx(indexTx_in), indexTxIn(indexTxIn_in), indexInfo(indexInfo_in) {}
 };
 
+/** Schema of the TxInfoEntry table, kept in PRAGMA user_version.
+ * Version 1 was the TxDbEntry table, with addresses and block hashes as text.
+ * Version 2 had no prev_latest_id.
+ */
+static const int TXINFO_STORE_VERSION = 3;
+
+/** Default number of (address, key) latest values CTxInfoStore keeps in memory. */
+static const unsigned int DEFAULT_TXINFO_CACHE = 50000;
+
 class CTxInfoStore
 {
 private:
     SQLite::Database db;
     SQLite::Transaction *curTransaction;
+    boost::thread::id idWriter;     // the thread that began curTransaction
     unsigned int byteEstimate;
+    bool fWAL;
+    
+    // Compiled statements by SQL text, for the life of the connection
+    std::map<std::string, SQLite::Statement *> mapStatements;
+    
+    // The GUI reads from its own thread
+    mutable CCriticalSection cs_store;
+    
+    // In WAL mode, reads from threads other than the writer's go through a
+    // second, read-only connection. They see the last commit and neither
+    // wait for nor hold up the writer.
+    SQLite::Database *pdbRead;
+    std::map<std::string, SQLite::Statement *> mapReadStatements;
+    mutable CCriticalSection cs_read;
+    class CReader;
+    friend class CReader;
+    
+    // Committed latest value per (address, key), or none, least recently used last.
+    // Keys written in the open transaction are listed in setLatestDirty and
+    // read from SQLite until it commits or rolls back.
+    typedef std::pair<std::vector<unsigned char>, std::pair<unsigned char, std::string> > LatestKey;
+    typedef std::list<std::pair<LatestKey, boost::optional<TxInfoValue> > > LatestList;
+    LatestList listLatest;
+    std::map<LatestKey, LatestList::iterator> mapLatest;
+    std::set<LatestKey> setLatestDirty;
+    unsigned int nLatestCacheSize;
+    uint64 nLatestHits, nLatestMisses;
+    unsigned int nLatestGeneration;     // bumped when a transaction ends
+    
+    static LatestKey MakeLatestKey(const std::vector<unsigned char> &vchAddr, const TxInfoKey &key);
+    void CacheLatest(const LatestKey &latestKey, const boost::optional<TxInfoValue> &value);
+    void ForgetDirtyLatest();
     
     void Initialize();
+    void Configure(const boost::filesystem::path &path, int64 nMmapSize, int nPageCacheMB);
+    void CreateTable();
+    void CreateIndexes();
+    void FillPrevLatest();
+    void MigrateTxDbEntry();
+    static SQLite::Statement &Prepare(SQLite::Database &database, std::map<std::string, SQLite::Statement *> &mapCache,
+                                      const char *pszQuery);
+    SQLite::Statement &Prepare(const char *pszQuery);
+    void ClearStatements();
+    
     bool _Process(const TxInfoRecord &infoRecord, std::string &reason);
     bool _Undo(const TxInfoRecord &infoRecord, std::string &reason);
+    void _UndoEntry(int64 id, int64 prevLatestId, const LatestKey &latestKey);
+    unsigned int _UndoBlock(uint256 blockHash);
     
 public:
-    explicit CTxInfoStore(const boost::filesystem::path &path) :
+    // nMmapSize bytes of the file are memory mapped, and each connection
+    // keeps nPageCacheMB of pages; 0 leaves SQLite's defaults
+    explicit CTxInfoStore(const boost::filesystem::path &path, unsigned int nLatestCacheSizeIn=DEFAULT_TXINFO_CACHE,
+                          bool fWALIn=false, int64 nMmapSize=0, int nPageCacheMB=0) :
     db(path.string(), SQLITE_OPEN_READWRITE|SQLITE_OPEN_CREATE)
     {
         curTransaction = NULL;
+        pdbRead = NULL;
         byteEstimate = 0;
+        fWAL = fWALIn;
+        nLatestCacheSize = nLatestCacheSizeIn;
+        nLatestHits = nLatestMisses = 0;
+        nLatestGeneration = 0;
         Initialize();
+        Configure(path, nMmapSize, nPageCacheMB);
     }
     
     ~CTxInfoStore()
     {
         if (InTransaction())
             Rollback();
+        ClearStatements();
+        delete pdbRead;
     }
     
     void Reset()
     {
-        db.exec("DROP TABLE TxDbEntry");
+        LOCK(cs_store);
+        ClearStatements();
+        listLatest.clear();
+        mapLatest.clear();
+        setLatestDirty.clear();
+        nLatestGeneration++;
+        db.exec("DROP TABLE TxInfoEntry");
         Initialize();
     }
     
     bool IsValid(const TxInfoRecord &infoRecord, std::string &reason=ignoreReason);
     bool Process(const TxInfoRecord &infoRecord, std::string &reason=ignoreReason);
     bool Undo(const TxInfoRecord &infoRecord, std::string &reason=ignoreReason);
+    // Undo every record of a block, newest first; returns how many there were
+    unsigned int UndoBlock(uint256 blockHash);
     
     boost::optional<TxInfoValue> Get(const CBitcoinAddress &addr, const TxInfoKey &key);
     std::vector<CBitcoinAddress> AddressesWithValue(const TxInfoKey &key, const TxInfoValue &value);
@@ -156,6 +233,21 @@ public:
     
     std::vector<TxInfoRecord> RecordsWithAddress(const CBitcoinAddress &addr);
     std::vector<TxInfoRecord> RecordsWithKey(const TxInfoKey &key);
+    // In the order they were processed
+    std::vector<TxInfoRecord> RecordsWithBlockHash(uint256 blockHash);
+    
+    // Pages of at most nLimit records in the order they were processed, for
+    // RPC. Each starts after nCursor and moves it to the last record returned.
+    std::vector<TxInfoRecord> RecordsWithAddress(const CBitcoinAddress &addr, bool fLatestOnly,
+                                                 int64 &nCursor, unsigned int nLimit);
+    std::vector<TxInfoRecord> RecordsWithKey(const TxInfoKey &key, const TxInfoValue *pvalue, bool fLatestOnly,
+                                             int64 &nCursor, unsigned int nLimit);
+    // Latest values of the keys of a type that start with strPrefix
+    std::vector<TxInfoRecord> RecordsWithKeyPrefix(unsigned char keyType, const std::string &strPrefix,
+                                                   int64 &nCursor, unsigned int nLimit);
+    
+    // Number of values ever set for key on addr, including overwritten ones
+    int CountRecords(const CBitcoinAddress &addr, const TxInfoKey &key);
     
     bool InTransaction() const;
     void BeginTransaction();
@@ -164,6 +256,15 @@ public:
     
     unsigned int GetCommitByteEstimate() const;
     
+    void GetLatestCacheStats(uint64 &nHits, uint64 &nMisses, unsigned int &nEntries) const;
+    
+    // Replace every record with ones given in chain order, for -rebuildtxinfo.
+    // BulkInsert() doesn't check records and leaves is_latest and the indexes
+    // to EndBulkLoad(); commit and begin again between batches as needed.
+    void BeginBulkLoad();
+    void BulkInsert(const TxInfoRecord &infoRecord);
+    void EndBulkLoad();
+    
     void DumpLatestInfos();
 };
 
@@ -202,4 +303,42 @@ public:
     }
 };
 
+
+/** Pending tx-info writes over a CTxInfoStore, kept in memory.
+ *
+ * Reads see the pending writes first and fall through to the store, so a
+ * transaction can be checked against everything before it without opening
+ * an SQLite write transaction. Nothing reaches the store until Flush().
+ */
+class CTxInfoOverlay
+{
+private:
+    typedef std::pair<std::string, std::pair<unsigned char, std::string> > LatestKey;
+    
+    CTxInfoStore *store;
+    std::vector<TxInfoRecord> vPending;
+    std::map<LatestKey, TxInfoValue> mapLatest;
+    
+    static LatestKey MakeKey(const std::string &addr, const TxInfoKey &key)
+    {
+        return std::make_pair(addr, std::make_pair(key.type, key.keyString));
+    }
+    
+public:
+    explicit CTxInfoOverlay(CTxInfoStore *storeIn) : store(storeIn) {}
+    
+    bool IsValid(const TxInfoRecord &infoRecord, std::string &reason=ignoreReason);
+    bool Process(const TxInfoRecord &infoRecord, std::string &reason=ignoreReason);
+    
+    boost::optional<TxInfoValue> Get(const CBitcoinAddress &addr, const TxInfoKey &key);
+    std::vector<CBitcoinAddress> AddressesWithValue(const TxInfoKey &key, const TxInfoValue &value);
+    boost::optional<CBitcoinAddress> UniqueAddressWithValue(const TxInfoKey &key, const TxInfoValue &value);
+    
+    // Writes the pending records to the store, in the order they were processed
+    bool Flush(std::string &reason=ignoreReason);
+    void Clear();
+    
+    unsigned int GetPendingCount() const { return vPending.size(); }
+};
+
 #endif
@@ -0,0 +1,179 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "unspent.h"
+#include "db.h"
+
+using namespace std;
+
+CUnspentCache* punspentCache = NULL;
+
+CUnspentCache::CUnspentCache(unsigned int nMaxEntriesIn, bool fDatabaseIn) :
+    nMaxEntries(nMaxEntriesIn), nDirty(0), fDatabase(fDatabaseIn), pdb(NULL), nHits(0), nMisses(0)
+{
+}
+
+CUnspentCache::~CUnspentCache()
+{
+    delete pdb;
+}
+
+// One handle for every lookup and flush, opened (and unspent.dat created)
+// the first time it is needed. Call with cs held.
+CUnspentDB* CUnspentCache::GetDB()
+{
+    if (!pdb && fDatabase)
+    {
+        try {
+            pdb = new CUnspentDB("cr+");
+        }
+        catch (std::exception& e) {
+            // without it every lookup is a miss, as when the set is empty
+            error("CUnspentCache::GetDB() : %s", e.what());
+            fDatabase = false;
+        }
+    }
+    return pdb;
+}
+
+void CUnspentCache::Set(const COutPoint& outpoint, const CUnspentOutput& unspent)
+{
+    CEntry& entry = mapEntries[outpoint];
+    if (!entry.fDirty)
+        nDirty++;
+    entry.unspent = unspent;
+    entry.fDirty = true;
+}
+
+bool CUnspentCache::Get(const COutPoint& outpoint, CUnspentOutput& unspent)
+{
+    LOCK(cs);
+    map<COutPoint, CEntry>::iterator mi = mapEntries.find(outpoint);
+    if (mi != mapEntries.end())
+    {
+        if (mi->second.unspent.IsNull())
+        {
+            nMisses++;
+            return false;
+        }
+        nHits++;
+        unspent = mi->second.unspent;
+        return true;
+    }
+
+    CUnspentDB* pdbRead = GetDB();
+    if (!pdbRead || !pdbRead->ReadUnspent(outpoint, unspent))
+    {
+        nMisses++;
+        return false;
+    }
+    nHits++;
+    if (mapEntries.size() < nMaxEntries)
+    {
+        CEntry& entry = mapEntries[outpoint];
+        entry.unspent = unspent;
+        entry.fDirty = false;
+    }
+    return true;
+}
+
+void CUnspentCache::ConnectTx(const CTransaction& tx, const CDiskTxPos& pos, int nHeight)
+{
+    LOCK(cs);
+    if (!tx.IsCoinBase())
+    {
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            Set(txin.prevout, CUnspentOutput());
+    }
+
+    uint256 hash = tx.GetHash();
+    for (unsigned int n = 0; n < tx.vout.size(); n++)
+        if (!tx.vout[n].IsEmpty())
+            Set(COutPoint(hash, n), CUnspentOutput(tx, n, pos, nHeight));
+}
+
+void CUnspentCache::DisconnectTx(const CTransaction& tx)
+{
+    LOCK(cs);
+    uint256 hash = tx.GetHash();
+    for (unsigned int n = 0; n < tx.vout.size(); n++)
+        if (!tx.vout[n].IsEmpty())
+            Set(COutPoint(hash, n), CUnspentOutput());
+}
+
+bool CUnspentCache::Flush()
+{
+    LOCK(cs);
+    if (nDirty && fDatabase)
+    {
+        // on failure the entries stay dirty, for the next flush to retry
+        CUnspentDB* pdbWrite = GetDB();
+        if (!pdbWrite)
+            return error("CUnspentCache::Flush() : unspent.dat is not open");
+        if (!pdbWrite->TxnBegin())
+            return error("CUnspentCache::Flush() : TxnBegin failed");
+        for (map<COutPoint, CEntry>::iterator mi = mapEntries.begin(); mi != mapEntries.end(); ++mi)
+        {
+            if (!mi->second.fDirty)
+                continue;
+            // erasing one that was never written fails harmlessly
+            if (mi->second.unspent.IsNull())
+                pdbWrite->EraseUnspent(mi->first);
+            else if (!pdbWrite->WriteUnspent(mi->first, mi->second.unspent))
+            {
+                pdbWrite->TxnAbort();
+                return error("CUnspentCache::Flush() : WriteUnspent failed");
+            }
+        }
+        if (!pdbWrite->TxnCommit())
+            return error("CUnspentCache::Flush() : TxnCommit failed");
+    }
+    if (fDebug && nDirty)
+        printf("CUnspentCache::Flush() : wrote %u of %u entries\n", nDirty, (unsigned int)mapEntries.size());
+
+    // everything is on disk now, so anything can be dropped
+    if (mapEntries.size() > nMaxEntries)
+        mapEntries.clear();
+    else
+    {
+        for (map<COutPoint, CEntry>::iterator mi = mapEntries.begin(); mi != mapEntries.end(); )
+        {
+            mi->second.fDirty = false;
+            if (mi->second.unspent.IsNull())
+                mapEntries.erase(mi++);
+            else
+                ++mi;
+        }
+    }
+    nDirty = 0;
+    return true;
+}
+
+void CUnspentCache::Close()
+{
+    LOCK(cs);
+    delete pdb;
+    pdb = NULL;
+    fDatabase = false;
+}
+
+unsigned int CUnspentCache::GetDirtyCount() const
+{
+    LOCK(cs);
+    return nDirty;
+}
+
+bool CUnspentCache::IsFull() const
+{
+    LOCK(cs);
+    return mapEntries.size() >= nMaxEntries;
+}
+
+void CUnspentCache::GetStats(uint64& nHitsRet, uint64& nMissesRet, uint64& nEntriesRet) const
+{
+    LOCK(cs);
+    nHitsRet = nHits;
+    nMissesRet = nMisses;
+    nEntriesRet = mapEntries.size();
+}
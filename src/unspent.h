@@ -0,0 +1,134 @@
+// Copyright (c) 2013-2014 The ShinyCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SHINYCOIN_UNSPENT_H
+#define SHINYCOIN_UNSPENT_H
+
+#include "main.h"
+
+#include <map>
+
+enum
+{
+    UNSPENT_COINBASE  = (1 << 0),
+    UNSPENT_COINSTAKE = (1 << 1),
+};
+
+static const unsigned int DEFAULT_UNSPENT_CACHE = 500000;
+
+class CUnspentDB;
+
+/** An unspent transaction output, with what validating a spend of it needs
+ * from the transaction and block it is in. */
+class CUnspentOutput
+{
+public:
+    CTxOut txout;
+    CDiskTxPos pos;         // of the transaction
+    int nHeight;
+    unsigned int nTime;     // of the transaction
+    unsigned int nFlags;
+
+    CUnspentOutput()
+    {
+        SetNull();
+    }
+
+    CUnspentOutput(const CTransaction& tx, unsigned int n, const CDiskTxPos& posIn, int nHeightIn)
+    {
+        txout = tx.vout[n];
+        pos = posIn;
+        nHeight = nHeightIn;
+        nTime = tx.nTime;
+        nFlags = (tx.IsCoinBase() ? UNSPENT_COINBASE : 0) | (tx.IsCoinStake() ? UNSPENT_COINSTAKE : 0);
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        if (!(nType & SER_GETHASH))
+            READWRITE(nVersion);
+        READWRITE(txout);
+        READWRITE(pos);
+        READWRITE(nHeight);
+        READWRITE(nTime);
+        READWRITE(nFlags);
+    )
+
+    void SetNull()
+    {
+        txout.SetNull();
+        pos.SetNull();
+        nHeight = 0;
+        nTime = 0;
+        nFlags = 0;
+    }
+
+    bool IsNull() const
+    {
+        return txout.IsNull();
+    }
+};
+
+/**
+ * The unspent output set, in unspent.dat behind a write-back cache. Changes
+ * stay in memory until Flush() writes them all in one database transaction.
+ *
+ * The set is not what decides whether an output is spent; the tx index
+ * still does. An entry is only used while its position matches its
+ * transaction's in the tx index, so one left behind by a crash or a block
+ * that failed to connect costs a block file read, and a missing one the
+ * same.
+ */
+class CUnspentCache
+{
+private:
+    struct CEntry
+    {
+        CUnspentOutput unspent;     // null once erased
+        bool fDirty;
+    };
+
+    mutable CCriticalSection cs;
+    std::map<COutPoint, CEntry> mapEntries;
+    unsigned int nMaxEntries;
+    unsigned int nDirty;
+    bool fDatabase;
+    CUnspentDB* pdb;            // kept open from first use until Close()
+    uint64 nHits;
+    uint64 nMisses;
+
+    CUnspentCache(const CUnspentCache&);
+    void operator=(const CUnspentCache&);
+
+    void Set(const COutPoint& outpoint, const CUnspentOutput& unspent);
+    CUnspentDB* GetDB();
+
+public:
+    // fDatabaseIn false keeps the set in memory only
+    explicit CUnspentCache(unsigned int nMaxEntriesIn=DEFAULT_UNSPENT_CACHE, bool fDatabaseIn=true);
+    ~CUnspentCache();
+
+    bool Get(const COutPoint& outpoint, CUnspentOutput& unspent);
+
+    // Spend tx's inputs and add its outputs, tx being at pos in a block at nHeight
+    void ConnectTx(const CTransaction& tx, const CDiskTxPos& pos, int nHeight);
+    // Take tx's outputs out of the set. Its inputs aren't put back: they are
+    // read from the block files when next spent.
+    void DisconnectTx(const CTransaction& tx);
+
+    // Write the changes to the database, and drop what's read back from the
+    // cache if it holds more than nMaxEntries
+    bool Flush();
+    // Let go of unspent.dat, before the database environment is flushed at
+    // shutdown; the cache is memory only after this
+    void Close();
+
+    unsigned int GetDirtyCount() const;
+    bool IsFull() const;
+    void GetStats(uint64& nHitsRet, uint64& nMissesRet, uint64& nEntriesRet) const;
+};
+
+extern CUnspentCache* punspentCache;
+
+#endif
@@ -8,6 +8,7 @@
 #define BITCOIN_WALLET_H
 
 #include "main.h"
+#include "kernel.h"
 #include "key.h"
 #include "keystore.h"
 #include "script.h"
@@ -74,6 +75,12 @@ private:
     // the maxmimum wallet format version: memory-only variable that specifies to what version this wallet may be upgraded
     int nWalletMaxVersion;
 
+    // Kernel inputs of the coins CreateCoinStake has searched, so each
+    // search is hashing only. Pruned when the best block changes.
+    std::map<COutPoint, CStakeKernelInput> mapStakeKernelInputs;
+    uint256 hashStakeKernelsBest;
+    bool GetStakeKernelInput(const CWalletTx* pcoin, unsigned int nOut, CStakeKernelInput& input);
+
 public:
     mutable CCriticalSection cs_wallet;
 